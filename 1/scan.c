@@ -3,6 +3,8 @@
 #include <ctype.h>
 #include <string.h>
 
+#include "keyword.h"
+
 /**
  * @file
  * 字句解析を行う為の関数を纏めている
@@ -61,17 +63,10 @@ int init_scan(const char * path)
 /**
  * @brief keyword listに含まれていかをチェックする
  * 予約語が含まれていた場合、そのトークンの種類を返す
+ * @param len string_attrに格納された名前の長さ
  * @return int
  */
-int check_keyword()
-{
-  for (int i = 0; i < KEYWORDSIZE; i++) {
-    if (strcmp(string_attr, key[i].keyword) == 0) {
-      return key[i].keytoken;
-    }
-  }
-  return TNAME;
-}
+int check_keyword(int len) { return lookupKeyword(string_attr, len); }
 
 /**
  * @brief 改行をチェックして、行番号をインクリメントする関数
@@ -151,7 +146,7 @@ int scan()
           return S_ERROR;
         cbuf = fgetc(fp);
       } while (isalnum(cbuf));
-      return check_keyword();
+      return check_keyword(i);
     } else if (isdigit(cbuf)) {
       // 数字の読み込み
       num_attr = 0;
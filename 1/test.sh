@@ -1,7 +1,7 @@
 #!/bin/bash
 rm *.gcda *.gcno *.o *.gcov tc
 
-gcc -coverage -c *.c
+gcc -coverage -I../common -c *.c
 gcc -coverage -o tc *.o
 
 for file in test/*.mpl; do
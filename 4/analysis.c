@@ -0,0 +1,164 @@
+#include "lpp.h"
+
+/**
+ * @file
+ * コード生成と中間表現の組み立ての両方で使う、トークン列と記号表を調べる関数と定数式の計算を実装している
+ *
+ * どちらもトークン列を先頭から読み直して命令を組み立てるので、括弧の対応や条件式の形の判定、
+ * 名前の解決、定数の畳み込みの結果が二つの経路で食い違わないように、ここに一つだけ置く。
+ */
+
+/**
+ * @brief 変数名のトークンから記号表の要素を引く関数。副プログラムの中では局所的な名前を優先する
+ *
+ * @param tokens トークン列
+ * @param tok 変数名のトークンの位置
+ * @param proc 副プログラムの中の場合はその名前。主プログラムの中ではNULL
+ * @return Symbol* 見つかった場合はその要素を返す。見つからなかった場合はNULLを返す。
+ */
+Symbol * resolveVar(TokenArray * tokens, int tok, const char * proc)
+{
+  Symbol * symbol = proc != NULL ? findSymbol(tokenStr(tokens, tok), proc) : NULL;
+  return symbol != NULL ? symbol : findSymbol(tokenStr(tokens, tok), NULL);
+}
+
+//! 位置tokの開き括弧に対応する閉じ括弧の位置を返す関数。丸括弧と角括弧をまとめて数える
+int matchingBracket(const TokenArray * tokens, int tok)
+{
+  int depth = 0;
+  for (int i = tok; i < tokens->size - 1; i++) {
+    switch (tokens->id[i]) {
+      case TLPAREN:
+      case TLSQPAREN:
+        depth++;
+        break;
+      case TRPAREN:
+      case TRSQPAREN:
+        if (--depth == 0) return i;
+        break;
+      default:
+        break;
+    }
+  }
+  return tokens->size - 1;
+}
+
+//! 括弧と角括弧の外側で、[start, end) の中の最初のトークンidの位置を返す関数。見つからない場合はendを返す
+int findTopLevel(const TokenArray * tokens, int start, int end, TokenID id)
+{
+  int depth = 0;
+  for (int i = start; i < end; i++) {
+    if (tokens->id[i] == TLPAREN || tokens->id[i] == TLSQPAREN) {
+      depth++;
+    } else if (tokens->id[i] == TRPAREN || tokens->id[i] == TRSQPAREN) {
+      depth--;
+    } else if (depth == 0 && tokens->id[i] == id) {
+      return i;
+    }
+  }
+  return end;
+}
+
+//! 位置tokから始まる実引数の直後の位置を返す関数。実引数は括弧の外側のコンマか閉じ括弧で終わる
+int argumentEnd(const TokenArray * tokens, int tok)
+{
+  int i = tok;
+  while (i < tokens->size - 1 && tokens->id[i] != TCOMMA && tokens->id[i] != TRPAREN) {
+    if (tokens->id[i] == TLPAREN || tokens->id[i] == TLSQPAREN) i = matchingBracket(tokens, i);
+    i++;
+  }
+  return i;
+}
+
+//! 実引数 [start, end) が変数か配列の要素だけからなるかを判定する関数
+bool isVariableArgument(const TokenArray * tokens, int start, int end)
+{
+  if (tokens->id[start] != TNAME) return false;
+  return end == start + 1 ||
+         (tokens->id[start + 1] == TLSQPAREN && matchingBracket(tokens, start + 1) == end - 1);
+}
+
+//! 条件式の範囲 [start, end) の中で、括弧の外側にある演算子を数える関数
+ConditionShape scanCondition(const TokenArray * tokens, int start, int end)
+{
+  ConditionShape shape = {0, 0, 0, 0, 0};
+  int depth = 0;
+  for (int i = start; i < end; i++) {
+    TokenID id = tokens->id[i];
+    if (id == TLPAREN || id == TLSQPAREN) {
+      depth++;
+    } else if (id == TRPAREN || id == TRSQPAREN) {
+      depth--;
+    } else if (depth > 0) {
+      continue;
+    } else if (isRelOp(id)) {
+      shape.relops++;
+    } else if (id == TOR) {
+      shape.ors++;
+    } else if (isAddOp(id)) {
+      shape.other_addops++;
+    } else if (id == TAND) {
+      shape.ands++;
+    } else if (isMulOp(id)) {
+      shape.other_mulops++;
+    }
+  }
+  return shape;
+}
+
+/**
+ * @brief 定数同士の二項演算をコンパイル時に計算する関数
+ * 桁あふれや0除算の場合は結果を0とし、実行時エラーのEOVF, E0DIVと同じ内容のメッセージを返す
+ * @param opr 演算子のトークン
+ * @param a 左オペランドの値
+ * @param b 右オペランドの値
+ * @param result 計算結果を格納する
+ * @return const char* 誤りを検出した場合はその内容。検出しなかった場合はNULL
+ */
+const char * foldWord(TokenID opr, int a, int b, int * result)
+{
+  long value;
+  *result = 0;
+  switch (opr) {
+    case TPLUS:
+      value = (long)a + b;
+      break;
+    case TMINUS:
+      value = (long)a - b;
+      break;
+    case TSTAR:
+      value = (long)a * b;
+      break;
+    case TDIV:
+      if (b == 0) return "Zero-Divide";
+      value = (long)a / b;
+      break;
+    case TAND:
+      value = a & b;
+      break;
+    case TOR:
+      value = a | b;
+      break;
+    case TEQUAL:
+      value = a == b;
+      break;
+    case TNOTEQ:
+      value = a != b;
+      break;
+    case TLE:
+      value = a < b;
+      break;
+    case TLEEQ:
+      value = a <= b;
+      break;
+    case TGR:
+      value = a > b;
+      break;
+    default:
+      value = a >= b;
+      break;
+  }
+  if (value < MIN_WORD || value > MAX_WORD) return "Overflow";
+  *result = (int)value;
+  return NULL;
+}
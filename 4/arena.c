@@ -0,0 +1,124 @@
+#include "arena.h"
+
+#include "lpp.h"
+
+/**
+ * @file
+ * アリーナアロケータを実装している
+ */
+
+/**
+ * @def ARENA_ALIGN
+ * 切り出す領域の境界。ポインタとlong doubleのどちらにも揃うようにする
+ */
+#define ARENA_ALIGN (sizeof(long double) > sizeof(void *) ? sizeof(long double) : sizeof(void *))
+
+//! アリーナが保持するブロック
+typedef struct ArenaBlock ArenaBlock;
+
+//! アリーナが保持するブロック
+struct ArenaBlock
+{
+  //! 一つ前に確保したブロック
+  ArenaBlock * prev;
+  //! 使用済みの大きさ
+  size_t used;
+  //! dataの大きさ
+  size_t size;
+  //! 切り出す領域
+  char data[];
+};
+
+struct Arena
+{
+  //! 現在切り出しているブロック
+  ArenaBlock * head;
+};
+
+/**
+ * @brief 新しいブロックを確保する
+ * ブロックはcallocで確保するので、切り出した領域は0で初期化されている
+ * @param prev 一つ前のブロック
+ * @param size 確保する大きさ
+ * @return ArenaBlock* 確保したブロック
+ */
+static ArenaBlock * newBlock(ArenaBlock * prev, size_t size)
+{
+  ArenaBlock * block = calloc(1, sizeof(ArenaBlock) + size);
+  if (block == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  block->prev = prev;
+  block->used = 0;
+  block->size = size;
+  return block;
+}
+
+/**
+ * @brief 新しいアリーナを生成する
+ * 
+ * @return Arena* 生成したアリーナ
+ */
+Arena * newArena(void)
+{
+  Arena * arena = malloc(sizeof(Arena));
+  if (arena == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  arena->head = newBlock(NULL, ARENA_BLOCK_SIZE);
+  return arena;
+}
+
+/**
+ * @brief アリーナから0で初期化された領域を切り出す
+ * 現在のブロックに収まらない場合は新しいブロックを確保する
+ * @param arena 切り出すアリーナ
+ * @param size 必要な大きさ
+ * @return void* 切り出した領域
+ */
+void * arenaAlloc(Arena * arena, size_t size)
+{
+  size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+  ArenaBlock * block = arena->head;
+  if (block->size - block->used < size) {
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    block = arena->head = newBlock(block, block_size);
+  }
+  void * p = block->data + block->used;
+  block->used += size;
+  return p;
+}
+
+/**
+ * @brief 文字列の先頭からlen文字をアリーナに複製する
+ * 
+ * @param arena 複製先のアリーナ
+ * @param s 複製する文字列
+ * @param len 複製する長さ
+ * @return char* 終端文字付きの複製された文字列
+ */
+char * arenaStrndup(Arena * arena, const char * s, size_t len)
+{
+  char * dst = arenaAlloc(arena, len + 1);
+  memcpy(dst, s, len);
+  dst[len] = '\0';
+  return dst;
+}
+
+/**
+ * @brief アリーナが確保したすべての領域を解放する
+ * 
+ * @param arena 解放するアリーナ
+ */
+void freeArena(Arena * arena)
+{
+  ArenaBlock * block = arena->head;
+  while (block != NULL) {
+    ArenaBlock * prev = block->prev;
+    free(block);
+    block = prev;
+  }
+  free(arena);
+}
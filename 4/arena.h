@@ -0,0 +1,30 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+/**
+ * @file
+ * 領域をまとめて確保し、先頭から順に切り出して返すアリーナアロケータ
+ * 
+ * 字句解析・構文解析・覗き穴最適化の各段階がそれぞれ1つのアリーナを持ち、
+ * その段階で生成される小さなオブジェクトはすべてそこから確保する。
+ * 個々のオブジェクトは解放せず、アリーナごとまとめて解放する。
+ * 構文解析のアリーナは記号表を参照し終えた時点で、覗き穴最適化のアリーナは最適化を終えた時点で解放する。
+ * 字句解析のアリーナにはインターンした名前があり、すべての段階が参照するのでプログラムの終了まで残す。
+ */
+
+/**
+ * @def ARENA_BLOCK_SIZE
+ * アリーナが一度に確保するブロックの大きさ
+ */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+//! アリーナの構造体
+typedef struct Arena Arena;
+
+Arena * newArena(void);
+void * arenaAlloc(Arena *, size_t);
+char * arenaStrndup(Arena *, const char *, size_t);
+void freeArena(Arena *);
+
+#endif
@@ -1,9 +1,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "ir.h"
 #include "lpp.h"
-static FILE * output_file;
-static Token * cur;
+
+//! 生成した命令を書き込む出力バッファ
+static Emitter * emitter;
+static TokenArray * tokens;
+static int cur;
 
 //! 定義されたプロシージャの名前を格納する変数
 static char * procname = NULL;
@@ -23,9 +27,107 @@ static bool loaded_address = false;
 //! 呼び出し変数の名前を格納する変数
 static char * call_var_name = NULL;
 
-//! プリントする文字列を格納する変数
+/**
+ * @def MAX_RANGE_FACTS
+ * 値の範囲を同時に記録しておく変数の数の上限。超えた分は範囲が不明な変数として扱う
+ */
+#define MAX_RANGE_FACTS 16
+
+//! 整数型の変数が取り得る値の範囲
+typedef struct
+{
+  //! 変数のラベル
+  const char * label;
+  //! 下限
+  int min;
+  //! 上限
+  int max;
+} RangeFact;
+
+//! プログラムのある地点で成り立つ変数の値の範囲の集合。記録されていない変数の範囲は不明とみなす
+typedef struct
+{
+  //! 範囲が分かっている変数
+  RangeFact facts[MAX_RANGE_FACTS];
+  //! 範囲が分かっている変数の数
+  int size;
+} RangeFacts;
+
+//! 現在の地点で成り立つ変数の値の範囲
+static RangeFacts range_facts;
+
+//! 配列の添字の範囲検査を生成する方針
+static BoundsCheck bounds_check = BOUNDS_CHECK_AUTO;
+
+//! 最適化のレベル。1以上の場合は実行時ライブラリを出力する前に覗き穴最適化をする
+static int optimization_level = 0;
+
+//! 到達できない副プログラムと参照されない変数の命令を生成しないかどうか。参照がすべて分かる2パスの場合だけ有効にする
+static bool strip_unused = false;
+
+//! 生成しなかった副プログラムの数と変数の数
+static int stripped_procedures = 0, stripped_variables = 0;
+
+//! 生成しなかった命令と定数の覗き穴最適化をする前の語数と、変数の領域の語数
+static int stripped_code_words = 0, stripped_data_words = 0;
+
+//! 生成しなかった副プログラムと変数の記号表の要素。生成しなかった順に並ぶ
+static const Symbol ** stripped_symbols;
+
+//! 生成しなかった要素の数と、確保済みの容量
+static int num_stripped_symbols = 0, stripped_symbols_capacity = 0;
+
+//! 実引数をレジスタで渡し、変更されない仮引数を値で渡すかどうか。呼び出しがすべて分かる2パスの場合だけ有効にする
+static bool register_arguments = false;
+
+//! 副プログラムの仮引数の渡し方を決めるために集める情報
+typedef struct
+{
+  //! 仮引数の記号表の要素。宣言の順に並ぶ
+  Symbol ** params;
+  //! 仮引数の数
+  int num_params;
+  //! 仮引数ごとの、副プログラムの中で変更され得るかどうか。呼び出す副プログラムを通して変更する場合を含む
+  bool * written;
+  //! 仮引数ごとの、呼び出しの間に実引数の変数が他の名前を通して変更され得るかどうか
+  bool * aliased;
+  //! 大域変数を変更し得るかどうか。呼び出す副プログラムが変更する場合を含む
+  bool writes_global;
+} ProcedureInfo;
+
+//! 記号表の要素の位置から副プログラムの情報を引く表。副プログラム以外の要素は使わない
+static ProcedureInfo * procedure_info;
+
+//! 式の値を参照渡しの実引数として渡すために、呼び出しごとに確保する領域のラベルの番号
+static int * argument_slots;
+
+//! 確保する領域の数と、確保済みの容量
+static int num_argument_slots = 0, argument_slots_capacity = 0;
+
+/**
+ * @def NUM_WORK_REGISTERS
+ * 式の途中結果を保持するために使う汎用レジスタの数
+ */
+#define NUM_WORK_REGISTERS 5
+
+//! 式の途中結果を保持する汎用レジスタ。GR1は式の結果、GR2は一時的な計算に使うのでGR3から割り当てる
+static const char * const work_registers[NUM_WORK_REGISTERS] = {"GR3", "GR4", "GR5", "GR6", "GR7"};
+
+//! 使用中の作業用レジスタの数
+static int work_register_depth = 0;
+
+//! ソースの行をコメントとして出力するために文字列を格納する行バッファ
 static char * print_buf = NULL;
 
+//! 行バッファに格納されている文字列の長さ
+static size_t print_len = 0;
+
+//! 行バッファに確保済みの容量
+static size_t print_capacity = 0;
+
+//! ソースの行をコメントとして出力するかどうか
+static bool source_comments = true;
+
 //! トークンの種類を表す文字列の配列
 static const char * token_str[NUMOFTOKEN + 1] = {
   "",       "NAME",   "program",   "var",     "array",   "of",     "begin",   "end",  "if",
@@ -40,111 +142,107 @@ DECLARE_STACK(PARAMETER, char *);
 //! 副プログラムの仮引数のカウント用変数
 PARAMETER parameter_stack;
 
-//! シンボルテーブルの構造体
-typedef struct Symbol Symbol;
+//! 主プログラムの開始番地を表すラベルの番号
+static int main_label;
 
-//! シンボルテーブルの構造体
-struct Symbol
-{
-  //! キー
-  char * key;
-  //! ラベル
-  char * label;
-  //! 型
-  char * type;
-  //! パラメータかどうか
-  bool ispara;
-};
+//! 脱出文で分岐する、最も内側の繰り返し文の直後のラベルの番号。繰り返し文の外では0
+static int loop_exit_label = 0;
 
-Symbol * symbols;
-
-//! 式の評価結果を表現する構造体
-typedef struct Obj * Obj;
-
-//! 式の評価結果を表現する構造体
-struct Obj
+//! 式の評価結果を表現する構造体。ヒープに確保せず値として受け渡す
+typedef struct
 {
-  //! 型
+  //! 型。評価に失敗した場合はTPRERROR
   TYPE_KIND type;
   //! 左辺値を持つ式かどうか
   bool isLVal;
-};
+  //! 定数に畳み込まれた式かどうか。定数の場合は命令を生成せず、GR1にも値を格納しない
+  bool isConst;
+  //! 定数に畳み込まれた式の値
+  int value;
+  //! 式の値の下限。不明な場合はMIN_WORD
+  int min;
+  //! 式の値の上限。不明な場合はMAX_WORD
+  int max;
+} Obj;
+
+//! 式の評価に失敗したことを表す評価結果
+static const Obj obj_error = {TPRERROR, false, false, 0, MIN_WORD, MAX_WORD};
+
+//! コード生成の結果。定数式の評価でエラーを検出した場合はERRORになる
+static int codegen_status = NORMAL;
+
+//! 式の評価に失敗したかどうかを判定する関数
+static bool isObjError(Obj obj) { return obj.type == TPRERROR; }
 
 static int pCompoundStatement();
 static int pStatement();
 static Obj pExpression();
+static Obj pLoadedExpression();
 
-//! Symbol構造体から一意に定まる変数名とプロシージャの組み合わせからsymbols配列から適切なsymbolを取得する関数
-static Symbol getSymbol(char * key)
+//! 変数名とプロシージャ名の組み合わせから適切なsymbolを取得する関数。procがNULLの場合は大域的な名前を探す
+static Symbol getSymbol(char * name, char * proc)
 {
-  for (int i = 0; symbols[i].key != NULL; i++) {
-    if (strcmp(symbols[i].key, key) == 0) {
-      return symbols[i];
-    }
-  }
-  Symbol symbol = {NULL, NULL, NULL, false};
-  return symbol;
+  Symbol * symbol = findSymbol(name, proc);
+  if (symbol != NULL) return *symbol;
+  Symbol not_found = {NULL, NULL, NULL, NULL, 0, false, NULL, true};
+  return not_found;
 }
 
-//! output_fileに文字列を改行付きで出力する関数
-static void println(char * fmt, ...)
+//! 出力バッファに長さを指定して文字列を改行付きで出力する関数
+static void genLine(const char * str, size_t len)
 {
-  va_list ap;
-  va_start(ap, fmt);
-  vfprintf(output_file, fmt, ap);
-  va_end(ap);
-  fprintf(output_file, "\n");
+  emitStr(emitter, str, len);
+  emitChar(emitter, '\n');
 }
 
-//! 文字列で表現された記号表を'|'で区切って破壊的な代入を行った後にSymbol構造体の配列に変換する関数
-static Symbol * parseSymbols(const SymbolBuffer * buf)
+//! 行バッファに長さを指定して文字列を追加する関数。容量が足りない場合は倍々に広げる
+static void appendPrintBuf(const char * str, size_t len)
 {
-  Symbol * symbols = malloc(sizeof(Symbol) * buf->line_count);
-  char * p = buf->buf;
-  for (int i = 0; i < buf->line_count; i++) {
-    symbols[i].key = p;
-    while (*p != '|') p++;
-    *p++ = '\0';
-    symbols[i].label = p;
-    while (*p != '|') p++;
-    *p++ = '\0';
-    symbols[i].type = p;
-    while (*p != '|') p++;
-    *p++ = '\0';
-    symbols[i].ispara = *p == '1';
-    while (*p != '\n') p++;
-    p++;
+  if (print_len + len + 1 > print_capacity) {
+    size_t capacity = print_capacity ? print_capacity : 256;
+    while (capacity < print_len + len + 1) capacity *= 2;
+    print_buf = realloc(print_buf, capacity);
+    if (print_buf == NULL) {
+      error("Memory allocation error");
+      exit(1);
+    }
+    print_capacity = capacity;
   }
-  return symbols;
+  memcpy(print_buf + print_len, str, len);
+  print_len += len;
+  print_buf[print_len] = '\0';
 }
 
-//! print_bufに文字列を格納していき、改行するタイミングでoutput_fileに出力する関数
-static void printToken(const Token * tok)
+//! トークンの字句を行バッファに追加する関数
+static void appendTokenText(int tok)
 {
-  if (print_buf == NULL) {
-    print_buf = malloc(sizeof(char) * 256);
-    print_buf[0] = '\0';
-    strcat(print_buf, ";\t");
+  if (tokens->kind[tok] == TK_KEYWORD || tokens->kind[tok] == TK_PUNCT) {
+    const char * str = token_str[tokens->id[tok]];
+    appendPrintBuf(str, strlen(str));
+  } else if (tokens->kind[tok] == TK_STR) {
+    appendPrintBuf("'", 1);
+    appendPrintBuf(tokens->loc[tok], tokens->loc_len[tok]);
+    appendPrintBuf("'", 1);
+  } else {
+    appendPrintBuf(tokens->loc[tok], tokens->loc_len[tok]);
   }
-  if (!at_bol && !tok->at_bol && tok->has_space) strcat(print_buf, " ");
+}
 
-  if ((at_bol || tok->at_bol) && tok->id != TPROGRAM) {
-    println("%s", print_buf);
-    print_buf[0] = '\0';
-    strcat(print_buf, ";\t");
+//! print_bufに文字列を格納していき、改行するタイミングで出力バッファに出力する関数
+static void printToken(int tok)
+{
+  if (!source_comments) return;
+  if (print_len == 0) appendPrintBuf(";\t", 2);
+  if (!at_bol && !tokens->at_bol[tok] && tokens->has_space[tok]) appendPrintBuf(" ", 1);
+
+  // 中間表現から命令を生成した直後は行バッファが空なので、空のコメントは出力しない
+  if ((at_bol || tokens->at_bol[tok]) && tokens->id[tok] != TPROGRAM && print_len > 2) {
+    genLine(print_buf, print_len);
+    print_len = 0;
+    appendPrintBuf(";\t", 2);
   }
 
-  if (tok->kind == TK_KEYWORD || tok->kind == TK_PUNCT) {
-    strcat(print_buf, token_str[tok->id]);
-  } else if (tok->kind == TK_NUM) {
-    strcat(print_buf, tok->str);
-  } else if (tok->kind == TK_STR) {
-    strcat(print_buf, "'");
-    strcat(print_buf, tok->str);
-    strcat(print_buf, "'");
-  } else {
-    strcat(print_buf, tok->str);
-  }
+  appendTokenText(tok);
   at_bol = false;
 }
 
@@ -152,7 +250,13 @@ static void printToken(const Token * tok)
 static void consumeToken()
 {
   printToken(cur);
-  cur = cur->next;
+  if (cur < tokens->size - 1) cur++;
+}
+
+//! トークンをコメントとして出力せずに一つ進める関数
+static void skipToken()
+{
+  if (cur < tokens->size - 1) cur++;
 }
 
 //! ラベルの番号を生成して返す関数
@@ -163,72 +267,290 @@ static int getLabelNum()
 }
 
 //! ラベルを生成する関数
-static void genLabel(int label) { println("L%04d", label); }
+static void genLabel(int label)
+{
+  emitLabelNum(emitter, label);
+  emitChar(emitter, '\n');
+}
+
+//! 命令のオペコードまでを出力する関数
+static void genOpcode(const char * opc)
+{
+  emitter->instructions++;
+  emitChar(emitter, '\t');
+  emitCStr(emitter, opc);
+  emitChar(emitter, '\t');
+}
 
-//! 命令を生成する関数
-static void genCode(char * opc, char * opr) { println("\t%s\t%s", opc, opr); }
+//! 命令を生成する関数。オペランドがない場合はoprにNULLを渡す
+static void genCode(const char * opc, const char * opr)
+{
+  if (opr == NULL) {
+    emitter->instructions++;
+    emitChar(emitter, '\t');
+    emitCStr(emitter, opc);
+    emitChar(emitter, '\n');
+    return;
+  }
+  genOpcode(opc);
+  emitCStr(emitter, opr);
+  emitChar(emitter, '\n');
+}
 
 //! ラベル付きの命令を生成する関数
-static void genCodeLabel(char * opc, int label) { println("\t%s\tL%04d", opc, label); }
+static void genCodeLabel(const char * opc, int label)
+{
+  genOpcode(opc);
+  emitLabelNum(emitter, label);
+  emitChar(emitter, '\n');
+}
+
+//! レジスタとラベルの番号で表す領域を指定する命令を生成する関数
+static void genCodeSlot(const char * opc, const char * reg, int slot)
+{
+  genOpcode(opc);
+  emitCStr(emitter, reg);
+  emitChar(emitter, ',');
+  emitLabelNum(emitter, slot);
+  emitChar(emitter, '\n');
+}
+
+//! レジスタに数値を指定する命令を生成する関数
+static void genCodeNum(const char * opc, const char * reg, int num)
+{
+  genOpcode(opc);
+  emitCStr(emitter, reg);
+  emitChar(emitter, ',');
+  emitInt(emitter, num);
+  emitChar(emitter, '\n');
+}
+
+//! レジスタとアドレスを指定する命令を生成する関数。インデックスレジスタがない場合はindexにNULLを渡す
+static void genCodeAddr(const char * opc, const char * reg, const char * label, const char * index)
+{
+  genOpcode(opc);
+  emitCStr(emitter, reg);
+  emitChar(emitter, ',');
+  emitCStr(emitter, label);
+  if (index != NULL) {
+    emitChar(emitter, ',');
+    emitCStr(emitter, index);
+  }
+  emitChar(emitter, '\n');
+}
+
+//! レジスタ間の命令を生成する関数
+static void genCodeRegs(const char * opc, const char * reg1, const char * reg2)
+{
+  genOpcode(opc);
+  emitCStr(emitter, reg1);
+  emitChar(emitter, ',');
+  emitCStr(emitter, reg2);
+  emitChar(emitter, '\n');
+}
+
+//! ラベル付きの領域確保の命令(DS, DC)を生成する関数
+static void genDefine(const char * label, const char * opc, int num)
+{
+  emitCStr(emitter, label);
+  emitChar(emitter, '\t');
+  emitCStr(emitter, opc);
+  emitChar(emitter, '\t');
+  emitInt(emitter, num);
+  emitChar(emitter, '\n');
+}
 
 //! 配列化どうかを判定する関数
-static bool isArray(Symbol key) { return key.type[0] == 'a'; }
+static bool isArray(Symbol key) { return key.arraysize > 0; }
+
+/**
+ * @brief GR1の値を空いている作業用レジスタに退避する関数
+ * 作業用レジスタが全て使用中の場合はスタックに積む
+ * @return const char* 退避先のレジスタ。スタックに積んだ場合はNULL
+ */
+static const char * saveOperand()
+{
+  if (work_register_depth < NUM_WORK_REGISTERS) {
+    const char * reg = work_registers[work_register_depth++];
+    genCodeRegs("LD", reg, "GR1");
+    return reg;
+  }
+  genCode("PUSH", "0,GR1");
+  return NULL;
+}
 
-//! 配列のサイズを型を表す文字列から取得する関数
-static int getArraySize(char * type)
+/**
+ * @brief saveOperandで退避した値を取り出す関数
+ * スタックに積んだ値はGR2にPOPする
+ * @param reg saveOperandが返したレジスタ
+ * @return const char* 退避した値を保持しているレジスタ
+ */
+static const char * restoreOperand(const char * reg)
 {
-  const char * p = strchr(type, '[');
-  p++;
-  char buf[64];
-  int i = 0;
-  while (*p != ']') {
-    buf[i++] = *p;
-    p++;
+  if (reg == NULL) {
+    genCode("POP", "GR2");
+    return "GR2";
   }
-  buf[i] = '\0';
-  return atoi(buf);
+  work_register_depth--;
+  return reg;
 }
 
-//! 変数の並びから命令を生成する関数
-static int pVarNames(bool isparam)
+/**
+ * @brief 名前が、主プログラムもしくは到達できる副プログラムから参照されているかを判定する関数
+ * 参照した副プログラムが到達できるかどうかは、先に決まっている必要がある
+ * @param symbol 名前
+ * @return true 参照されている場合
+ * @return false 参照されていない場合
+ */
+static bool isReferenced(const Symbol * symbol)
 {
-  Symbol symbol;
-  char key[256];
-  if (procname != NULL) {
-    snprintf(key, sizeof(key), "%s:%s", cur->str, procname);
-  } else {
-    strcpy(key, cur->str);
+  for (const LINE * line = symbol->id->irefp; line != NULL; line = line->nextlinep) {
+    if (line->refprocname == NULL) return true;
+    const Symbol * caller = findSymbol(line->refprocname, NULL);
+    if (caller != NULL && caller->reachable) return true;
   }
-  symbol = getSymbol(key);
-  if (isArray(symbol)) {
-    if (isparam) PARAMETER_push(&parameter_stack, symbol.label);
-    println("%s\tDS\t%d", symbol.label, getArraySize(symbol.type));
-  } else {
-    if (symbol.label == NULL) {
-      return error("Error at %d: Undefined variable %s", cur->line_no, cur->str);
+  return false;
+}
+
+/**
+ * @brief 主プログラムから呼び出しをたどって到達できる副プログラムを求める関数
+ * 副プログラムは宣言した後でしか呼び出せず、再帰呼び出しもできないので、呼び出し元は必ず後に宣言されている。
+ * 記号表を宣言と逆の順にたどれば、呼び出し元より先に呼び出し先を判定することはない
+ */
+static void findReachableProcedures()
+{
+  SymbolTable * table = getSymbolTable();
+  for (int i = table->size - 1; i >= 0; i--) {
+    Symbol * symbol = &table->symbols[i];
+    if (symbol->type->ttype == TPPROC) symbol->reachable = isReferenced(symbol);
+  }
+}
+
+//! 命令コードが文字列と一致するかを判定する関数
+static bool isOpcode(const char * opcode, size_t len, const char * name)
+{
+  return strlen(name) == len && memcmp(opcode, name, len) == 0;
+}
+
+/**
+ * @brief 出力した命令の列が占める語数を数える関数
+ * DCとDSの領域はデータの語数に、それ以外の命令と命令が参照する定数はコードの語数に加える
+ * @param text 命令の列
+ * @param len 命令の列の長さ
+ * @param code_words コードの語数を加える先
+ * @param data_words データの語数を加える先
+ */
+static void countWords(const char * text, size_t len, int * code_words, int * data_words)
+{
+  static const char * const register_forms[] = {"LD",  "ADDA", "ADDL", "SUBA", "SUBL",
+                                                 "AND", "OR",   "XOR",  "CPA",  "CPL"};
+  const char * end = text + len;
+  for (const char * line = text; line < end;) {
+    const char * eol = memchr(line, '\n', end - line);
+    if (eol == NULL) eol = end;
+    const char * opcode = *line == ';' ? NULL : memchr(line, '\t', eol - line);
+    line = eol + 1;
+    if (opcode == NULL) continue;
+
+    opcode++;
+    const char * operand = memchr(opcode, '\t', eol - opcode);
+    size_t opcode_len = (operand == NULL ? eol : operand) - opcode;
+    operand = operand == NULL ? eol : operand + 1;
+    size_t operand_len = eol - operand;
+    if (isOpcode(opcode, opcode_len, "DS")) {
+      *data_words += atoi(operand);
+      continue;
+    }
+    if (isOpcode(opcode, opcode_len, "DC")) {
+      (*data_words)++;
+      continue;
+    }
+    if (isOpcode(opcode, opcode_len, "START") || isOpcode(opcode, opcode_len, "END")) continue;
+
+    // 1語の命令はオペランドのないものとPOP、レジスタ同士の演算と比較
+    int words = 2;
+    if (operand_len == 0 || isOpcode(opcode, opcode_len, "POP")) words = 1;
+    for (size_t i = 0; i < sizeof(register_forms) / sizeof(register_forms[0]); i++) {
+      if (isOpcode(opcode, opcode_len, register_forms[i]) && operand_len == 7 && operand[4] == 'G')
+        words = 1;
+    }
+    // 定数は文字列なら文字数、それ以外は1語を占める
+    const char * literal = memchr(operand, '=', operand_len);
+    if (literal != NULL && literal[1] == '\'') {
+      for (const char * p = literal + 2; p < eol; p++) {
+        if (*p != '\'') {
+          words++;
+        } else if (p + 1 < eol && p[1] == '\'') {
+          words++;
+          p++;
+        }
+      }
+    } else if (literal != NULL) {
+      words++;
     }
-    if (isparam) PARAMETER_push(&parameter_stack, symbol.label);
-    println("%s\tDC\t0", symbol.label);
+    *code_words += words;
+  }
+}
+
+//! 生成しなかった副プログラムもしくは変数を、集計で名前を出力するために記録する関数
+static void noteStripped(const Symbol * symbol)
+{
+  if (num_stripped_symbols == stripped_symbols_capacity) {
+    stripped_symbols_capacity = stripped_symbols_capacity ? stripped_symbols_capacity * 2 : 16;
+    stripped_symbols = realloc(stripped_symbols, sizeof(Symbol *) * stripped_symbols_capacity);
+    if (stripped_symbols == NULL) {
+      error("Memory allocation error");
+      exit(1);
+    }
+  }
+  stripped_symbols[num_stripped_symbols++] = symbol;
+}
+
+/**
+ * @brief 到達できない副プログラムから生成した命令を取り消す関数
+ * 語数は覗き穴最適化をする前の命令で数える
+ * @param proc 取り消す副プログラムの記号表の要素
+ * @param mark 副プログラムの命令を生成する前の出力バッファの書き込み位置
+ */
+static void stripProcedure(const Symbol * proc, EmitterMark mark)
+{
+  stripped_procedures++;
+  noteStripped(proc);
+  countWords(
+    emitter->buf + mark.len, emitter->len - mark.len, &stripped_code_words, &stripped_data_words);
+  rewindEmitter(emitter, mark);
+  // 副プログラムの最後の行もコメントとして出力しない
+  print_len = 0;
+}
+
+//! 変数名を一つ読んで領域を確保する命令を生成する関数。参照されない変数の領域は確保しない
+static int pVarName(bool isparam)
+{
+  Symbol symbol = getSymbol(tokenStr(tokens, cur), procname);
+  if (symbol.label == NULL) {
+    return error("Error at %d: Undefined variable %s", tokens->line_no[cur], tokenStr(tokens, cur));
+  }
+  if (isparam) PARAMETER_push(&parameter_stack, symbol.label);
+  if (strip_unused && !isparam && !isReferenced(&symbol)) {
+    stripped_variables++;
+    noteStripped(findSymbol(tokenStr(tokens, cur), procname));
+    stripped_data_words += isArray(symbol) ? symbol.arraysize : 1;
+  } else if (isArray(symbol)) {
+    genDefine(symbol.label, "DS", symbol.arraysize);
+  } else {
+    genDefine(symbol.label, "DC", 0);
   }
   consumeToken();
-  while (cur->id == TCOMMA) {
+  return NORMAL;
+}
+
+//! 変数の並びから命令を生成する関数
+static int pVarNames(bool isparam)
+{
+  if (pVarName(isparam) == ERROR) return ERROR;
+  while (tokens->id[cur] == TCOMMA) {
     consumeToken();
-    if (procname != NULL) {
-      snprintf(key, sizeof(key), "%s:%s", cur->str, procname);
-    } else {
-      strcpy(key, cur->str);
-    }
-    symbol = getSymbol(key);
-    if (isArray(symbol)) {
-      if (isparam) PARAMETER_push(&parameter_stack, symbol.label);
-      println("%s\tDS\t%d", symbol.label, getArraySize(symbol.type));
-    } else {
-      if (symbol.label == NULL)
-        return error("Error at %d: Undefined variable %s", cur->line_no, cur->str);
-      if (isparam) PARAMETER_push(&parameter_stack, symbol.label);
-      println("%s\tDC\t0", symbol.label);
-      consumeToken();
-    }
+    if (pVarName(isparam) == ERROR) return ERROR;
   }
   return NORMAL;
 }
@@ -239,128 +561,527 @@ static int pVarDeclaration()
   consumeToken();
   at_bol = true;
   pVarNames(false);
-  while (cur->id != TSEMI) consumeToken();
+  while (tokens->id[cur] != TSEMI) consumeToken();
   consumeToken();
 
-  while (cur->id == TNAME) {
+  while (tokens->id[cur] == TNAME) {
     at_bol = true;
     pVarNames(false);
-    while (cur->id != TSEMI) consumeToken();
+    while (tokens->id[cur] != TSEMI) consumeToken();
     consumeToken();
   }
 
   return NORMAL;
 }
 
-//! 型を表す文字列から型を表すenum定数を返す関数
-static int decodeType(char * type)
+//! 変数の型を表すenum定数を返す関数。配列の場合は要素の型を返す
+static int getVarType(Symbol symbol)
 {
-  if (strncmp(type, "array", 5) == 0) {
-    char * p = strchr(type, '[');
-    if (!p) return -1;
+  switch (isArray(symbol) ? symbol.type->etp->ttype : symbol.type->ttype) {
+    case TPINT:
+    case TPARRAYINT:
+      return TPINT;
+    case TPBOOL:
+    case TPARRAYBOOL:
+      return TPBOOL;
+    case TPCHAR:
+    case TPARRAYCHAR:
+      return TPCHAR;
+    default:
+      return -1;
+  }
+}
+
+//! 変数名のトークンから記号表を引く関数。副プログラムの中では局所的な名前を優先する
+static Symbol lookupVar(int tok)
+{
+  Symbol * symbol = resolveVar(tokens, tok, procname);
+  return symbol != NULL ? *symbol : getSymbol(tokenStr(tokens, tok), NULL);
+}
 
-    while (*p != ']') {
-      if (*p == '\0') return -1;
-      p++;
+//! 副プログラムの情報を返す関数
+static ProcedureInfo * procedureInfo(const Symbol * procedure)
+{
+  return &procedure_info[procedure - getSymbolTable()->symbols];
+}
+
+/**
+ * @brief 実引数 [start, end) がアドレスを渡し得る変数であれば、その変数名の位置を返す関数
+ * 括弧や型変換で囲まれた変数も、生成する命令によってはアドレスを渡すので変数とみなす
+ * @param start 実引数の先頭の位置
+ * @param end 実引数の直後の位置
+ * @return int 変数名のトークンの位置。変数でない場合は-1
+ */
+static int argumentVariable(int start, int end)
+{
+  for (;;) {
+    bool cast = tokens->id[start] == TINTEGER || tokens->id[start] == TCHAR || tokens->id[start] == TBOOLEAN;
+    if (tokens->id[start] == TLPAREN && matchingBracket(tokens, start) == end - 1) {
+      start++;
+    } else if (cast && tokens->id[start + 1] == TLPAREN && matchingBracket(tokens, start + 1) == end - 1) {
+      start += 2;
+    } else {
+      break;
     }
-    p++;
+    end--;
+  }
+  return isVariableArgument(tokens, start, end) ? start : -1;
+}
 
-    if (strncmp(p, "of", 2) != 0) return -1;
-    p += 2;
+//! 副プログラムの中で変数が変更され得ることを記録する関数。主プログラムの中ではprocedureにNULLを渡す
+static void noteWrite(ProcedureInfo * procedure, const Symbol * var)
+{
+  if (procedure == NULL || var == NULL) return;
+  if (var->procname == NULL) {
+    procedure->writes_global = true;
+    return;
+  }
+  for (int i = 0; i < procedure->num_params; i++) {
+    if (procedure->params[i] == var) procedure->written[i] = true;
+  }
+}
 
-    while (isspace(*p)) p++;
+/**
+ * @brief 呼び出し元の二つの変数が同じ領域を指し得るかを判定する関数
+ * 仮引数は呼び出し元の外の領域を指すので、呼び出し元の局所変数以外のどの変数とも同じ領域を指し得る
+ */
+static bool mayAlias(const Symbol * a, const Symbol * b)
+{
+  if (a == b) return true;
+  bool a_local = a->procname != NULL && !a->ispara;
+  bool b_local = b->procname != NULL && !b->ispara;
+  return (a->ispara && !b_local) || (b->ispara && !a_local);
+}
 
-    if (strncmp(p, "integer", 7) == 0) return TPINT;
-    if (strncmp(p, "boolean", 7) == 0) return TPBOOL;
-    if (strncmp(p, "char", 4) == 0) return TPCHAR;
-    return -1;
+/**
+ * @brief 呼び出し文の実引数を調べ、呼び出し元が変更し得る変数と、呼び出し先の仮引数の別名を記録する関数
+ * 呼び出し先が変更し得る仮引数に渡した変数は、呼び出し元が変更するものとする。
+ * 変更されない仮引数の実引数の変数は、呼び出し先が大域変数か他の仮引数を通して変更し得る場合に別名があるとする
+ * @param caller 呼び出し元の副プログラム。主プログラムの場合はNULL
+ * @param tok 呼び出す副プログラム名のトークンの位置
+ */
+static void scanCallSite(ProcedureInfo * caller, int tok)
+{
+  const Symbol * symbol = findSymbol(tokenStr(tokens, tok), NULL);
+  if (symbol == NULL || symbol->type->ttype != TPPROC) return;
+  ProcedureInfo * callee = procedureInfo(symbol);
+  if (callee->writes_global && caller != NULL) caller->writes_global = true;
+  if (tokens->id[tok + 1] != TLPAREN || callee->num_params == 0) return;
+
+  Symbol ** actuals = malloc(sizeof(Symbol *) * callee->num_params);
+  if (actuals == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  int start = tok + 2;
+  for (int i = 0; i < callee->num_params; i++) {
+    int end = argumentEnd(tokens, start);
+    int var = argumentVariable(start, end);
+    actuals[i] = var >= 0 ? resolveVar(tokens, var, procname) : NULL;
+    if (callee->written[i]) noteWrite(caller, actuals[i]);
+    if (end < tokens->size - 1) start = end + 1;
+  }
+  for (int i = 0; i < callee->num_params; i++) {
+    if (actuals[i] == NULL || callee->written[i]) continue;
+    bool global = actuals[i]->procname == NULL || actuals[i]->ispara;
+    if (callee->writes_global && global) callee->aliased[i] = true;
+    for (int j = 0; j < callee->num_params; j++) {
+      if (j == i || !callee->written[j] || actuals[j] == NULL) continue;
+      if (mayAlias(actuals[i], actuals[j])) callee->aliased[i] = true;
+    }
+  }
+  free(actuals);
+}
+
+//! 副プログラムの宣言から仮引数を宣言の順に集める関数。tokは副プログラム名のトークンの位置
+static void collectParameters(ProcedureInfo * procedure, int tok)
+{
+  if (tokens->id[tok + 1] != TLPAREN) return;
+  int end = matchingBracket(tokens, tok + 1);
+  for (int i = tok + 2; i < end; i++) {
+    if (tokens->id[i] == TNAME) procedure->num_params++;
+  }
+  if (procedure->num_params == 0) return;
+  procedure->params = malloc(sizeof(Symbol *) * procedure->num_params);
+  procedure->written = calloc(procedure->num_params, sizeof(bool));
+  procedure->aliased = calloc(procedure->num_params, sizeof(bool));
+  if (procedure->params == NULL || procedure->written == NULL || procedure->aliased == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  int n = 0;
+  for (int i = tok + 2; i < end; i++) {
+    if (tokens->id[i] == TNAME) procedure->params[n++] = findSymbol(tokenStr(tokens, i), procname);
+  }
+}
+
+/**
+ * @brief 値で渡せる仮引数を求める関数
+ * 副プログラムは宣言した後でしか呼び出せず、再帰呼び出しもできないので、トークン列を先頭から一度たどれば、
+ * 呼び出し文を調べる時点で呼び出し先の情報は揃っている。
+ * 副プログラムの中で変更されず、どの呼び出しでも別名のない仮引数を値で渡す。
+ * 値で渡す仮引数は局所変数と同じに扱えるので、記号表の仮引数の印を外す
+ */
+static void findValueParameters()
+{
+  SymbolTable * table = getSymbolTable();
+  procedure_info = calloc(table->size + 1, sizeof(ProcedureInfo));
+  if (procedure_info == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  ProcedureInfo * current = NULL;
+  int depth = 0;
+  for (int i = 0; i < tokens->size - 1; i++) {
+    switch (tokens->id[i]) {
+      case TPROCEDURE: {
+        procname = tokenStr(tokens, i + 1);
+        const Symbol * procedure = findSymbol(procname, NULL);
+        current = procedure != NULL ? procedureInfo(procedure) : NULL;
+        if (current != NULL) collectParameters(current, i + 1);
+        break;
+      }
+      case TBEGIN:
+        depth++;
+        break;
+      case TEND:
+        if (--depth == 0) {
+          procname = NULL;
+          current = NULL;
+        }
+        break;
+      case TCALL:
+        scanCallSite(current, i + 1);
+        break;
+      case TREAD:
+      case TREADLN:
+        if (tokens->id[i + 1] != TLPAREN) break;
+        for (int arg = i + 2; arg < tokens->size - 1; arg++) {
+          noteWrite(current, resolveVar(tokens, arg, procname));
+          arg = argumentEnd(tokens, arg);
+          if (tokens->id[arg] != TCOMMA) break;
+        }
+        break;
+      case TNAME:
+        if (tokens->id[i + 1] == TASSIGN ||
+            (tokens->id[i + 1] == TLSQPAREN && tokens->id[matchingBracket(tokens, i + 1) + 1] == TASSIGN))
+          noteWrite(current, resolveVar(tokens, i, procname));
+        break;
+      default:
+        break;
+    }
+  }
+  procname = NULL;
+
+  for (int i = 0; i < table->size; i++) {
+    ProcedureInfo * procedure = &procedure_info[i];
+    for (int j = 0; j < procedure->num_params; j++) {
+      if (!procedure->written[j] && !procedure->aliased[j]) procedure->params[j]->ispara = false;
+    }
+  }
+}
+
+//! 参照渡しの実引数の式の値を格納する領域を確保し、ラベルの番号を返す関数
+static int newArgumentSlot()
+{
+  if (num_argument_slots == argument_slots_capacity) {
+    argument_slots_capacity = argument_slots_capacity ? argument_slots_capacity * 2 : 16;
+    argument_slots = realloc(argument_slots, sizeof(int) * argument_slots_capacity);
+    if (argument_slots == NULL) {
+      error("Memory allocation error");
+      exit(1);
+    }
+  }
+  int slot = getLabelNum();
+  argument_slots[num_argument_slots++] = slot;
+  return slot;
+}
+
+//! 副プログラムもしくは主プログラムの中で確保した実引数の領域を生成する関数
+static void genArgumentSlots()
+{
+  for (int i = 0; i < num_argument_slots; i++) {
+    emitLabelNum(emitter, argument_slots[i]);
+    emitStr(emitter, "\tDS\t1\n", 6);
+  }
+  num_argument_slots = 0;
+}
+
+//! 評価結果の値の下限を返す関数
+static int objMin(Obj obj) { return obj.isConst ? obj.value : obj.min; }
+
+//! 評価結果の値の上限を返す関数
+static int objMax(Obj obj) { return obj.isConst ? obj.value : obj.max; }
+
+//! 値の範囲を記録する変数かどうかを判定する関数。仮引数は他の変数と同じ場所を指すことがあるので記録しない
+static bool isRangeTracked(Symbol symbol)
+{
+  return symbol.label != NULL && !symbol.ispara && !isArray(symbol) && getVarType(symbol) == TPINT;
+}
+
+//! 変数の値の範囲を記録している要素を返す関数。記録していない場合はNULLを返す
+static RangeFact * findRange(const char * label)
+{
+  for (int i = 0; i < range_facts.size; i++) {
+    if (range_facts.facts[i].label == label) return &range_facts.facts[i];
+  }
+  return NULL;
+}
+
+//! 変数の値の範囲を評価結果に設定する関数。範囲を記録していない変数の場合は評価結果を変更しない
+static void getVarRange(const char * label, Obj * obj)
+{
+  RangeFact * fact = findRange(label);
+  if (fact == NULL) return;
+  obj->min = fact->min;
+  obj->max = fact->max;
+}
+
+//! 変数の値の範囲を記録する関数。範囲が整数全体の場合は記録を消す
+static void setVarRange(const char * label, int min, int max)
+{
+  RangeFact * fact = findRange(label);
+  if (min == MIN_WORD && max == MAX_WORD) {
+    if (fact != NULL) *fact = range_facts.facts[--range_facts.size];
+    return;
+  }
+  if (fact == NULL) {
+    if (range_facts.size == MAX_RANGE_FACTS) return;
+    fact = &range_facts.facts[range_facts.size++];
+    fact->label = label;
+  }
+  fact->min = min;
+  fact->max = max;
+}
+
+//! 変数の値の範囲を、条件から分かった範囲との共通部分に狭める関数
+static void narrowVarRange(const char * label, int min, int max)
+{
+  RangeFact * fact = findRange(label);
+  if (fact != NULL) {
+    if (fact->min > min) min = fact->min;
+    if (fact->max < max) max = fact->max;
+  }
+  // 共通部分が空になるのは実行されることのない部分なので、範囲は狭めない
+  if (min > max) return;
+  setVarRange(label, min, max);
+}
+
+//! 二つの経路が合流する地点の範囲を求める関数。現在の範囲とotherの両方に記録されている変数だけを、両者を含む範囲で残す
+static void joinRanges(const RangeFacts * other)
+{
+  RangeFacts joined;
+  joined.size = 0;
+  for (int i = 0; i < range_facts.size; i++) {
+    RangeFact fact = range_facts.facts[i];
+    for (int j = 0; j < other->size; j++) {
+      if (other->facts[j].label != fact.label) continue;
+      if (other->facts[j].min < fact.min) fact.min = other->facts[j].min;
+      if (other->facts[j].max > fact.max) fact.max = other->facts[j].max;
+      joined.facts[joined.size++] = fact;
+      break;
+    }
+  }
+  range_facts = joined;
+}
+
+//! 関係演算子の否定を返す関数
+static int negateRelation(int opr)
+{
+  switch (opr) {
+    case TEQUAL:
+      return TNOTEQ;
+    case TNOTEQ:
+      return TEQUAL;
+    case TLE:
+      return TGREQ;
+    case TLEEQ:
+      return TGR;
+    case TGR:
+      return TLEEQ;
+    default:
+      return TLE;
+  }
+}
+
+//! 左辺と右辺を入れ替えた場合の関係演算子を返す関数
+static int mirrorRelation(int opr)
+{
+  switch (opr) {
+    case TLE:
+      return TGR;
+    case TLEEQ:
+      return TGREQ;
+    case TGR:
+      return TLE;
+    case TGREQ:
+      return TLEEQ;
+    default:
+      return opr;
+  }
+}
+
+/**
+ * @brief 変数と右辺の関係が成り立つことから、変数の値の範囲を狭める関数
+ * 
+ * @param label 変数のラベル
+ * @param opr 関係演算子。変数が左辺になる向きで渡す
+ * @param min 右辺の値の下限
+ * @param max 右辺の値の上限
+ */
+static void recordRelation(const char * label, int opr, int min, int max)
+{
+  switch (opr) {
+    case TEQUAL:
+      narrowVarRange(label, min, max);
+      break;
+    case TLE:
+      if (max > MIN_WORD) narrowVarRange(label, MIN_WORD, max - 1);
+      break;
+    case TLEEQ:
+      narrowVarRange(label, MIN_WORD, max);
+      break;
+    case TGR:
+      if (min < MAX_WORD) narrowVarRange(label, min + 1, MAX_WORD);
+      break;
+    case TGREQ:
+      narrowVarRange(label, min, MAX_WORD);
+      break;
+    default:
+      // <>から分かる範囲は一つの区間で表せない
+      break;
   }
-  if (strcmp(type, "integer") == 0) return TPINT;
-  if (strcmp(type, "boolean") == 0) return TPBOOL;
-  if (strcmp(type, "char") == 0) return TPCHAR;
-  return -1;
 }
 
 //! 変数から命令を生成する関数
 static int pVar()
 {
-  Symbol symbol;
-  if (procname != NULL) {
-    char key[256];
-    snprintf(key, sizeof(key), "%s:%s", cur->str, procname);
-    symbol = getSymbol(key);
-    if (symbol.label == NULL) symbol = getSymbol(cur->str);
-    if (symbol.label == NULL)
-      return error("Error at %d: Undefined variable %s", cur->line_no, cur->str);
-  } else {
-    symbol = getSymbol(cur->str);
-  }
+  Symbol symbol = lookupVar(cur);
+  if (procname != NULL && symbol.label == NULL)
+    return error("Error at %d: Undefined variable %s", tokens->line_no[cur], tokenStr(tokens, cur));
   consumeToken();
-  if (cur->id == TLSQPAREN) {
+  if (tokens->id[cur] == TLSQPAREN) {
     consumeToken();
     // Expressionの結果はGR1に格納されている
     bool isAddress2 = needs_address_load;
     needs_address_load = false;
-    if (pExpression() == NULL) return ERROR;
+    Obj index;
+    if (isObjError(index = pLoadedExpression())) return ERROR;
     needs_address_load = isAddress2;
-    // 配列の添字が0より大きいかをチェック(GR0には0が常に格納されている)
-    genCode("CPA", "GR1,GR0");
-    genCode("JMI", "EROV");
-    // 配列の添字が配列のサイズより小さいかをチェック
-    println("\tLAD\tGR2,%d", getArraySize(symbol.type) - 1);
-    genCode("CPA", "GR1,GR2");
-    genCode("JPL", "EROV");
+    // 範囲内にあることが分かっている添字は検査しない
+    bool check_lower = bounds_check == BOUNDS_CHECK_ALWAYS || (bounds_check == BOUNDS_CHECK_AUTO && index.min < 0);
+    bool check_upper = bounds_check == BOUNDS_CHECK_ALWAYS ||
+                       (bounds_check == BOUNDS_CHECK_AUTO && index.max > symbol.arraysize - 1);
+    if (check_lower) {
+      // 配列の添字が0より大きいかをチェック(GR0には0が常に格納されている)
+      genCode("CPA", "GR1,GR0");
+      genCode("JMI", "EROV");
+    }
+    if (check_upper) {
+      // 配列の添字が配列のサイズより小さいかをチェック
+      genCodeNum("LAD", "GR2", symbol.arraysize - 1);
+      genCode("CPA", "GR1,GR2");
+      genCode("JPL", "EROV");
+    }
     // GR1の分offsetを考慮して配列にアクセスする
 
+    // 前の変数で設定したままの印で、読み込んだ要素の値をさらに参照しないようにする
     if (needs_address_load && !symbol.ispara) {
-      println("\tLAD\tGR1,%s,GR1", symbol.label);
+      genCodeAddr("LAD", "GR1", symbol.label, "GR1");
+      loaded_address = true;
     } else {
-      println("\tLD\tGR1,%s,GR1", symbol.label);
+      genCodeAddr("LD", "GR1", symbol.label, "GR1");
+      loaded_address = false;
     }
 
-    if (cur->id != TRSQPAREN) {
-      return error("Error at %d: Expected ']'", cur->line_no);
+    if (tokens->id[cur] != TRSQPAREN) {
+      return error("Error at %d: Expected ']'", tokens->line_no[cur]);
     }
     consumeToken();
   } else {
     if (symbol.label == NULL) {
-      return error("Error at %d: Undefined variable %s", cur->line_no, cur->str);
+      return error("Error at %d: Undefined variable %s", tokens->line_no[cur], tokenStr(tokens, cur));
     }
     if (needs_address_load && !symbol.ispara) {
-      println("\tLAD\tGR1,%s", symbol.label);
+      genCodeAddr("LAD", "GR1", symbol.label, NULL);
       loaded_address = true;
     } else {
-      println("\tLD\tGR1,%s", symbol.label);
+      genCodeAddr("LD", "GR1", symbol.label, NULL);
       loaded_address = false;
     }
   }
-  int type = decodeType(symbol.type);
-  if (type == -1) return error("Error at %d: Undefined type %s", cur->line_no, symbol.type);
+  int type = getVarType(symbol);
+  if (type == -1) return error("Error at %d: Undefined type of %s", tokens->line_no[cur], symbol.name);
   is_parameter = symbol.ispara;
   call_var_name = symbol.label;
   return type;
 }
 
+/**
+ * @brief トークンの位置から始まる因子が、レジスタを使わずに値を読み込める単純な因子かを判定する関数
+ * 定数と配列でない変数が該当する
+ * @param tok 因子の先頭のトークンの位置
+ * @return true 単純な因子の場合
+ * @return false それ以外の場合
+ */
+static bool isLeafFactor(int tok)
+{
+  switch (tokens->id[tok]) {
+    case TNUMBER:
+    case TTRUE:
+    case TFALSE:
+    case TSTRING:
+      return true;
+    case TNAME: {
+      if (tokens->id[tok + 1] == TLSQPAREN) return false;
+      Symbol symbol = lookupVar(tok);
+      return symbol.label != NULL && !isArray(symbol);
+    }
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief isLeafFactorを満たす変数の値をGR2に読み込む命令を生成する関数
+ * 左オペランドはGR1に残したまま、右オペランドをGR2に読み込んで演算するために使う
+ */
+static void genLeafFactor()
+{
+  Symbol symbol = lookupVar(cur);
+  genCodeAddr("LD", "GR2", symbol.label, NULL);
+  // 仮引数には実引数のアドレスが格納されている
+  if (symbol.ispara) genCode("LD", "GR2,0,GR2");
+  consumeToken();
+}
+
 //! 代入文から命令を生成する関数
 static int pAssignment()
 {
   Obj lhs;
+  Symbol target = lookupVar(cur);
+  bool scalar = tokens->id[cur + 1] != TLSQPAREN;
   needs_address_load = true;
   if (pVar() == ERROR) return ERROR;
   needs_address_load = false;
-  genCode("PUSH", "0,GR1");
+  const char * address = saveOperand();
 
-  if (cur->id != TASSIGN) return error("Error at %d: Expected ':='", cur->line_no);
+  if (tokens->id[cur] != TASSIGN) return error("Error at %d: Expected ':='", tokens->line_no[cur]);
   consumeToken();
 
   // Expressionの結果はGR1に格納されている
-  if ((lhs = pExpression()) == NULL) return ERROR;
+  if (isObjError(lhs = pLoadedExpression())) return ERROR;
 
-  // 左辺部の変数のアドレスをスタックからPOP
-  genCode("POP", "GR2");
-  // GR2には変数のアドレスが格納されているので、そのアドレスにGR1の値を格納する
-  genCode("ST", "GR1,0,GR2");
+  // 退避しておいた左辺部の変数のアドレスに、GR1の値を格納する
+  address = restoreOperand(address);
+  genCodeAddr("ST", "GR1", "0", address);
 
+  // 仮引数は他の変数と同じ場所を指していることがあるので、どの変数の範囲も分からなくなる
+  if (scalar && target.ispara) {
+    range_facts.size = 0;
+  } else if (scalar && isRangeTracked(target)) {
+    setVarRange(target.label, lhs.min, lhs.max);
+  }
   return NORMAL;
 }
 
@@ -378,91 +1099,144 @@ static void genStoreBoolean()
   genLabel(labelEnd);
 }
 
-//! 因子から命令を生成する関数
+//! 定数の因子を表す評価結果を返す関数
+static Obj constantObj(TYPE_KIND type, int value)
+{
+  Obj obj = {type, false, true, value, value, value};
+  return obj;
+}
+
+/**
+ * @brief 定数式の評価で実行時エラーと同じ誤りを検出したことを報告する関数
+ * 実行時エラーのEOVF, E0DIVと同じ内容のメッセージを出力する。
+ * 続くエラーも報告できるようにコード生成は続け、最後に失敗させる
+ * @param message エラーの内容
+ */
+static void constantError(const char * message)
+{
+  codegen_status = ERROR;
+  error("Error at %d: %s", tokens->line_no[cur], message);
+}
+
+/**
+ * @brief 定数同士の二項演算をコンパイル時に計算する関数
+ * オーバーフローや0除算の場合はエラーを報告し、結果を0とする
+ * @param lhs 左オペランド。計算結果で上書きされる
+ * @param opr 演算子
+ * @param value 右オペランドの値
+ */
+static void foldConstants(Obj * lhs, int opr, int value)
+{
+  const char * message = foldWord(opr, lhs->value, value, &lhs->value);
+  if (message != NULL) constantError(message);
+}
+
+//! 定数に畳み込まれた式の値をGR1に読み込む関数
+static void genLoadConstant(Obj * obj)
+{
+  if (!obj->isConst) return;
+  genCodeNum("LAD", "GR1", obj->value);
+  obj->isConst = false;
+  obj->min = obj->max = obj->value;
+}
+
+//! GR1の値の符号を反転する関数。GR0には常に0が格納されているので、GR0からの減算で求める
+static void genNegate()
+{
+  genCodeRegs("LD", "GR2", "GR1");
+  genCodeRegs("LD", "GR1", "GR0");
+  genCodeRegs("SUBA", "GR1", "GR2");
+  genCode("JOV", "EOVF");
+}
+
+//! 因子から命令を生成する関数。定数の因子は命令を生成せず、値を評価結果に格納して返す
 static Obj pFactor()
 {
-  Obj factor, expression;
-  factor = malloc(sizeof(struct Obj));
-  expression = malloc(sizeof(struct Obj));
-  switch (cur->id) {
+  Obj factor = obj_error, expression;
+  switch (tokens->id[cur]) {
     // 変数
     case TNAME:
-      factor->isLVal = true;
-      if ((factor->type = pVar()) == TPRERROR) return NULL;
+      factor.isLVal = true;
+      if ((factor.type = pVar()) == TPRERROR) return obj_error;
       if (is_parameter || loaded_address) genCode("LD", "GR1,0,GR1");
+      getVarRange(call_var_name, &factor);
       break;
     // 定数
     case TNUMBER:
-      factor->type = TPINT;
-      factor->isLVal = false;
-      println("\tLAD\tGR1,%d", cur->num);
+      factor = constantObj(TPINT, tokens->num[cur]);
       consumeToken();
       break;
     case TFALSE:
-      factor->type = TPBOOL;
-      factor->isLVal = false;
-      println("\tLAD\tGR1,0");
+      factor = constantObj(TPBOOL, 0);
       consumeToken();
       break;
     case TTRUE:
-      factor->type = TPBOOL;
-      factor->isLVal = false;
-      println("\tLAD\tGR1,1");
+      factor = constantObj(TPBOOL, 1);
       consumeToken();
       break;
     case TSTRING:
-      factor->type = TPCHAR;
-      factor->isLVal = false;
-      println("\tLAD\tGR1,%d", (int)*cur->str);
+      factor = constantObj(TPCHAR, (int)*tokens->loc[cur]);
       consumeToken();
       break;
       // "(" Expression ")"
     case TLPAREN:
       consumeToken();
-      if ((factor = pExpression()) == NULL) return NULL;
-      if (cur->id != TRPAREN) {
-        error("Error at %d: Expected ')'", cur->line_no);
-        return NULL;
+      if (isObjError(factor = pExpression())) return obj_error;
+      if (tokens->id[cur] != TRPAREN) {
+        error("Error at %d: Expected ')'", tokens->line_no[cur]);
+        return obj_error;
       }
       consumeToken();
       break;
     case TNOT:
       consumeToken();
-      if ((factor = pFactor()) == NULL) return NULL;
-      genCode("LAD", "GR2,1");
-      genCode("XOR", "GR1,GR2");
+      if (isObjError(factor = pFactor())) return obj_error;
+      if (factor.isConst) {
+        factor.value ^= 1;
+      } else {
+        genCode("LAD", "GR2,1");
+        genCode("XOR", "GR1,GR2");
+      }
+      factor.isLVal = false;
+      factor.min = MIN_WORD;
+      factor.max = MAX_WORD;
       break;
       // 標準型 "(" Expression ")"
     case TINTEGER:
-      factor->type = TPINT;
+      factor.type = TPINT;
       consumeToken();
-      if (cur->id != TLPAREN) {
-        error("Error at %d: Expected '('", cur->line_no);
-        return NULL;
+      if (tokens->id[cur] != TLPAREN) {
+        error("Error at %d: Expected '('", tokens->line_no[cur]);
+        return obj_error;
       }
       consumeToken();
-      if ((expression = pExpression()) == NULL) return NULL;
+      if (isObjError(expression = pExpression())) return obj_error;
 
-      if (cur->id != TRPAREN) {
-        error("Error at %d: Expected ')'", cur->line_no);
-        return NULL;
+      if (tokens->id[cur] != TRPAREN) {
+        error("Error at %d: Expected ')'", tokens->line_no[cur]);
+        return obj_error;
       }
       consumeToken();
-      factor->isLVal = expression->isLVal;
+      factor.isLVal = expression.isLVal;
+      factor.isConst = expression.isConst;
+      factor.value = expression.value;
+      factor.min = expression.min;
+      factor.max = expression.max;
       break;
     case TBOOLEAN:
-      factor->type = TPBOOL;
+      factor.type = TPBOOL;
       consumeToken();
-      if (cur->id != TLPAREN) {
-        error("Error at %d: Expected '('", cur->line_no);
-        return NULL;
+      if (tokens->id[cur] != TLPAREN) {
+        error("Error at %d: Expected '('", tokens->line_no[cur]);
+        return obj_error;
       }
 
       consumeToken();
-      if ((expression = pExpression()) == NULL) return NULL;
+      if (isObjError(expression = pExpression())) return obj_error;
 
-      switch (expression->type) {
+      switch (expression.type) {
         case TPINT: {
+          if (expression.isConst) break;
           int label = getLabelNum();
           genCode("CPA", "GR1,GR0");
           genCodeLabel("JZE", label);
@@ -473,89 +1247,288 @@ static Obj pFactor()
         case TPBOOL:
           break;
         case TPCHAR:
-          genStoreBoolean();
+          if (!expression.isConst) genStoreBoolean();
           break;
         default:
-          error("Error at %d: Expected boolean", cur->line_no);
-          return NULL;
+          error("Error at %d: Expected boolean", tokens->line_no[cur]);
+          return obj_error;
       }
-      if (cur->id != TRPAREN) {
-        error("Error at %d: Expected ')'", cur->line_no);
-        return NULL;
+      if (tokens->id[cur] != TRPAREN) {
+        error("Error at %d: Expected ')'", tokens->line_no[cur]);
+        return obj_error;
       }
       consumeToken();
-      factor->isLVal = expression->isLVal;
+      factor.isLVal = expression.isLVal;
+      factor.isConst = expression.isConst;
+      factor.value = expression.value != 0;
       break;
     case TCHAR:
-      factor->type = TPCHAR;
+      factor.type = TPCHAR;
       consumeToken();
-      if (cur->id != TLPAREN) {
-        error("Error at %d: Expected '('", cur->line_no);
-        return NULL;
+      if (tokens->id[cur] != TLPAREN) {
+        error("Error at %d: Expected '('", tokens->line_no[cur]);
+        return obj_error;
       }
       consumeToken();
-      if ((expression = pExpression()) == NULL) return NULL;
+      if (isObjError(expression = pExpression())) return obj_error;
 
-      switch (expression->type) {
+      factor.isConst = expression.isConst;
+      factor.value = expression.value;
+      switch (expression.type) {
         case TPINT:
+          if (expression.isConst) {
+            factor.value &= 0x7F;
+            break;
+          }
           genCode("LAD", "GR2,#007F");
           genCode("AND", "GR1,GR2");
           genCode("LAD", "GR2,0");
           break;
         case TPBOOL:
+          if (expression.isConst) {
+            factor.value = factor.value != 0;
+            break;
+          }
           genStoreBoolean();
           break;
         case TPCHAR:
           break;
         default:
-          error("Error at %d: Expected char", cur->line_no);
-          return NULL;
+          error("Error at %d: Expected char", tokens->line_no[cur]);
+          return obj_error;
       }
 
-      if (cur->id != TRPAREN) {
-        error("Error at %d: Expected ')'", cur->line_no);
-        return NULL;
+      if (tokens->id[cur] != TRPAREN) {
+        error("Error at %d: Expected ')'", tokens->line_no[cur]);
+        return obj_error;
       }
       consumeToken();
-      factor->isLVal = expression->isLVal;
+      factor.isLVal = expression.isLVal;
       break;
 
     default:
-      error("Error at %d: Expected factor", cur->line_no);
-      return NULL;
+      error("Error at %d: Expected factor", tokens->line_no[cur]);
+      return obj_error;
   }
   return factor;
 }
 
+/**
+ * @brief レジスタに格納された二つのオペランドの演算の命令を生成する関数
+ * どちらか一方のオペランドはGR1に格納されている。演算結果はGR1に格納する
+ * @param opr 演算子
+ * @param lhs 左オペランドを保持するレジスタ
+ * @param rhs 右オペランドを保持するレジスタ
+ */
+static void genRegisterOperation(int opr, const char * lhs, const char * rhs)
+{
+  bool lhs_in_gr1 = strcmp(lhs, "GR1") == 0;
+  // 交換可能な演算はGR1に直接結果を格納する
+  const char * other = lhs_in_gr1 ? rhs : lhs;
+
+  switch (opr) {
+    case TSTAR:
+      genCodeRegs("MULA", "GR1", other);
+      genCode("JOV", "EOVF");
+      break;
+    case TPLUS:
+      genCodeRegs("ADDA", "GR1", other);
+      genCode("JOV", "EOVF");
+      break;
+    case TAND:
+      genCodeRegs("AND", "GR1", other);
+      break;
+    case TOR:
+      genCodeRegs("OR", "GR1", other);
+      break;
+    case TDIV:
+    case TMINUS:
+      genCodeRegs(opr == TDIV ? "DIVA" : "SUBA", lhs, rhs);
+      genCode("JOV", "EOVF");
+      if (!lhs_in_gr1) genCodeRegs("LD", "GR1", lhs);
+      break;
+    default:
+      // 関係演算子は比較だけを行い、分岐は呼び出し元で生成する
+      genCodeRegs("CPA", lhs, rhs);
+      break;
+  }
+}
+
+/**
+ * @brief 右オペランドが定数の二項演算の命令を生成する関数
+ * 左オペランドはGR1に格納されている。結果が自明な演算は命令を省略し、2倍は加算に置き換える
+ * @param opr 演算子
+ * @param value 右オペランドの値
+ */
+static void genConstantRight(int opr, int value)
+{
+  switch (opr) {
+    case TPLUS:
+    case TMINUS:
+      if (value == 0) return;
+      break;
+    case TSTAR:
+      if (value == 1) return;
+      if (value == 0) {
+        genCode("LAD", "GR1,0");
+        return;
+      }
+      // CASL IIのSLAは最後に送り出したビットをOFに設定するので桁あふれを検出できない。
+      // 2倍だけは自身との加算で桁あふれを検出できる
+      if (value == 2) {
+        genCodeRegs("ADDA", "GR1", "GR1");
+        genCode("JOV", "EOVF");
+        return;
+      }
+      break;
+    case TDIV:
+      if (value == 1) return;
+      // 定数の0による除算は必ず実行時エラーになる
+      if (value == 0) constantError("Zero-Divide");
+      break;
+    case TAND:
+      if (value != 0) return;
+      genCode("LAD", "GR1,0");
+      return;
+    case TOR:
+      if (value == 0) return;
+      genCode("LAD", "GR1,1");
+      return;
+    default:
+      // 0との比較はGR0を使う
+      if (value == 0) {
+        genCodeRegs("CPA", "GR1", "GR0");
+        return;
+      }
+      break;
+  }
+  genCodeNum("LAD", "GR2", value);
+  genRegisterOperation(opr, "GR1", "GR2");
+}
+
+/**
+ * @brief 左オペランドが定数の二項演算の命令を生成する関数
+ * 右オペランドはGR1に格納されている
+ * @param opr 演算子
+ * @param value 左オペランドの値
+ */
+static void genConstantLeft(int opr, int value)
+{
+  switch (opr) {
+    case TPLUS:
+    case TSTAR:
+    case TAND:
+    case TOR:
+      genConstantRight(opr, value);
+      return;
+    case TMINUS:
+      if (value == 0) {
+        genNegate();
+        return;
+      }
+      break;
+    case TDIV:
+      break;
+    default:
+      if (value == 0) {
+        genCodeRegs("CPA", "GR0", "GR1");
+        return;
+      }
+      break;
+  }
+  genCodeNum("LAD", "GR2", value);
+  genRegisterOperation(opr, "GR2", "GR1");
+}
+
+/**
+ * @brief 二項演算の結果の値の範囲を求める関数
+ * 加減算だけを扱い、それ以外の演算の結果は範囲が不明とする。
+ * 桁あふれは実行時エラーになるので、結果は1語で表せる範囲に収まる
+ * @param result 演算結果の評価結果。範囲を上書きする
+ * @param opr 演算子
+ * @param lhs 左オペランドの評価結果
+ * @param rhs 右オペランドの評価結果
+ */
+static void setBinaryRange(Obj * result, int opr, Obj lhs, Obj rhs)
+{
+  long min = MIN_WORD, max = MAX_WORD;
+  if (opr == TPLUS) {
+    min = (long)objMin(lhs) + objMin(rhs);
+    max = (long)objMax(lhs) + objMax(rhs);
+  } else if (opr == TMINUS) {
+    min = (long)objMin(lhs) - objMax(rhs);
+    max = (long)objMax(lhs) - objMin(rhs);
+  }
+  result->min = min < MIN_WORD ? MIN_WORD : (int)min;
+  result->max = max > MAX_WORD ? MAX_WORD : (int)max;
+}
+
+/**
+ * @brief 二項演算の右オペランドを評価して演算の命令を生成する関数
+ * 左オペランドはGR1に格納されているか、定数に畳み込まれている。
+ * 両方のオペランドが定数の場合はコンパイル時に計算する。右オペランドが配列でない変数の場合はGR2に直接読み込み、
+ * そうでない場合は左オペランドを作業用レジスタに退避してから右オペランドを評価する。
+ * 演算結果はGR1に格納する
+ * @param lhs 左オペランドの評価結果。演算結果で上書きされる
+ * @param opr 演算子
+ * @param pOperand 右オペランドを評価する関数
+ * @param leaf 右オペランドが単純な因子かどうか
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+static int genBinaryOperation(Obj * lhs, int opr, Obj (*pOperand)(), bool leaf)
+{
+  Obj left = *lhs, rhs = obj_error;
+  // 左オペランドが定数の場合はGR1が空いているので、右オペランドをそのまま評価する
+  if (lhs->isConst) {
+    if (isObjError(rhs = pOperand())) return ERROR;
+    if (rhs.isConst) {
+      foldConstants(lhs, opr, rhs.value);
+      return NORMAL;
+    }
+    genConstantLeft(opr, lhs->value);
+    lhs->isConst = false;
+  } else if (leaf && tokens->id[cur] == TNAME) {
+    getVarRange(lookupVar(cur).label, &rhs);
+    genLeafFactor();
+    genRegisterOperation(opr, "GR1", "GR2");
+  } else if (leaf) {
+    rhs = pOperand();
+    genConstantRight(opr, rhs.value);
+  } else {
+    EmitterMark mark = markEmitter(emitter);
+    const char * saved = saveOperand();
+    EmitterMark saved_mark = markEmitter(emitter);
+    if (isObjError(rhs = pOperand())) return ERROR;
+    if (rhs.isConst) {
+      // 右オペランドが定数に畳み込まれた場合はGR1の値は変わっていないので、退避は不要だった
+      if (emitter->len == saved_mark.len) {
+        rewindEmitter(emitter, mark);
+        if (saved != NULL) work_register_depth--;
+      } else {
+        restoreOperand(saved);
+      }
+      genConstantRight(opr, rhs.value);
+    } else {
+      genRegisterOperation(opr, restoreOperand(saved), "GR1");
+    }
+  }
+  setBinaryRange(lhs, opr, left, rhs);
+  return NORMAL;
+}
+
 //! 項から命令を生成する関数
 static Obj pTerm()
 {
-  int opr;
   Obj factor;
   // 式の結果はGR1に格納されている
-  if ((factor = pFactor()) == NULL) return NULL;
+  if (isObjError(factor = pFactor())) return obj_error;
 
-  while (isMulOp(cur->id)) {
-    factor->isLVal = false;
-
-    genCode("PUSH", "0,GR1");
-    opr = cur->id;
+  while (isMulOp(tokens->id[cur])) {
+    factor.isLVal = false;
+    int opr = tokens->id[cur];
     consumeToken();
-    if (pFactor() == NULL) return NULL;
-    genCode("POP", "GR2");
-    if (opr == TSTAR) {
-      genCode("MULA", "GR1,GR2");
-      genCode("JOV", "EOVF");
-      factor->type = TPINT;
-    } else if (opr == TDIV) {
-      genCode("DIVA", "GR2,GR1");
-      genCode("JOV", "EOVF");
-      genCode("LD", "GR1,GR2");
-      factor->type = TPINT;
-    } else if (opr == TAND) {
-      genCode("AND", "GR1,GR2");
-      factor->type = TPBOOL;
-    }
+    if (genBinaryOperation(&factor, opr, pFactor, isLeafFactor(cur)) == ERROR) return obj_error;
+    factor.type = opr == TAND ? TPBOOL : TPINT;
   }
   return factor;
 }
@@ -564,39 +1537,34 @@ static Obj pTerm()
 static Obj pSimpleExpression()
 {
   Obj term;
-  if (cur->id == TMINUS) {
+  if (tokens->id[cur] == TMINUS) {
     consumeToken();
-    // 次の項の値に-1を乗じる
-    // 式の結果はスタックに積まれている
-    if ((term = pTerm()) == NULL) return NULL;
-    genCode("LAD", "GR2,-1");
-    genCode("MULA", "GR1,GR2");
-    genCode("JOV", "EOVF");
+    // 次の項の符号を反転する
+    if (isObjError(term = pTerm())) return obj_error;
+    if (term.isConst) {
+      Obj zero = constantObj(TPINT, 0);
+      foldConstants(&zero, TMINUS, term.value);
+      term.value = zero.value;
+    } else {
+      genNegate();
+      int min = term.min;
+      term.min = term.max == MIN_WORD ? MAX_WORD : -term.max;
+      term.max = min == MIN_WORD ? MAX_WORD : -min;
+    }
+    term.isLVal = false;
   } else {
-    if (cur->id == TPLUS) consumeToken();
-    if ((term = pTerm()) == NULL) return NULL;
+    if (tokens->id[cur] == TPLUS) consumeToken();
+    if (isObjError(term = pTerm())) return obj_error;
   }
 
-  while (isAddOp(cur->id)) {
-    genCode("PUSH", "0,GR1");
-    int opr = cur->id;
-    term->isLVal = false;
+  while (isAddOp(tokens->id[cur])) {
+    int opr = tokens->id[cur];
+    term.isLVal = false;
     consumeToken();
-    if ((term = pTerm()) == NULL) return NULL;
-    genCode("POP", "GR2");
-    if (opr == TPLUS) {
-      term->type = TPINT;
-      genCode("ADDA", "GR1,GR2");
-      genCode("JOV", "EOVF");
-    } else if (opr == TMINUS) {
-      term->type = TPINT;
-      genCode("SUBA", "GR2,GR1");
-      genCode("JOV", "EOVF");
-      genCode("LD", "GR1,GR2");
-    } else if (opr == TOR) {
-      term->type = TPBOOL;
-      genCode("OR", "GR1,GR2");
-    }
+    // 右オペランドの項が一つの因子だけからなる場合はレジスタを使わずに読み込める
+    bool leaf = isLeafFactor(cur) && !isMulOp(tokens->id[cur + 1]);
+    if (genBinaryOperation(&term, opr, pTerm, leaf) == ERROR) return obj_error;
+    term.type = opr == TOR ? TPBOOL : TPINT;
   }
   return term;
 }
@@ -605,22 +1573,20 @@ static Obj pSimpleExpression()
 static Obj pExpression()
 {
   Obj expression;
-  int label1, label2;
   // 計算結果はGR1に格納されている
-  if ((expression = pSimpleExpression()) == NULL) return NULL;
-  while (isRelOp(cur->id)) {
-    genCode("PUSH", "0,GR1");
-    expression->type = TPBOOL;
-    expression->isLVal = false;
-    label1 = getLabelNum();
-    label2 = getLabelNum();
-    int opr = cur->id;
+  if (isObjError(expression = pSimpleExpression())) return obj_error;
+  while (isRelOp(tokens->id[cur])) {
+    expression.type = TPBOOL;
+    expression.isLVal = false;
+    int opr = tokens->id[cur];
     consumeToken();
-    // 計算結果はGR1に格納されている
-    pSimpleExpression();
-    genCode("POP", "GR2");
-    genCode("CPA", "GR2,GR1");
+    // 右オペランドの単純式が一つの因子だけからなる場合はレジスタを使わずに読み込める
+    bool leaf = isLeafFactor(cur) && !isMulOp(tokens->id[cur + 1]) && !isAddOp(tokens->id[cur + 1]);
+    if (genBinaryOperation(&expression, opr, pSimpleExpression, leaf) == ERROR) return obj_error;
+    if (expression.isConst) continue;
 
+    int label1 = getLabelNum();
+    int label2 = getLabelNum();
     switch (opr) {
       case TEQUAL:
         genCodeLabel("JZE", label1);
@@ -647,38 +1613,335 @@ static Obj pExpression()
     }
     genCode("LAD", "GR1,0");
     genCodeLabel("JUMP", label2);
-    println("L%04d", label1);
+    genLabel(label1);
     genCode("LAD", "GR1,1");
-    println("L%04d", label2);
+    genLabel(label2);
   }
   return expression;
 }
 
+//! 式から命令を生成し、定数に畳み込まれた場合も含めて結果を必ずGR1に格納する関数
+static Obj pLoadedExpression()
+{
+  Obj expression = pExpression();
+  if (!isObjError(expression)) genLoadConstant(&expression);
+  return expression;
+}
+
+/**
+ * @brief CPAの結果のフラグから、関係が成り立つ(whenが偽の場合は成り立たない)ときに分岐する命令を生成する関数
+ * 
+ * @param opr 関係演算子
+ * @param when 分岐する関係の真偽
+ * @param label 分岐先のラベルの番号
+ */
+static void genRelationalJump(int opr, bool when, int label)
+{
+  if (!when) opr = negateRelation(opr);
+  switch (opr) {
+    case TEQUAL:
+      genCodeLabel("JZE", label);
+      break;
+    case TNOTEQ:
+      genCodeLabel("JNZ", label);
+      break;
+    case TLE:
+      genCodeLabel("JMI", label);
+      break;
+    case TLEEQ:
+      genCodeLabel("JMI", label);
+      genCodeLabel("JZE", label);
+      break;
+    case TGR:
+      genCodeLabel("JPL", label);
+      break;
+    default:
+      genCodeLabel("JPL", label);
+      genCodeLabel("JZE", label);
+      break;
+  }
+}
+
+//! 値の範囲を記録する変数だけからなるオペランドの場合にラベルを返す関数。そうでない場合はNULLを返す
+static const char * trackedVarAt(int tok, bool whole_operand)
+{
+  if (!whole_operand || tokens->id[tok] != TNAME || tokens->id[tok + 1] == TLSQPAREN) return NULL;
+  Symbol symbol = lookupVar(tok);
+  return isRangeTracked(symbol) ? symbol.label : NULL;
+}
+
+/**
+ * @brief 関係演算子を一つ含む条件式を評価し、値がwhenと等しい場合にlabelへ分岐する命令を生成する関数
+ * 分岐しなかった場合に成り立つ関係から、変数の値の範囲を狭める
+ * @param when 分岐する条件式の値
+ * @param label 分岐先のラベルの番号
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+static int genRelationalBranch(bool when, int label)
+{
+  Obj lhs, rhs = obj_error;
+  // 変数だけからなる辺は、分岐しなかった場合に成り立つ関係から範囲を狭められる
+  const char * lhs_var = trackedVarAt(cur, isRelOp(tokens->id[cur + 1]));
+  if (isObjError(lhs = pSimpleExpression())) return ERROR;
+  Obj left = lhs;
+  int opr = tokens->id[cur];
+  consumeToken();
+  bool leaf = isLeafFactor(cur) && !isMulOp(tokens->id[cur + 1]) && !isAddOp(tokens->id[cur + 1]);
+  const char * rhs_var = trackedVarAt(cur, leaf);
+  if (rhs_var != NULL) getVarRange(rhs_var, &rhs);
+
+  if (leaf && tokens->id[cur] == TNUMBER && !lhs.isConst) {
+    // 分岐が二つ必要な関係は、定数を1ずらして分岐が一つで済む関係に置き換える
+    int value = tokens->num[cur];
+    consumeToken();
+    if (when ? opr == TLEEQ : opr == TLE) {
+      if (value > MIN_WORD) {
+        opr = when ? TLE : TLEEQ;
+        value += when ? 1 : -1;
+      }
+    } else if (when ? opr == TGREQ : opr == TGR) {
+      if (value < MAX_WORD) {
+        opr = when ? TGR : TGREQ;
+        value += when ? -1 : 1;
+      }
+    }
+    genConstantRight(opr, value);
+    rhs.min = rhs.max = value;
+  } else {
+    if (genBinaryOperation(&lhs, opr, pSimpleExpression, leaf) == ERROR) return ERROR;
+    // 定数に畳み込まれた場合は分岐するかどうかがコンパイル時に決まる
+    if (lhs.isConst) {
+      if ((lhs.value != 0) == when) genCodeLabel("JUMP", label);
+      return NORMAL;
+    }
+  }
+  genRelationalJump(opr, when, label);
+
+  int relation = when ? negateRelation(opr) : opr;
+  if (lhs_var != NULL) recordRelation(lhs_var, relation, rhs.min, rhs.max);
+  if (rhs_var != NULL) recordRelation(rhs_var, mirrorRelation(relation), objMin(left), objMax(left));
+  return NORMAL;
+}
+
+/**
+ * @brief 条件式の範囲 [cur, end) を評価し、値がwhenと等しい場合にlabelへ分岐する命令を生成する関数
+ * 真偽値をGR1に格納せずに比較の結果のフラグで直接分岐する。and, orは短絡評価する
+ * @param end 条件式の直後のトークンの位置
+ * @param pOperand 範囲を通常の式として評価する場合に使う関数。範囲の構文に合わせて因子、項、式のいずれかを渡す
+ * @param when 分岐する条件式の値
+ * @param label 分岐先のラベルの番号
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+static int genBranch(int end, Obj (*pOperand)(), bool when, int label)
+{
+  ConditionShape shape = scanCondition(tokens, cur, end);
+
+  if (shape.relops == 1) return genRelationalBranch(when, label);
+
+  // or: 一つでも真の項があれば真
+  if (shape.relops == 0 && shape.ors > 0 && shape.other_addops == 0) {
+    // 途中の項が真になって合流先へ分岐した場合は、後の項から分かる範囲は成り立たない
+    RangeFacts before = range_facts;
+    int skip = when ? label : getLabelNum();
+    int next;
+    while ((next = findTopLevel(tokens, cur, end, TOR)) != end) {
+      if (genBranch(next, pTerm, true, skip) == ERROR) return ERROR;
+      consumeToken();
+    }
+    if (genBranch(end, pTerm, when, label) == ERROR) return ERROR;
+    if (!when) {
+      genLabel(skip);
+      range_facts = before;
+    }
+    return NORMAL;
+  }
+
+  // and: 一つでも偽の因子があれば偽
+  if (shape.relops == 0 && shape.ors == 0 && shape.other_addops == 0 && shape.ands > 0 &&
+      shape.other_mulops == 0) {
+    RangeFacts before = range_facts;
+    int skip = when ? getLabelNum() : label;
+    int next;
+    while ((next = findTopLevel(tokens, cur, end, TAND)) != end) {
+      if (genBranch(next, pFactor, false, skip) == ERROR) return ERROR;
+      consumeToken();
+    }
+    if (genBranch(end, pFactor, when, label) == ERROR) return ERROR;
+    if (when) {
+      genLabel(skip);
+      range_facts = before;
+    }
+    return NORMAL;
+  }
+
+  bool single_factor = shape.relops == 0 && shape.ors == 0 && shape.other_addops == 0 &&
+                       shape.ands == 0 && shape.other_mulops == 0;
+  if (single_factor && tokens->id[cur] == TNOT) {
+    consumeToken();
+    return genBranch(end, pFactor, !when, label);
+  }
+  if (single_factor && tokens->id[cur] == TLPAREN && tokens->id[end - 1] == TRPAREN) {
+    consumeToken();
+    if (genBranch(end - 1, pExpression, when, label) == ERROR) return ERROR;
+    consumeToken();
+    return NORMAL;
+  }
+
+  // それ以外の条件式は真偽値をGR1に求めてから分岐する
+  Obj condition = pOperand();
+  if (isObjError(condition)) return ERROR;
+  if (condition.isConst) {
+    if ((condition.value != 0) == when) genCodeLabel("JUMP", label);
+    return NORMAL;
+  }
+  genCode("CPA", "GR1,GR0");
+  genCodeLabel(when ? "JNZ" : "JZE", label);
+  return NORMAL;
+}
+
+//! 文の終わりの位置を返す関数。else節を含めてしまうことがあるが、変更される変数を調べるには十分である
+static int findStatementEnd()
+{
+  int depth = 0;
+  int i = cur;
+  for (; i < tokens->size - 1; i++) {
+    TokenID id = tokens->id[i];
+    if (id == TBEGIN) {
+      depth++;
+    } else if (id == TEND) {
+      if (depth == 0) break;
+      depth--;
+    } else if (id == TSEMI && depth == 0) {
+      break;
+    }
+  }
+  return i;
+}
+
+//! 繰り返し文の本体での変数の変更のされ方
+typedef enum {
+  //! 変更されない
+  VAR_UNCHANGED,
+  //! 非負の値を足す代入だけで変更される
+  VAR_INCREASED,
+  //! それ以外の変更をされる
+  VAR_CHANGED,
+} VarChange;
+
+static VarChange scanVarChange(const char * label, int start, int end, bool allow_increase);
+
+//! 位置posから始まる代入文の右辺が、変数labelに非負の値を足す式かどうかを判定する関数
+static bool isIncrement(const char * label, int pos, int start, int end)
+{
+  if (tokens->id[pos] != TNAME || tokens->id[pos + 1] != TPLUS) return false;
+  if (lookupVar(pos).label != label) return false;
+  switch (tokens->id[pos + 3]) {
+    case TSEMI:
+    case TEND:
+    case TELSE:
+      break;
+    default:
+      return false;
+  }
+  if (tokens->id[pos + 2] == TNUMBER) return true;
+
+  // 足す変数が本体で変更されず、繰り返しの前から非負であればよい
+  const char * addend = trackedVarAt(pos + 2, true);
+  if (addend == NULL || addend == label) return false;
+  RangeFact * fact = findRange(addend);
+  return fact != NULL && fact->min >= 0 && scanVarChange(addend, start, end, false) == VAR_UNCHANGED;
+}
+
+/**
+ * @brief 繰り返し文の範囲 [start, end) で、変数がどのように変更されるかを調べる関数
+ * 手続き呼び出し、入力文、仮引数への代入は、どの変数も変更し得るとみなす
+ * @param label 変数のラベル
+ * @param start 繰り返し文の先頭のトークンの位置
+ * @param end 繰り返し文の直後のトークンの位置
+ * @param allow_increase 非負の値を足す代入を区別するかどうか。falseの場合は全ての代入をVAR_CHANGEDとする
+ * @return VarChange 変数の変更のされ方
+ */
+static VarChange scanVarChange(const char * label, int start, int end, bool allow_increase)
+{
+  VarChange change = VAR_UNCHANGED;
+  for (int i = start; i < end; i++) {
+    switch (tokens->id[i]) {
+      case TCALL:
+      case TREAD:
+      case TREADLN:
+        return VAR_CHANGED;
+      case TNAME:
+        break;
+      default:
+        continue;
+    }
+    if (tokens->id[i + 1] != TASSIGN) continue;
+    Symbol target = lookupVar(i);
+    if (target.ispara) return VAR_CHANGED;
+    if (target.label != label) continue;
+    if (!allow_increase || !isIncrement(label, i + 2, start, end)) return VAR_CHANGED;
+    change = VAR_INCREASED;
+  }
+  return change;
+}
+
+/**
+ * @brief 繰り返しの先頭で常に成り立つ範囲だけを残す関数
+ * 本体で変更されない変数は範囲をそのまま残し、非負の値を足すだけの変数は下限だけを残す
+ * @param start 繰り返し文の先頭のトークンの位置
+ * @param end 繰り返し文の直後のトークンの位置
+ */
+static void setLoopInvariantRanges(int start, int end)
+{
+  RangeFacts invariant;
+  invariant.size = 0;
+  for (int i = 0; i < range_facts.size; i++) {
+    RangeFact fact = range_facts.facts[i];
+    switch (scanVarChange(fact.label, start, end, true)) {
+      case VAR_UNCHANGED:
+        break;
+      case VAR_INCREASED:
+        fact.max = MAX_WORD;
+        break;
+      default:
+        continue;
+    }
+    invariant.facts[invariant.size++] = fact;
+  }
+  range_facts = invariant;
+}
+
 //! 条件分岐文から命令を生成する関数
 static int pCondition()
 {
   int label1, label2;
-  if (cur->id != TIF) return error("Error at %d: Expected 'if'", cur->line_no);
+  if (tokens->id[cur] != TIF) return error("Error at %d: Expected 'if'", tokens->line_no[cur]);
   consumeToken();
-  if (pExpression() == NULL) return ERROR;
 
+  // 条件式が偽の場合はlabel1に分岐する
   label1 = getLabelNum();
-  genCode("CPA", "GR1,GR0");
-  println("\tJZE\tL%04d", label1);
-  if (cur->id != TTHEN) return error("Error at %d: Expected 'then'", cur->line_no);
+  RangeFacts before = range_facts;
+  int end = findTopLevel(tokens, cur, tokens->size - 1, TTHEN);
+  if (genBranch(end, pExpression, false, label1) == ERROR) return ERROR;
+  if (tokens->id[cur] != TTHEN) return error("Error at %d: Expected 'then'", tokens->line_no[cur]);
   consumeToken();
   at_bol = true;
   if (pStatement() == ERROR) return ERROR;
-  if (cur->id == TELSE) {
+  // 条件式は変数を変更しないので、else節と条件式が偽の場合は条件式の前の範囲から始まる
+  if (tokens->id[cur] == TELSE) {
+    RangeFacts then_facts = range_facts;
+    range_facts = before;
     label2 = getLabelNum();
     at_bol = true;
-    println("\tJUMP\tL%04d", label2);
+    genCodeLabel("JUMP", label2);
     genLabel(label1);
     consumeToken();
     if (pStatement() == ERROR) return ERROR;
     genLabel(label2);
+    joinRanges(&then_facts);
   } else {
     genLabel(label1);
+    joinRanges(&before);
   }
   return NORMAL;
 }
@@ -689,15 +1952,22 @@ static int pIteration()
   consumeToken();
   int label1 = getLabelNum();
   int label2 = getLabelNum();
+  int outer_exit_label = loop_exit_label;
+  setLoopInvariantRanges(cur, findStatementEnd());
+  RangeFacts invariant = range_facts;
   genLabel(label1);
-  pExpression();
-  genCode("CPA", "GR1,GR0");
-  genCodeLabel("JZE", label2);
-  if (cur->id != TDO) return error("Error at %d: Expected 'do'", cur->line_no);
+  // 条件式が偽の場合はループを抜ける
+  int end = findTopLevel(tokens, cur, tokens->size - 1, TDO);
+  if (genBranch(end, pExpression, false, label2) == ERROR) return ERROR;
+  if (tokens->id[cur] != TDO) return error("Error at %d: Expected 'do'", tokens->line_no[cur]);
   consumeToken();
-  pStatement();
+  loop_exit_label = label2;
+  int result = pStatement();
+  loop_exit_label = outer_exit_label;
+  if (result == ERROR) return ERROR;
   genCodeLabel("JUMP", label1);
   genLabel(label2);
+  range_facts = invariant;
   return NORMAL;
 }
 
@@ -705,19 +1975,19 @@ static int pIteration()
 static void genProcedureCall(Obj obj)
 {
   // 左辺値を持つ式なのかどうか
-  if (obj->isLVal) {
+  if (obj.isLVal) {
     // 変数のアドレスをスタックにPUSH
     if (!is_parameter)
-      println("\tLAD\tGR1,%s", call_var_name);
+      genCodeAddr("LAD", "GR1", call_var_name, NULL);
     else {
-      println("\tLD\tGR1,%s", call_var_name);
+      genCodeAddr("LD", "GR1", call_var_name, NULL);
     }
     genCode("PUSH", "0,GR1");
   } else {
-    // 左辺値を持たない場合
-    genCode("LAD", "GR2,=0");
-    genCode("ST", "GR1,0,GR2");
-    genCode("PUSH", "0,GR2");
+    // 左辺値を持たない場合は、呼び出しごとの領域に格納してそのアドレスを積む
+    int slot = newArgumentSlot();
+    genCodeSlot("ST", "GR1", slot);
+    genCodeLabel("PUSH", slot);
   }
 }
 
@@ -726,34 +1996,110 @@ static int pExpressions()
 {
   Obj expression;
   needs_address_load = true;
-  if ((expression = pExpression()) == NULL) return ERROR;
+  if (isObjError(expression = pLoadedExpression())) return ERROR;
   genProcedureCall(expression);
 
-  while (cur->id == TCOMMA) {
+  while (tokens->id[cur] == TCOMMA) {
     consumeToken();
-    if ((expression = pExpression()) == NULL) return ERROR;
+    if (isObjError(expression = pLoadedExpression())) return ERROR;
     genProcedureCall(expression);
   }
   needs_address_load = false;
   return NORMAL;
 }
 
+/**
+ * @brief 実引数を一つ読んで、空いている作業用レジスタで渡す命令を生成する関数
+ * 値渡しの仮引数には値を、参照渡しの仮引数にはアドレスを渡す。式の値は呼び出しごとの領域に格納してアドレスを渡す。
+ * 作業用レジスタが全て使用中の場合はスタックに積む
+ * @param param 実引数を受け取る仮引数
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+static int pArgument(const Symbol * param)
+{
+  bool by_value = param != NULL && !param->ispara;
+  int end = argumentEnd(tokens, cur);
+  bool variable = isVariableArgument(tokens, cur, end);
+  Symbol symbol = lookupVar(cur);
+  if (variable && end == cur + 1 && symbol.label != NULL && work_register_depth < NUM_WORK_REGISTERS) {
+    // 配列でない変数は作業用レジスタに直接読み込む
+    const char * reg = work_registers[work_register_depth++];
+    if (by_value) {
+      genCodeAddr("LD", reg, symbol.label, NULL);
+      // 仮引数には実引数のアドレスが格納されている
+      if (symbol.ispara) genCodeAddr("LD", reg, "0", reg);
+    } else {
+      genCodeAddr(symbol.ispara ? "LD" : "LAD", reg, symbol.label, NULL);
+    }
+    consumeToken();
+    return NORMAL;
+  }
+  if (variable && !by_value) {
+    needs_address_load = true;
+    int type = pVar();
+    needs_address_load = false;
+    if (type == ERROR) return ERROR;
+    saveOperand();
+    return NORMAL;
+  }
+  Obj expression;
+  if (isObjError(expression = pExpression())) return ERROR;
+  if (by_value && expression.isConst && work_register_depth < NUM_WORK_REGISTERS) {
+    genCodeNum("LAD", work_registers[work_register_depth++], expression.value);
+    return NORMAL;
+  }
+  genLoadConstant(&expression);
+  if (!by_value && expression.isLVal) {
+    // 括弧や型変換で囲まれた変数も、変数のアドレスを渡す
+    genCodeAddr(is_parameter ? "LD" : "LAD", "GR1", call_var_name, NULL);
+  } else if (!by_value) {
+    int slot = newArgumentSlot();
+    genCodeSlot("ST", "GR1", slot);
+    genCodeSlot("LAD", "GR1", slot);
+  }
+  saveOperand();
+  return NORMAL;
+}
+
+/**
+ * @brief 実引数の並びから命令を生成する関数
+ * 実引数は先頭から順にGR3からGR7で渡し、残りはスタックに積む
+ * @param procedure 呼び出す手続き
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+static int pArguments(const Symbol * procedure)
+{
+  const ProcedureInfo * info = procedureInfo(procedure);
+  for (int i = 0;; i++) {
+    if (pArgument(i < info->num_params ? info->params[i] : NULL) == ERROR) return ERROR;
+    if (tokens->id[cur] != TCOMMA) return NORMAL;
+    consumeToken();
+  }
+}
+
 //! 手続き呼び出し文から命令を生成する関数
 static int pCall()
 {
-  if (cur->id != TCALL) return error("Error at %d: Expected 'call'", cur->line_no);
+  if (tokens->id[cur] != TCALL) return error("Error at %d: Expected 'call'", tokens->line_no[cur]);
   consumeToken();
-  char * procedure_name = getSymbol(cur->str).label;
+  const Symbol * procedure = findSymbol(tokenStr(tokens, cur), NULL);
+  char * procedure_name = getSymbol(tokenStr(tokens, cur), NULL).label;
   consumeToken();
-  if (cur->id != TLPAREN) {
+  // 手続きは大域変数や実引数の変数を変更し得る
+  range_facts.size = 0;
+  if (tokens->id[cur] != TLPAREN) {
     genCode("CALL", procedure_name);
     return NORMAL;
   }
   consumeToken();
 
-  if (pExpressions() == ERROR) return ERROR;
+  if (register_arguments && procedure != NULL) {
+    if (pArguments(procedure) == ERROR) return ERROR;
+  } else if (pExpressions() == ERROR) {
+    return ERROR;
+  }
 
-  if (cur->id != TRPAREN) return error("Error at %d: Expected ')'", cur->line_no);
+  if (tokens->id[cur] != TRPAREN) return error("Error at %d: Expected ')'", tokens->line_no[cur]);
   consumeToken();
   genCode("CALL", procedure_name);
   return NORMAL;
@@ -782,7 +2128,7 @@ static void genRead(TYPE_KIND type)
       genCode("CALL", "READCHAR");
       break;
     default:
-      error("Error at %d: Expected integer, boolean or char", cur->line_no);
+      error("Error at %d: Expected integer, boolean or char", tokens->line_no[cur]);
       break;
   }
 }
@@ -790,11 +2136,12 @@ static void genRead(TYPE_KIND type)
 //! 入力文から命令を生成する関数
 static int pInput()
 {
-  bool isReadln = cur->id == TREADLN;
+  bool isReadln = tokens->id[cur] == TREADLN;
   TYPE_KIND var_type;
   consumeToken();
+  range_facts.size = 0;
 
-  if (cur->id != TLPAREN) {
+  if (tokens->id[cur] != TLPAREN) {
     if (isReadln) genCode("CALL", "READLINE");
     return NORMAL;
   }
@@ -803,19 +2150,19 @@ static int pInput()
   needs_address_load = true;
   if ((var_type = pVar()) == TPRERROR) return ERROR;
   needs_address_load = false;
-  if (!canReadType(var_type)) return error("Error at %d: Expected integer or char", cur->line_no);
+  if (!canReadType(var_type)) return error("Error at %d: Expected integer or char", tokens->line_no[cur]);
   genRead(var_type);
 
-  while (cur->id == TCOMMA) {
+  while (tokens->id[cur] == TCOMMA) {
     consumeToken();
     needs_address_load = true;
     if ((var_type = pVar()) == TPRERROR) return ERROR;
     needs_address_load = false;
-    if (!canReadType(var_type)) return error("Error at %d: Expected integer or char", cur->line_no);
+    if (!canReadType(var_type)) return error("Error at %d: Expected integer or char", tokens->line_no[cur]);
     genRead(var_type);
   }
 
-  if (cur->id != TRPAREN) return error("Error at %d: Expected ')'", cur->line_no);
+  if (tokens->id[cur] != TRPAREN) return error("Error at %d: Expected ')'", tokens->line_no[cur]);
   consumeToken();
   if (isReadln) genCode("CALL", "READLINE");
 
@@ -836,59 +2183,69 @@ static void genWrite(TYPE_KIND type)
       genCode("CALL", "WRITECHAR");
       break;
     default:
-      error("Error at %d: Expected integer, boolean or char", cur->line_no);
+      error("Error at %d: Expected integer, boolean or char", tokens->line_no[cur]);
       break;
   }
 }
 
+//! 長さが1でない文字列を出力する命令を生成する関数。strは両端の'を含まないソース中の文字列
+static void genWriteString(const char * str, int len)
+{
+  genOpcode("LAD");
+  emitStr(emitter, "GR1,='", 6);
+  emitStr(emitter, str, len);
+  emitStr(emitter, "'\n", 2);
+  genCode("LAD", "GR2,0");
+  genCode("CALL", "WRITESTR");
+}
+
 //! 出力文のフォーマットから命令を生成する関数
 static int pOutputFormat()
 {
-  if (cur->id == TSTRING && cur->len != 1) {
-    println("\tLAD\tGR1,='%s'", cur->str);
-    genCode("LAD", "GR2,0");
-    genCode("CALL", "WRITESTR");
+  if (tokens->id[cur] == TSTRING && tokens->len[cur] != 1) {
+    genWriteString(tokens->loc[cur], tokens->loc_len[cur]);
     consumeToken();
     return NORMAL;
   }
 
-  Obj expression = pExpression();
+  Obj expression = pLoadedExpression();
+  if (isObjError(expression)) return ERROR;
 
   int output_num = 0;
-  if (cur->id != TCOLON) {
-    println("\tLAD\tGR2,%d", output_num);
-    genWrite(expression->type);
+  if (tokens->id[cur] != TCOLON) {
+    genCodeNum("LAD", "GR2", output_num);
+    genWrite(expression.type);
     return NORMAL;
   }
   consumeToken();
-  output_num = cur->num;
+  output_num = tokens->num[cur];
   consumeToken();
 
-  println("\tLAD\tGR2,%d", output_num);
-  genWrite(expression->type);
+  genCodeNum("LAD", "GR2", output_num);
+  genWrite(expression.type);
   return NORMAL;
 }
 
 //! 出力文から命令を生成する関数
 static int pOutputStatement()
 {
-  bool isWriteln = cur->id == TWRITELN;
+  bool isWriteln = tokens->id[cur] == TWRITELN;
   consumeToken();
-  if (cur->id != TLPAREN) {
+  if (tokens->id[cur] != TLPAREN) {
     if (isWriteln) genCode("CALL", "WRITELINE");
     return NORMAL;
   }
 
   consumeToken();
-  pOutputFormat();
-  while (cur->id == TCOMMA) {
+  if (pOutputFormat() == ERROR) return ERROR;
+  while (tokens->id[cur] == TCOMMA) {
     consumeToken();
-    pOutputFormat();
+    if (pOutputFormat() == ERROR) return ERROR;
   }
 
   if (isWriteln) genCode("CALL", "WRITELINE");
 
-  if (cur->id != TRPAREN) return error("Error at %d: Expected ')'", cur->line_no);
+  if (tokens->id[cur] != TRPAREN) return error("Error at %d: Expected ')'", tokens->line_no[cur]);
   consumeToken();
 
   return NORMAL;
@@ -897,7 +2254,9 @@ static int pOutputStatement()
 //! 文の構文解析を行う関数
 static int pStatement()
 {
-  switch (cur->id) {
+  // 文の先頭では式の途中結果は残っていない。エラーで解放されなかった作業用レジスタもここで戻す
+  work_register_depth = 0;
+  switch (tokens->id[cur]) {
       // 代入文
     case TNAME:
       if (pAssignment() == ERROR) return ERROR;
@@ -912,8 +2271,8 @@ static int pStatement()
       break;
     // 脱出文
     case TBREAK:
-
       consumeToken();
+      if (loop_exit_label != 0) genCodeLabel("JUMP", loop_exit_label);
       break;
     // 手続き呼び出し文
     case TCALL:
@@ -923,10 +2282,10 @@ static int pStatement()
     case TRETURN:
       consumeToken();
       if (procname != NULL) {
-        println("\tRET");
+        genCode("RET", NULL);
       } else {
         genCode("CALL", "FLUSH");
-        println("\tSVC\t0");
+        genCode("SVC", "0");
       }
       break;
     // 入力文
@@ -955,128 +2314,952 @@ static int pStatement()
 //! 複合文から命令を生成する関数
 static int pCompoundStatement()
 {
-  if (cur->id != TBEGIN) return error("Error at %d: Expected 'begin'", cur->line_no);
+  if (tokens->id[cur] != TBEGIN) return error("Error at %d: Expected 'begin'", tokens->line_no[cur]);
   consumeToken();
   at_bol = true;
 
-  pStatement();
-  while (cur->id == TSEMI) {
+  if (pStatement() == ERROR) return ERROR;
+  while (tokens->id[cur] == TSEMI) {
     consumeToken();
     at_bol = true;
-    pStatement();
+    if (pStatement() == ERROR) return ERROR;
   }
 
-  if (cur->id != TEND) return error("Error at %d: Expected 'end'", cur->line_no);
+  if (tokens->id[cur] != TEND) return error("Error at %d: Expected 'end'", tokens->line_no[cur]);
   consumeToken();
 
   return NORMAL;
 }
 
+//! 一時変数を保持する場所
+typedef struct
+{
+  //! 定義している基本ブロック。定義されていない場合は-1
+  int block;
+  //! 定義している命令の位置
+  int def;
+  //! 最後に使う命令の位置。終端命令はブロックの命令数の位置とする
+  int last_use;
+  //! 使われる回数
+  int uses;
+  //! 値をメモリに置くかどうか。基本ブロックや手続き呼び出しをまたいで使う一時変数はメモリに置く
+  bool in_memory;
+  //! メモリに置く場合の領域のラベルの番号。未確保の場合は0
+  int slot;
+  //! 値を保持しているレジスタ。メモリに置く場合はNULL
+  const char * reg;
+} TempHome;
+
+//! 命令を生成している中間表現
+static const IrFunction * lowering;
+
+//! 一時変数の番号から保持する場所を引く表
+static TempHome * temp_homes;
+
+//! 作業用レジスタが一時変数を保持しているかどうか
+static bool register_used[NUM_WORK_REGISTERS];
+
+//! 基本ブロックの番号から、先頭に置くラベルの番号を引く表。ラベルが不要な場合は0
+static int * block_labels;
+
+//! 基本ブロックの番号から、入口から到達するかどうかを引く表
+static bool * block_reachable;
+
+//! 最後にコメントとして出力したソースの行番号
+static int commented_line;
+
+//! 中間表現から命令を生成するかどうか
+static bool ir_codegen = false;
+
+//! 中間表現を標準出力に表示するかどうか
+static bool ir_dump = false;
+
+//! 中間表現の命令が生成する値を格納するかどうかを判定する関数
+static bool definesValue(IrOpcode op) { return op <= IR_GE || op == IR_LOAD_ELEM; }
+
+//! 比較が成り立たない場合に成り立つ比較を返す関数
+static IrOpcode negateCondition(IrOpcode cond)
+{
+  static const IrOpcode negated[] = {IR_NE, IR_EQ, IR_GE, IR_GT, IR_LE, IR_LT};
+  return negated[cond - IR_EQ];
+}
+
+//! 比較の左右のオペランドを入れ替えた場合に同じ意味になる比較を返す関数
+static IrOpcode mirrorCondition(IrOpcode cond)
+{
+  static const IrOpcode mirrored[] = {IR_EQ, IR_NE, IR_GT, IR_GE, IR_LT, IR_LE};
+  return mirrored[cond - IR_EQ];
+}
+
+//! 値がレジスタにある一時変数かどうかを判定する関数
+static bool inRegister(IrValue value) { return value.kind == IR_TEMP && temp_homes[value.num].reg != NULL; }
+
+//! メモリに置く一時変数の領域のラベルの番号を返す関数
+static int tempSlot(IrValue value)
+{
+  TempHome * home = &temp_homes[value.num];
+  if (home->slot == 0) home->slot = getLabelNum();
+  return home->slot;
+}
+
+//! 値をレジスタregに読み込む命令を生成する関数
+static void loadValue(const char * reg, IrValue value)
+{
+  switch (value.kind) {
+    case IR_CONST:
+      genCodeNum("LAD", reg, value.num);
+      break;
+    case IR_TEMP:
+      if (!inRegister(value)) {
+        genCodeSlot("LD", reg, tempSlot(value));
+      } else if (strcmp(reg, temp_homes[value.num].reg) != 0) {
+        genCodeRegs("LD", reg, temp_homes[value.num].reg);
+      }
+      break;
+    default:
+      genCodeAddr("LD", reg, value.symbol->label, NULL);
+      // 仮引数には実引数のアドレスが格納されている
+      if (value.symbol->ispara) genCodeAddr("LD", reg, "0", reg);
+      break;
+  }
+}
+
+//! 値を保持しているレジスタを返す関数。0はGR0を返し、レジスタにない値はscratchに読み込む
+static const char * lowerOperand(IrValue value, const char * scratch)
+{
+  if (inRegister(value)) return temp_homes[value.num].reg;
+  if (value.kind == IR_CONST && value.num == 0) return "GR0";
+  loadValue(scratch, value);
+  return scratch;
+}
+
+//! レジスタregと値の演算の命令を生成する関数。アドレスで参照できる値はレジスタに読み込まない
+static void genOperation(const char * opc, const char * reg, IrValue value)
+{
+  if (value.kind == IR_VAR && !value.symbol->ispara) {
+    genCodeAddr(opc, reg, value.symbol->label, NULL);
+  } else if (value.kind == IR_TEMP && !inRegister(value)) {
+    genCodeSlot(opc, reg, tempSlot(value));
+  } else {
+    genCodeRegs(opc, reg, lowerOperand(value, "GR2"));
+  }
+}
+
+//! 配列の添字を保持するインデックスレジスタを返す関数。添字が0の場合はNULLを返す
+static const char * indexRegister(IrValue index)
+{
+  if (index.kind == IR_CONST && index.num == 0) return NULL;
+  return lowerOperand(index, "GR2");
+}
+
+//! 命令の結果をレジスタregから格納先に書き込む命令を生成する関数
+static void storeResult(IrValue dst, const char * reg)
+{
+  if (dst.kind == IR_TEMP) {
+    if (!inRegister(dst)) genCodeSlot("ST", reg, tempSlot(dst));
+  } else if (dst.symbol->ispara) {
+    genCodeAddr("LD", "GR2", dst.symbol->label, NULL);
+    genCodeAddr("ST", reg, "0", "GR2");
+  } else {
+    genCodeAddr("ST", reg, dst.symbol->label, NULL);
+  }
+}
+
+//! 呼び出し文の中で次に渡す実引数の番号
+static int argument_index = 0;
+
+//! 位置posの実引数を受け取る仮引数を返す関数。基本ブロックの中で後に続く呼び出しの手続きから引く
+static const Symbol * argumentParameter(const IrBlock * block, int pos)
+{
+  while (block->instrs[pos].op != IR_CALL) pos++;
+  const ProcedureInfo * procedure = procedureInfo(block->instrs[pos].a.symbol);
+  return argument_index < procedure->num_params ? procedure->params[argument_index] : NULL;
+}
+
+/**
+ * @brief 値を次の命令が値渡しの実引数として渡す場合に、実引数を渡す作業用レジスタの番号を返す関数
+ * そのレジスタに直接値を求めれば、実引数を渡すための転送が要らない
+ * @return int 作業用レジスタの番号。該当しない場合やレジスタが空いていない場合は-1
+ */
+static int argumentRegister(IrValue value, const IrBlock * block, int pos)
+{
+  if (!register_arguments || argument_index >= NUM_WORK_REGISTERS || register_used[argument_index]) return -1;
+  TempHome * home = &temp_homes[value.num];
+  if (home->uses != 1 || home->last_use != pos + 1 || pos + 1 >= block->size) return -1;
+  const IrInstr * next = &block->instrs[pos + 1];
+  if (next->op != IR_ARG || next->a.kind != IR_TEMP || next->a.num != value.num) return -1;
+  const Symbol * param = argumentParameter(block, pos + 1);
+  return param != NULL && !param->ispara ? argument_index : -1;
+}
+
+//! 値を次の命令がGR1に読み込んで使うかどうかを判定する関数
+static bool isConsumedInGr1(IrValue value, const IrBlock * block, int pos)
+{
+  TempHome * home = &temp_homes[value.num];
+  if (home->uses != 1 || home->last_use != pos + 1 || pos + 1 >= block->size) return false;
+  const IrInstr * next = &block->instrs[pos + 1];
+  switch (next->op) {
+    case IR_MOVE:
+    case IR_WRITE:
+      return next->a.kind == IR_TEMP && next->a.num == value.num;
+    case IR_ARG:
+      return next->a.kind == IR_TEMP && next->a.num == value.num && next->b.kind == IR_NONE;
+    case IR_STORE_ELEM:
+      return next->b.kind == IR_TEMP && next->b.num == value.num;
+    default:
+      return false;
+  }
+}
+
+//! 値がこの命令で最後に使われ、作業用レジスタにある一時変数かどうかを判定する関数
+static bool diesInWorkRegister(IrValue value, int pos)
+{
+  return inRegister(value) && temp_homes[value.num].last_use == pos && strcmp(temp_homes[value.num].reg, "GR1") != 0;
+}
+
+/**
+ * @brief 命令の結果を求めるレジスタを決める関数
+ * 次の命令がGR1で使う一時変数はGR1に、そうでなければこの命令で最後に使われるオペランドのレジスタか、
+ * 空いている作業用レジスタに割り当てる。空いていなければメモリに置く
+ * @param instr 命令
+ * @param block 命令を含む基本ブロック
+ * @param pos 命令の位置
+ * @param operand 結果のレジスタを共有してよいオペランド
+ * @return const char* 結果を求めるレジスタ。変数やメモリに置く一時変数に格納する場合はGR1
+ */
+static const char * allocateResult(const IrInstr * instr, const IrBlock * block, int pos, IrValue operand)
+{
+  if (instr->dst.kind != IR_TEMP) return "GR1";
+  TempHome * home = &temp_homes[instr->dst.num];
+  if (home->in_memory) return "GR1";
+  int argument = argumentRegister(instr->dst, block, pos);
+  if (argument >= 0) {
+    register_used[argument] = true;
+    home->reg = work_registers[argument];
+  } else if (isConsumedInGr1(instr->dst, block, pos)) {
+    home->reg = "GR1";
+  } else if (diesInWorkRegister(operand, pos)) {
+    home->reg = temp_homes[operand.num].reg;
+  } else {
+    for (int i = 0; i < NUM_WORK_REGISTERS; i++) {
+      if (register_used[i]) continue;
+      register_used[i] = true;
+      home->reg = work_registers[i];
+      break;
+    }
+    if (home->reg == NULL) home->in_memory = true;
+  }
+  return home->reg != NULL ? home->reg : "GR1";
+}
+
+//! 一時変数がこの命令で最後に使われる場合に、保持していた作業用レジスタを空ける関数
+static void releaseOperand(IrValue value, int pos, const char * result)
+{
+  if (!inRegister(value) || temp_homes[value.num].last_use != pos) return;
+  const char * reg = temp_homes[value.num].reg;
+  temp_homes[value.num].reg = NULL;
+  // 結果を同じレジスタに求めた場合は空けない
+  if (result != NULL && strcmp(reg, result) == 0) return;
+  for (int i = 0; i < NUM_WORK_REGISTERS; i++) {
+    if (strcmp(reg, work_registers[i]) == 0) register_used[i] = false;
+  }
+}
+
+//! CPAの結果のフラグから、比較が成り立つ場合にラベルへ分岐する命令を生成する関数
+static void genConditionJump(IrOpcode cond, int label)
+{
+  static const char * const jumps[] = {"JZE", "JNZ", "JMI", "JMI", "JPL", "JPL"};
+  genCodeLabel(jumps[cond - IR_EQ], label);
+  // <=と>=は等しい場合にも分岐する
+  if (cond == IR_LE || cond == IR_GE) genCodeLabel("JZE", label);
+}
+
+/**
+ * @brief 比較の命令を生成する関数
+ * 左オペランドはレジスタに置く必要があるので、右オペランドだけがレジスタにある場合や左オペランドだけが定数の場合は
+ * オペランドを入れ替える。分岐が二つ必要な比較は、右オペランドが定数であれば1ずらして分岐が一つで済む比較にする
+ * @param cond 比較の種類
+ * @param a 左オペランド
+ * @param b 右オペランド
+ * @param scratch 左オペランドを読み込むレジスタ
+ * @return IrOpcode 生成した比較の命令のフラグで判定する比較の種類
+ */
+static IrOpcode genCompare(IrOpcode cond, IrValue a, IrValue b, const char * scratch)
+{
+  if ((!inRegister(a) && inRegister(b)) || (a.kind == IR_CONST && b.kind != IR_CONST)) {
+    IrValue value = a;
+    a = b;
+    b = value;
+    cond = mirrorCondition(cond);
+  }
+  if (b.kind == IR_CONST && cond == IR_LE && b.num < MAX_WORD) {
+    cond = IR_LT;
+    b.num++;
+  } else if (b.kind == IR_CONST && cond == IR_GE && b.num > MIN_WORD) {
+    cond = IR_GT;
+    b.num--;
+  }
+  const char * lhs = inRegister(a) ? temp_homes[a.num].reg : scratch;
+  if (!inRegister(a)) loadValue(lhs, a);
+  genOperation("CPA", lhs, b);
+  return cond;
+}
+
+//! 型変換の命令を生成する関数
+static void lowerCast(const char * reg, IrValue dst, IrValue value)
+{
+  loadValue(reg, value);
+  if (dst.type == TPCHAR && value.type == TPINT) {
+    genCode("LAD", "GR2,#007F");
+    genCodeRegs("AND", reg, "GR2");
+  } else if (dst.type == TPBOOL && value.type != TPBOOL) {
+    int label = getLabelNum();
+    genCodeRegs("CPA", reg, "GR0");
+    genCodeLabel("JZE", label);
+    genCodeNum("LAD", reg, 1);
+    genLabel(label);
+  }
+}
+
+//! 実引数を積む命令を生成する関数
+static void lowerArgument(IrValue value, IrValue index)
+{
+  if (value.kind != IR_VAR) {
+    // 式の値は呼び出しごとの領域に格納して、そのアドレスを渡す
+    int slot = newArgumentSlot();
+    genCodeSlot("ST", lowerOperand(value, "GR1"), slot);
+    genCodeLabel("PUSH", slot);
+    return;
+  }
+  if (value.symbol->ispara) {
+    genCodeAddr("LD", "GR1", value.symbol->label, NULL);
+    genCode("PUSH", "0,GR1");
+    return;
+  }
+  const char * reg = index.kind != IR_NONE ? indexRegister(index) : NULL;
+  genOpcode("PUSH");
+  emitCStr(emitter, value.symbol->label);
+  if (reg != NULL) {
+    emitChar(emitter, ',');
+    emitCStr(emitter, reg);
+  }
+  emitChar(emitter, '\n');
+}
+
+/**
+ * @brief 実引数を作業用レジスタで渡す命令を生成する関数
+ * 値渡しの仮引数には値を、参照渡しの仮引数にはアドレスを渡す。式の値は呼び出しごとの領域に格納してアドレスを渡す。
+ * 作業用レジスタの数を超える実引数はスタックに積む
+ * @param block 命令を含む基本ブロック
+ * @param pos 命令の位置
+ * @param value 実引数
+ * @param index 配列の要素の場合は添字
+ */
+static void lowerRegisterArgument(const IrBlock * block, int pos, IrValue value, IrValue index)
+{
+  const Symbol * param = argumentParameter(block, pos);
+  bool stacked = argument_index >= NUM_WORK_REGISTERS;
+  const char * reg = stacked ? "GR1" : work_registers[argument_index];
+  if (param != NULL && !param->ispara) {
+    if (value.kind == IR_VAR && index.kind != IR_NONE) {
+      genCodeAddr("LD", reg, value.symbol->label, indexRegister(index));
+    } else {
+      loadValue(reg, value);
+    }
+  } else if (value.kind != IR_VAR) {
+    int slot = newArgumentSlot();
+    genCodeSlot("ST", lowerOperand(value, "GR1"), slot);
+    genCodeSlot("LAD", reg, slot);
+  } else if (value.symbol->ispara) {
+    genCodeAddr("LD", reg, value.symbol->label, NULL);
+  } else {
+    genCodeAddr("LAD", reg, value.symbol->label, index.kind != IR_NONE ? indexRegister(index) : NULL);
+  }
+  if (stacked) genCode("PUSH", "0,GR1");
+}
+
+//! 入力文で読み込む先のアドレスをGR1に求める命令を生成する関数
+static void loadReadAddress(IrValue value, IrValue index)
+{
+  if (value.symbol->ispara) {
+    genCodeAddr("LD", "GR1", value.symbol->label, NULL);
+    return;
+  }
+  genCodeAddr("LAD", "GR1", value.symbol->label, index.kind != IR_NONE ? indexRegister(index) : NULL);
+}
+
+/**
+ * @brief 中間表現の命令から命令を生成する関数
+ *
+ * @param block 命令を含む基本ブロック
+ * @param pos 命令の位置
+ */
+static void lowerInstr(const IrBlock * block, int pos)
+{
+  const IrInstr * instr = &block->instrs[pos];
+  IrValue a = instr->a, b = instr->b;
+  const char * reg = NULL;
+  if (definesValue(instr->op)) {
+    // 交換できる演算は、最後に使われるレジスタのオペランドを左に置いてそのレジスタに結果を求める
+    bool commutative = instr->op == IR_ADD || instr->op == IR_MUL || instr->op == IR_AND || instr->op == IR_OR;
+    if (commutative && !diesInWorkRegister(a, pos) && diesInWorkRegister(b, pos)) {
+      a = instr->b;
+      b = instr->a;
+    }
+    reg = allocateResult(instr, block, pos, instr->op == IR_LOAD_ELEM ? b : a);
+  }
+
+  switch (instr->op) {
+    case IR_MOVE:
+      if (inRegister(instr->dst)) {
+        loadValue(reg, a);
+      } else {
+        storeResult(instr->dst, lowerOperand(a, "GR1"));
+        reg = NULL;
+      }
+      break;
+    case IR_NEG:
+      if (inRegister(a) && strcmp(temp_homes[a.num].reg, reg) == 0) {
+        genCodeRegs("LD", "GR2", reg);
+        genCodeRegs("LD", reg, "GR0");
+        genCodeRegs("SUBA", reg, "GR2");
+      } else {
+        genCodeRegs("LD", reg, "GR0");
+        genOperation("SUBA", reg, a);
+      }
+      genCode("JOV", "EOVF");
+      break;
+    case IR_NOT:
+      loadValue(reg, a);
+      genCode("LAD", "GR2,1");
+      genCodeRegs("XOR", reg, "GR2");
+      break;
+    case IR_CAST:
+      lowerCast(reg, instr->dst, a);
+      break;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV: {
+      static const char * const arithmetic[] = {"ADDA", "SUBA", "MULA", "DIVA"};
+      loadValue(reg, a);
+      genOperation(arithmetic[instr->op - IR_ADD], reg, b);
+      genCode("JOV", "EOVF");
+      break;
+    }
+    case IR_AND:
+    case IR_OR:
+      loadValue(reg, a);
+      genOperation(instr->op == IR_AND ? "AND" : "OR", reg, b);
+      break;
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+    case IR_GT:
+    case IR_GE: {
+      // 比較の後でLADはフラグを変えないので、真を仮定して1を読み込んでから分岐する
+      int label = getLabelNum();
+      IrOpcode cond = genCompare(instr->op, a, b, reg);
+      genCodeNum("LAD", reg, 1);
+      genConditionJump(cond, label);
+      genCodeNum("LAD", reg, 0);
+      genLabel(label);
+      break;
+    }
+    case IR_CHECK_INDEX: {
+      int size = a.symbol->arraysize;
+      if (bounds_check == BOUNDS_CHECK_OFF) break;
+      if (bounds_check == BOUNDS_CHECK_AUTO && b.kind == IR_CONST && b.num >= 0 && b.num < size) break;
+      const char * index = lowerOperand(b, "GR1");
+      genCodeRegs("CPA", index, "GR0");
+      genCode("JMI", "EROV");
+      genCodeNum("LAD", "GR2", size - 1);
+      genCodeRegs("CPA", index, "GR2");
+      genCode("JPL", "EROV");
+      break;
+    }
+    case IR_LOAD_ELEM:
+      genCodeAddr("LD", reg, a.symbol->label, indexRegister(b));
+      break;
+    case IR_STORE_ELEM: {
+      const char * value = lowerOperand(b, "GR1");
+      genCodeAddr("ST", value, instr->dst.symbol->label, indexRegister(a));
+      break;
+    }
+    case IR_ARG:
+      if (register_arguments) {
+        lowerRegisterArgument(block, pos, a, b);
+      } else {
+        lowerArgument(a, b);
+      }
+      break;
+    case IR_CALL:
+      genCode("CALL", a.symbol->label);
+      // 実引数を渡した作業用レジスタを空ける
+      for (int i = 0; i < argument_index && i < NUM_WORK_REGISTERS; i++) register_used[i] = false;
+      argument_index = 0;
+      break;
+    case IR_READ:
+      loadReadAddress(a, b);
+      genRead(getVarType(*a.symbol));
+      break;
+    case IR_READLN:
+      genCode("CALL", "READLINE");
+      break;
+    case IR_WRITE:
+      if (a.kind == IR_STRING) {
+        genWriteString(a.str, a.num);
+        break;
+      }
+      loadValue("GR1", a);
+      genCodeNum("LAD", "GR2", b.num);
+      genWrite(a.type);
+      break;
+    case IR_WRITELN:
+      genCode("CALL", "WRITELINE");
+      break;
+    default:
+      break;
+  }
+
+  if (reg != NULL) storeResult(instr->dst, reg);
+  releaseOperand(a, pos, reg);
+  releaseOperand(b, pos, reg);
+  // 渡した実引数のレジスタは呼び出しまで使わない
+  if (instr->op == IR_ARG && register_arguments) {
+    if (argument_index < NUM_WORK_REGISTERS) register_used[argument_index] = true;
+    argument_index++;
+  }
+}
+
+//! 配置で次に置く基本ブロックの番号を返す関数。到達しない基本ブロックは置かない。ない場合は-1を返す
+static int nextReachableBlock(int i)
+{
+  for (i++; i < lowering->num_blocks; i++) {
+    if (block_reachable[i]) return i;
+  }
+  return -1;
+}
+
+//! 基本ブロックの先頭のラベルの番号を返す関数。まだ割り当てていない場合は割り当てる
+static int blockLabel(int i)
+{
+  if (block_labels[i] == 0) block_labels[i] = getLabelNum();
+  return block_labels[i];
+}
+
+/**
+ * @brief 終端命令から命令を生成する関数。次に置く基本ブロックへの分岐は省く
+ *
+ * @param block 基本ブロックの番号
+ */
+static void lowerTerminator(int block)
+{
+  const IrInstr * term = &lowering->blocks[block].term;
+  int next = nextReachableBlock(block);
+  switch (term->op) {
+    case IR_JUMP:
+      if (term->target == next) break;
+      genCodeLabel("JUMP", blockLabel(term->target));
+      break;
+    case IR_BRANCH: {
+      int pos = lowering->blocks[block].size;
+      IrOpcode cond = term->cond;
+      int target = term->target, other = -1;
+      if (target == next) {
+        cond = negateCondition(cond);
+        target = term->other;
+      } else if (term->other != next) {
+        other = term->other;
+      }
+      cond = genCompare(cond, term->a, term->b, "GR1");
+      genConditionJump(cond, blockLabel(target));
+      if (other >= 0) genCodeLabel("JUMP", blockLabel(other));
+      releaseOperand(term->a, pos, NULL);
+      releaseOperand(term->b, pos, NULL);
+      break;
+    }
+    default:
+      if (lowering->name == NULL) genCode("CALL", "FLUSH");
+      genCode("RET", NULL);
+      break;
+  }
+}
+
+//! 入口から到達する基本ブロックに印を付ける関数
+static void markReachable(int i)
+{
+  while (!block_reachable[i]) {
+    block_reachable[i] = true;
+    const IrInstr * term = &lowering->blocks[i].term;
+    if (term->op == IR_RETURN) return;
+    if (term->op == IR_BRANCH) markReachable(term->other);
+    i = term->target;
+  }
+}
+
+//! 一時変数を使う命令の位置を記録する関数
+static void noteTempUse(IrValue value, int block, int pos)
+{
+  if (value.kind != IR_TEMP) return;
+  TempHome * home = &temp_homes[value.num];
+  home->uses++;
+  // 定義と異なる基本ブロックで使う一時変数はメモリに置く
+  if (home->block != block) home->in_memory = true;
+  home->last_use = pos;
+}
+
+//! 一時変数ごとに定義と使用の位置を調べ、メモリに置く一時変数を決める関数
+static void analyzeTemps()
+{
+  for (int i = 0; i < lowering->num_temps; i++) {
+    TempHome home = {-1, 0, 0, 0, false, 0, NULL};
+    temp_homes[i] = home;
+  }
+  for (int i = 0; i < lowering->num_blocks; i++) {
+    const IrBlock * block = &lowering->blocks[i];
+    for (int j = 0; j <= block->size; j++) {
+      const IrInstr * instr = j < block->size ? &block->instrs[j] : &block->term;
+      noteTempUse(instr->a, i, j);
+      noteTempUse(instr->b, i, j);
+      if (instr->dst.kind != IR_TEMP || instr->op == IR_STORE_ELEM) continue;
+      TempHome * home = &temp_homes[instr->dst.num];
+      if (home->block >= 0) home->in_memory = true;
+      home->block = i;
+      home->def = j;
+    }
+  }
+  // 手続きはレジスタを保存しないので、呼び出しをまたいで使う一時変数はメモリに置く
+  for (int i = 0; i < lowering->num_blocks; i++) {
+    const IrBlock * block = &lowering->blocks[i];
+    for (int j = 0; j < block->size; j++) {
+      if (block->instrs[j].op != IR_CALL) continue;
+      for (int k = 0; k < lowering->num_temps; k++) {
+        TempHome * home = &temp_homes[k];
+        if (home->block == i && home->def < j && home->last_use > j) home->in_memory = true;
+      }
+    }
+  }
+}
+
+//! 中間表現の命令の文を含むソースの行をコメントとして出力する関数。直前に出力した行と同じ場合は出力しない
+static void genSourceLine(int tok)
+{
+  int line = tokens->line_no[tok];
+  if (!source_comments || line == commented_line) return;
+  commented_line = line;
+  int first = tok;
+  while (first > 0 && tokens->line_no[first - 1] == line) first--;
+  print_len = 0;
+  appendPrintBuf(";\t", 2);
+  for (int i = first; i < tokens->size - 1 && tokens->line_no[i] == line; i++) {
+    // 行頭に置くトークンは行の途中に現れても空白で区切る
+    if (i > first && (tokens->has_space[i] || tokens->at_bol[i])) appendPrintBuf(" ", 1);
+    appendTokenText(i);
+  }
+  genLine(print_buf, print_len);
+  print_len = 0;
+}
+
+/**
+ * @brief 中間表現から命令を生成する関数
+ * 基本ブロックを配置の順に並べ、一時変数は基本ブロックの中で作業用レジスタに割り当てる
+ * @param ir 中間表現
+ */
+static void lowerIrFunction(const IrFunction * ir)
+{
+  lowering = ir;
+  temp_homes = malloc(sizeof(TempHome) * (ir->num_temps + 1));
+  block_labels = calloc(ir->num_blocks, sizeof(int));
+  block_reachable = calloc(ir->num_blocks, sizeof(bool));
+  if (temp_homes == NULL || block_labels == NULL || block_reachable == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  analyzeTemps();
+  markReachable(0);
+
+  // 後ろへの分岐に備えて、先に分岐先の基本ブロックにラベルを割り当てておく
+  for (int i = 0; i < ir->num_blocks; i++) {
+    const IrInstr * term = &ir->blocks[i].term;
+    if (!block_reachable[i]) continue;
+    int next = nextReachableBlock(i);
+    if (term->op == IR_JUMP && term->target != next) blockLabel(term->target);
+    if (term->op == IR_BRANCH && term->target != next) blockLabel(term->target);
+    if (term->op == IR_BRANCH && term->other != next) blockLabel(term->other);
+  }
+
+  // 直前に行バッファに溜めていた宣言部のコメントを出力する
+  if (print_len > 2) genLine(print_buf, print_len);
+  print_len = 0;
+  commented_line = 0;
+  for (int i = 0; i < ir->num_blocks; i++) {
+    if (!block_reachable[i]) continue;
+    if (block_labels[i] != 0) genLabel(block_labels[i]);
+    const IrBlock * block = &ir->blocks[i];
+    for (int j = 0; j < NUM_WORK_REGISTERS; j++) register_used[j] = false;
+    for (int j = 0; j < block->size; j++) {
+      genSourceLine(block->instrs[j].tok);
+      lowerInstr(block, j);
+    }
+    genSourceLine(block->term.tok);
+    lowerTerminator(i);
+  }
+
+  // メモリに置いた一時変数の領域を確保する
+  for (int i = 0; i < ir->num_temps; i++) {
+    if (temp_homes[i].slot == 0) continue;
+    emitLabelNum(emitter, temp_homes[i].slot);
+    emitStr(emitter, "\tDS\t1\n", 6);
+  }
+  genArgumentSlots();
+  free(temp_homes);
+  free(block_labels);
+  free(block_reachable);
+}
+
+/**
+ * @brief 副プログラムもしくは主プログラムの複合文を中間表現に組み立て、命令を生成する関数
+ * 複合文の直後まで読み進める
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+static int genIrBody()
+{
+  IrFunction * ir = buildIrFunction(tokens, &cur, procname);
+  if (ir == NULL) {
+    codegen_status = ERROR;
+    return ERROR;
+  }
+  if (ir_dump) printIrFunction(stdout, ir);
+  lowerIrFunction(ir);
+  freeIrFunction(ir);
+  return NORMAL;
+}
+
 //! 関数の引数を処理する関数
 static int pFormalParameters()
 {
-  if (cur->id != TLPAREN) return error("Error at %d: Expected '('", cur->line_no);
+  if (tokens->id[cur] != TLPAREN) return error("Error at %d: Expected '('", tokens->line_no[cur]);
   consumeToken();
-  if (cur->kind != TK_IDENT) return error("Error at %d: Expected variable name", cur->line_no);
+  if (tokens->kind[cur] != TK_IDENT) return error("Error at %d: Expected variable name", tokens->line_no[cur]);
   pVarNames(true);
-  while (cur->id != TSEMI && cur->id != TRPAREN) consumeToken();
+  while (tokens->id[cur] != TSEMI && tokens->id[cur] != TRPAREN) consumeToken();
 
-  while (cur->id == TSEMI || cur->id == TRPAREN) {
-    if (cur->id == TRPAREN) {
-      consumeToken();
-      break;
-    }
+  // ';'で区切られた仮引数の並びを順に処理する
+  while (tokens->id[cur] == TSEMI) {
+    consumeToken();
+    pVarNames(true);
+    while (tokens->id[cur] != TSEMI && tokens->id[cur] != TRPAREN) consumeToken();
   }
+  consumeToken();
 
   return NORMAL;
 }
 
+/**
+ * @brief 作業用レジスタとスタックで渡された実引数を仮引数に格納する命令を生成する関数
+ * 先頭から作業用レジスタの数までの実引数はGR3から順に、残りはスタックに積まれている
+ */
+static void genParameterStores()
+{
+  int size = (int)parameter_stack.size;
+  if (size > NUM_WORK_REGISTERS) {
+    // GR2に戻り番地を退避し、最後の実引数から順にPOPする
+    genCode("POP", "GR2");
+    for (int i = size - 1; i >= NUM_WORK_REGISTERS; i--) {
+      genCode("POP", "GR1");
+      genCodeAddr("ST", "GR1", parameter_stack.data[i], NULL);
+    }
+    genCode("PUSH", "0,GR2");
+  }
+  for (int i = 0; i < size && i < NUM_WORK_REGISTERS; i++) {
+    genCodeAddr("ST", work_registers[i], parameter_stack.data[i], NULL);
+  }
+  parameter_stack.size = 0;
+}
+
 //! 関数の定義を処理する関数
 static int pSubProgram()
 {
-  procname = cur->str;
+  procname = tokenStr(tokens, cur);
   consumeToken();
-  if (cur->id == TLPAREN) {
+  if (tokens->id[cur] == TLPAREN) {
     pFormalParameters();
   }
   consumeToken();
-  if (cur->id == TVAR) pVarDeclaration();
-  println("%s", getSymbol(procname).label);
-
-  if (!PARAMETER_is_empty(&parameter_stack)) {
+  if (tokens->id[cur] == TVAR) pVarDeclaration();
+  range_facts.size = 0;
+  const char * proc_label = getSymbol(procname, NULL).label;
+  genLine(proc_label, strlen(proc_label));
+
+  if (register_arguments) {
+    genParameterStores();
+  } else if (!PARAMETER_is_empty(&parameter_stack)) {
     // GR2に戻り番地、GR1に関数の引数を
     genCode("POP", "GR2");
     genCode("POP", "GR1");
 
     for (;;) {
       char * label = PARAMETER_pop(&parameter_stack);
-      println("\tST\tGR1,%s", label);
+      genCodeAddr("ST", "GR1", label, NULL);
       if (PARAMETER_is_empty(&parameter_stack)) break;
       genCode("POP", "GR1");
     }
-    println("\tPUSH\t0,GR2");
+    genCode("PUSH", "0,GR2");
   }
 
-  pCompoundStatement();
-  if (cur->id != TSEMI) return error("Error at %d: Expected ';'", cur->line_no);
+  // 中間表現から生成する場合は、戻りの命令も中間表現の終端命令から生成する
+  if (ir_codegen) {
+    if (genIrBody() == ERROR) return ERROR;
+    if (tokens->id[cur] != TSEMI) return error("Error at %d: Expected ';'", tokens->line_no[cur]);
+    skipToken();
+    procname = NULL;
+    return NORMAL;
+  }
+  if (pCompoundStatement() == ERROR) {
+    codegen_status = ERROR;
+    return ERROR;
+  }
+  if (tokens->id[cur] != TSEMI) return error("Error at %d: Expected ';'", tokens->line_no[cur]);
   consumeToken();
   procname = NULL;
-  println("\tRET");
+  genCode("RET", NULL);
+  genArgumentSlots();
   return NORMAL;
 }
 
-//! ブロック文から命令を生成する関数
-static int pBlock(char * program_name)
-{
-  int label = getLabelNum();
-  println("%%%%%s\tSTART\tL%04d", program_name, label);
+//! ソースの行をコメントとして出力するかどうかを設定する関数
+void setSourceComments(bool enabled) { source_comments = enabled; }
 
-  for (;;) {
-    if (cur->id == TVAR) {
-      pVarDeclaration();
-    } else if (cur->id == TPROCEDURE) {
-      consumeToken();
-      pSubProgram();
-    } else {
-      break;
-    }
-  }
-  genLabel(label);
-  genCode("LAD", "GR0,0");
-  if (pCompoundStatement() == ERROR) return ERROR;
+//! 配列の添字の範囲検査を生成する方針を設定する関数
+void setBoundsCheck(BoundsCheck mode) { bounds_check = mode; }
 
-  return NORMAL;
+//! 最適化のレベルを設定する関数
+void setOptimizationLevel(int level) { optimization_level = level; }
+
+//! 副プログラムと主プログラムの複合文を中間表現を経由して命令に変換するかどうかを設定する関数。実験的な経路である
+void setIrCodegen(bool enabled) { ir_codegen = enabled; }
+
+//! 組み立てた中間表現を標準出力に表示するかどうかを設定する関数
+void setIrDump(bool enabled) { ir_dump = enabled; }
+
+//! コード生成の状態を初期化する関数
+static void initCodegen(TokenArray * tok, Emitter * output)
+{
+  emitter = output;
+  tokens = tok;
+  cur = 0;
+  codegen_status = NORMAL;
+  range_facts.size = 0;
+  PARAMETER_init(&parameter_stack);
 }
 
-//! プログラム文から命令を生成する関数
-static int pProgramst()
+//! プログラム名から命令を生成する関数
+static int genProgramHeader()
 {
-  if (cur->id != TPROGRAM)
-    return error("Error at %d: Keyword 'program' is not found", cur->line_no);
+  if (tokens->id[cur] != TPROGRAM)
+    return error("Error at %d: Keyword 'program' is not found", tokens->line_no[cur]);
   consumeToken();
-  char * program_name = cur->str;
+  char * program_name = tokenStr(tokens, cur);
   consumeToken();
   consumeToken();
 
-  pBlock(program_name);
-  genCode("CALL", "FLUSH");
-  println("\tRET");
+  main_label = getLabelNum();
+  emitStr(emitter, "%%", 2);
+  emitCStr(emitter, program_name);
+  emitStr(emitter, "\tSTART\t", 7);
+  genLabel(main_label);
+  return NORMAL;
+}
+
+//! 変数宣言部もしくは副プログラム宣言を一つ読んで命令を生成する関数
+static int genDeclaration()
+{
+  if (tokens->id[cur] == TVAR) return pVarDeclaration();
   consumeToken();
 
-  return NORMAL;
+  // 到達できない副プログラムも、誤りを検出するために一度命令を生成してから取り消す
+  const Symbol * proc = findSymbol(tokenStr(tokens, cur), NULL);
+  EmitterMark mark = markEmitter(emitter);
+  int result = pSubProgram();
+  if (proc != NULL && !proc->reachable) stripProcedure(proc, mark);
+  return result;
 }
 
-//! コード生成を行う関数
-int codegen(Token * tok, FILE * output)
+//! 主プログラムの複合文と実行時ライブラリから命令を生成する関数
+static int genMainProgram()
 {
-  output_file = output;
-  cur = tok;
-  PARAMETER_init(&parameter_stack);
+  genLabel(main_label);
+  genCode("LAD", "GR0,0");
+  range_facts.size = 0;
+  if (ir_codegen) {
+    if (genIrBody() == ERROR) return ERROR;
+    skipToken();
+  } else {
+    if (pCompoundStatement() == ERROR) {
+      codegen_status = ERROR;
+      return ERROR;
+    }
+    genCode("CALL", "FLUSH");
+    genCode("RET", NULL);
+    genArgumentSlots();
+    consumeToken();
+  }
 
-  symbols = parseSymbols(getCrossrefBuf());
-  if (pProgramst() == ERROR) return ERROR;
-  outlib(output_file);
-  println("\tEND");
+  if (optimization_level >= 1) optimizePeephole(emitter, 0);
+  outlib(emitter, optimization_level >= 1);
+  genLine("\tEND", 4);
+  return codegen_status;
+}
 
-  return NORMAL;
-}
\ No newline at end of file
+//! 構文解析の結果の記号表を用いてコード生成を行う関数
+int codegen(TokenArray * tok, Emitter * output)
+{
+  initCodegen(tok, output);
+  strip_unused = optimization_level >= 1;
+  if (strip_unused) findReachableProcedures();
+  register_arguments = optimization_level >= 1;
+  if (register_arguments) findValueParameters();
+
+  if (genProgramHeader() == ERROR) return ERROR;
+  while (tokens->id[cur] == TVAR || tokens->id[cur] == TPROCEDURE) {
+    if (genDeclaration() == ERROR) return ERROR;
+  }
+  return genMainProgram();
+}
+
+//! 生成しなかった要素のうち、副プログラムかどうかがprocに一致するものの名前を一行ずつ出力する関数
+static void printStrippedNames(FILE * fp, bool proc)
+{
+  for (int i = 0; i < num_stripped_symbols; i++) {
+    const Symbol * symbol = stripped_symbols[i];
+    if ((symbol->type->ttype == TPPROC) != proc) continue;
+    // 局所的な名前はクロスリファレンス表と同じく、名前:副プログラム名の形で出力する
+    if (symbol->procname != NULL) {
+      fprintf(fp, "    %s:%s\n", symbol->name, symbol->procname);
+    } else {
+      fprintf(fp, "    %s\n", symbol->name);
+    }
+  }
+}
+
+/**
+ * @brief 生成しなかった副プログラムと変数の数と名前、それらが占めるはずだった語数を出力する関数
+ * 最適化のレベルが0で取り除いていない場合は、その旨だけを出力する
+ * @param fp 出力先
+ */
+void printStripReport(FILE * fp)
+{
+  fprintf(fp, "Unused symbol elimination\n");
+  if (!strip_unused) {
+    fprintf(fp, "  disabled (requires -O1)\n");
+    return;
+  }
+  fprintf(fp, "  %-18s%8d\n", "procedures", stripped_procedures);
+  printStrippedNames(fp, true);
+  fprintf(fp, "  %-18s%8d\n", "variables", stripped_variables);
+  printStrippedNames(fp, false);
+  fprintf(fp, "  %-18s%8d\n", "code words", stripped_code_words);
+  fprintf(fp, "  %-18s%8d\n", "data words", stripped_data_words);
+}
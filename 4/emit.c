@@ -0,0 +1,172 @@
+#include "emit.h"
+
+#include <unistd.h>
+
+#include "lpp.h"
+
+/**
+ * @file
+ * 出力バッファへの書き込みと、ファイルへの書き出しを実装している
+ */
+
+/**
+ * @brief 空の出力バッファを生成する
+ * 
+ * @return Emitter* 生成した出力バッファ
+ */
+Emitter * newEmitter(void)
+{
+  Emitter * emitter = calloc(1, sizeof(Emitter));
+  if (emitter == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  return emitter;
+}
+
+/**
+ * @brief 出力バッファに少なくともlen文字を追記できる容量を確保する
+ * 容量は倍々に広げる
+ * @param emitter 出力バッファ
+ * @param len 追記したい文字数
+ */
+static void reserveEmitter(Emitter * emitter, size_t len)
+{
+  if (emitter->len + len <= emitter->capacity) return;
+  size_t capacity = emitter->capacity ? emitter->capacity : EMITTER_INITIAL_SIZE;
+  while (capacity < emitter->len + len) capacity *= 2;
+  emitter->buf = realloc(emitter->buf, capacity);
+  if (emitter->buf == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  emitter->capacity = capacity;
+}
+
+/**
+ * @brief 長さを指定して文字列を追記する
+ * 
+ * @param emitter 出力バッファ
+ * @param str 追記する文字列
+ * @param len 文字列の長さ
+ */
+void emitStr(Emitter * emitter, const char * str, size_t len)
+{
+  reserveEmitter(emitter, len);
+  memcpy(emitter->buf + emitter->len, str, len);
+  emitter->len += len;
+}
+
+/**
+ * @brief 終端文字で終わる文字列を追記する
+ * 
+ * @param emitter 出力バッファ
+ * @param str 追記する文字列
+ */
+void emitCStr(Emitter * emitter, const char * str) { emitStr(emitter, str, strlen(str)); }
+
+/**
+ * @brief 1文字を追記する
+ * 
+ * @param emitter 出力バッファ
+ * @param c 追記する文字
+ */
+void emitChar(Emitter * emitter, char c)
+{
+  reserveEmitter(emitter, 1);
+  emitter->buf[emitter->len++] = c;
+}
+
+/**
+ * @brief 整数を10進数で追記する
+ * 
+ * @param emitter 出力バッファ
+ * @param num 追記する整数
+ */
+void emitInt(Emitter * emitter, int num)
+{
+  char digits[16];
+  char * p = digits + sizeof(digits);
+  unsigned int n = num < 0 ? -(unsigned int)num : (unsigned int)num;
+  do {
+    *--p = '0' + n % 10;
+    n /= 10;
+  } while (n != 0);
+  if (num < 0) *--p = '-';
+  emitStr(emitter, p, digits + sizeof(digits) - p);
+}
+
+/**
+ * @brief ラベルの番号からL0001の形式のラベルを追記する
+ * 番号が4桁に満たない場合は0で埋める
+ * @param emitter 出力バッファ
+ * @param label ラベルの番号
+ */
+void emitLabelNum(Emitter * emitter, int label)
+{
+  if (label < 0 || label > 9999) {
+    emitChar(emitter, 'L');
+    emitInt(emitter, label);
+    return;
+  }
+  char str[5] = {'L', '0' + label / 1000, '0' + label / 100 % 10, '0' + label / 10 % 10,
+                 '0' + label % 10};
+  emitStr(emitter, str, sizeof(str));
+}
+
+/**
+ * @brief 出力バッファの現在の書き込み位置を返す
+ * 
+ * @param emitter 出力バッファ
+ * @return EmitterMark 書き込み位置
+ */
+EmitterMark markEmitter(const Emitter * emitter)
+{
+  EmitterMark mark = {emitter->len, emitter->instructions};
+  return mark;
+}
+
+/**
+ * @brief 出力バッファをmarkEmitterで記録した位置まで巻き戻す
+ * 記録した位置より後に書き込んだ内容は取り消される
+ * @param emitter 出力バッファ
+ * @param mark 巻き戻す位置
+ */
+void rewindEmitter(Emitter * emitter, EmitterMark mark)
+{
+  emitter->len = mark.len;
+  emitter->instructions = mark.instructions;
+}
+
+/**
+ * @brief 出力バッファの内容をファイルディスクリプタに書き出して空にする
+ * 書き出しは1回のwriteで行い、途中までしか書き込めなかった場合のみ残りを書き足す
+ * @param emitter 出力バッファ
+ * @param fd 書き出し先のファイルディスクリプタ
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+int flushEmitter(Emitter * emitter, int fd)
+{
+  size_t written = 0;
+  while (written < emitter->len) {
+    ssize_t n = write(fd, emitter->buf + written, emitter->len - written);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return error("Cannot write output: %s", strerror(errno));
+    }
+    written += n;
+  }
+  emitter->len = 0;
+  return NORMAL;
+}
+
+/**
+ * @brief 出力バッファを解放する
+ * 
+ * @param emitter 解放する出力バッファ
+ */
+void freeEmitter(Emitter * emitter)
+{
+  free(emitter->buf);
+  free(emitter);
+}
@@ -0,0 +1,53 @@
+#ifndef EMIT_H
+#define EMIT_H
+#include <stddef.h>
+
+/**
+ * @file
+ * 生成したCASL IIのプログラムをメモリ上の出力バッファに書き込むエミッタ
+ * 
+ * コード生成は命令を1行ずつ出力バッファに追記し、最後にflushEmitterで
+ * ファイルへまとめて1回のwriteで書き出す。
+ * 書き出さずにバッファの内容をそのまま参照することもできる。
+ */
+
+/**
+ * @def EMITTER_INITIAL_SIZE
+ * 出力バッファが最初に確保する大きさ
+ */
+#define EMITTER_INITIAL_SIZE (64 * 1024)
+
+//! 出力バッファの構造体
+typedef struct
+{
+  //! 出力した文字列。終端文字は付けない
+  char * buf;
+  //! 出力した文字列の長さ
+  size_t len;
+  //! bufに確保済みの大きさ
+  size_t capacity;
+  //! 出力した命令の数
+  long instructions;
+} Emitter;
+
+//! 出力バッファの書き込み位置。rewindEmitterでそれ以降に書き込んだ内容を取り消すために使う
+typedef struct
+{
+  //! 出力した文字列の長さ
+  size_t len;
+  //! 出力した命令の数
+  long instructions;
+} EmitterMark;
+
+Emitter * newEmitter(void);
+void emitStr(Emitter *, const char *, size_t);
+void emitCStr(Emitter *, const char *);
+void emitChar(Emitter *, char);
+void emitInt(Emitter *, int);
+void emitLabelNum(Emitter *, int);
+EmitterMark markEmitter(const Emitter *);
+void rewindEmitter(Emitter *, EmitterMark);
+int flushEmitter(Emitter *, int);
+void freeEmitter(Emitter *);
+
+#endif
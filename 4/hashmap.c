@@ -1,128 +1,130 @@
+#include <stdint.h>
+
 #include "lpp.h"
 
 /**
  * @brief 新しいハッシュマップを作成する
  * 
- * @param size ハッシュマップのサイズ
+ * @param capacity 最初に確保するエントリの数。2のべき乗に切り上げられる
  * @return HashMap* 作成されたハッシュマップへのポインタ
  */
-HashMap * newHashMap(int size)
+HashMap * newHashMap(int capacity)
 {
   HashMap * hashmap;
   if ((hashmap = malloc(sizeof(HashMap))) == NULL) {
     error("Memory allocation error\n");
     exit(1);
   }
-  hashmap->size = size;
+  hashmap->capacity = HASHMAP_MIN_CAPACITY;
+  while (hashmap->capacity < capacity) hashmap->capacity *= 2;
+  hashmap->count = 0;
 
-  hashmap->entries = malloc(sizeof(Entry *) * size);
+  hashmap->entries = calloc(hashmap->capacity, sizeof(Entry));
   if (hashmap->entries == NULL) {
     error("Memory allocation error\n");
     exit(1);
   }
-  for (int i = 0; i < size; i++) {
-    hashmap->entries[i] = NULL;
-  }
 
   return hashmap;
 }
 
 /**
  * @brief ハッシュ値を計算する
- * 
+ * キーはtokenStrでインターンされた文字列なので、文字列を走査せずにポインタからハッシュ値を求める
  * @param key ハッシュ値を計算する文字列
- * @param size ハッシュマップのサイズ
  * @return unsigned int 
  */
-static unsigned int hash(const char * key, const int size)
+static unsigned int hash(const char * key)
 {
-  unsigned int hash = 0;
-  for (int i = 0; key[i] != '\0'; i++) {
-    hash = 31 * hash + key[i];
-  }
-  return hash % size;
+  return (unsigned int)(((uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ULL) >> 32);
 }
 
 /**
- * @brief ハッシュマップにエントリを追加する
- * 
- * @param hashmap 挿入されるハッシュマップ
+ * @brief キーに対応するエントリの位置を探す
+ * キーが存在しない場合は、そのキーを挿入すべき空きの位置を返す
+ * @param hashmap 探索するハッシュマップ
  * @param key キー
- * @param value キーに対応するバリュー
+ * @param h キーのハッシュ値
+ * @return Entry* エントリの位置
  */
-void insertToHashMap(const HashMap * hashmap, const char * key, ID * value)
+static Entry * findEntry(const HashMap * hashmap, const char * key, unsigned int h)
 {
-  unsigned int index = hash(key, hashmap->size);
-
-  Entry * entry = hashmap->entries[index];
-  while (entry != NULL) {
-    if (strcmp(entry->key, key) == 0) {
-      entry->value = value;
-      return;
-    }
-    entry = entry->next;
+  unsigned int mask = hashmap->capacity - 1;
+  for (unsigned int i = h & mask;; i = (i + 1) & mask) {
+    Entry * entry = &hashmap->entries[i];
+    if (entry->key == NULL) return entry;
+    if (entry->hash == h && entry->key == key) return entry;
   }
+}
 
-  entry = (Entry *)malloc(sizeof(Entry));
-  if (entry == NULL) {
-    fprintf(stderr, "Failed to allocate memory for new entry\n");
+/**
+ * @brief ハッシュマップの容量を倍にして全てのエントリを挿入し直す
+ * 
+ * @param hashmap 拡張するハッシュマップ
+ */
+static void growHashMap(HashMap * hashmap)
+{
+  Entry * old_entries = hashmap->entries;
+  int old_capacity = hashmap->capacity;
+
+  hashmap->capacity *= 2;
+  hashmap->entries = calloc(hashmap->capacity, sizeof(Entry));
+  if (hashmap->entries == NULL) {
+    error("Memory allocation error\n");
     exit(1);
   }
-
-  entry->key = strdup(key);
-  entry->value = value;
-  entry->next = hashmap->entries[index];
-  hashmap->entries[index] = entry;
+  for (int i = 0; i < old_capacity; i++) {
+    if (old_entries[i].key == NULL) continue;
+    *findEntry(hashmap, old_entries[i].key, old_entries[i].hash) = old_entries[i];
+  }
+  free(old_entries);
 }
 
 /**
- * @brief ハッシュマップから指定されたキーを持つエントリを取得する
- * 
- * @param hashmap 取得したいエントリが含まれるハッシュマップ
- * @param key 検索するキー
- * @return ID* 取得したエントリーの要素
+ * @brief ハッシュマップにエントリを追加する
+ * 負荷率がHASHMAP_MAX_LOAD_PERCENTを超える場合は容量を倍にする
+ * @param hashmap 挿入されるハッシュマップ
+ * @param key キー。tokenStrでインターンされた文字列で、複製せずにそのまま保持する
+ * @param value キーに対応するバリュー
  */
-ID * getValueFromHashMap(const HashMap * hashmap, const char * key)
+void insertToHashMap(HashMap * hashmap, const char * key, ID * value)
 {
-  unsigned int index = hash(key, hashmap->size);
-
-  Entry * entry = hashmap->entries[index];
-  while (entry != NULL) {
-    if (strcmp(entry->key, key) == 0) {
-      return entry->value;
-    }
-    entry = entry->next;
+  unsigned int h = hash(key);
+  Entry * entry = findEntry(hashmap, key, h);
+  if (entry->key != NULL) {
+    entry->value = value;
+    return;
   }
 
-  return NULL;
+  if ((hashmap->count + 1) * 100 > hashmap->capacity * HASHMAP_MAX_LOAD_PERCENT) {
+    growHashMap(hashmap);
+    entry = findEntry(hashmap, key, h);
+  }
+  entry->key = key;
+  entry->hash = h;
+  entry->value = value;
+  hashmap->count++;
 }
 
 /**
- * @brief エントリーを解放する
+ * @brief ハッシュマップから指定されたキーを持つエントリを取得する
  * 
- * @param entry 開放するエントリ
+ * @param hashmap 取得したいエントリが含まれるハッシュマップ
+ * @param key 検索するキー。tokenStrでインターンされた文字列
+ * @return ID* 取得したエントリーの要素
  */
-static void freeEntry(Entry * entry)
+ID * getValueFromHashMap(const HashMap * hashmap, const char * key)
 {
-  while (entry != NULL) {
-    Entry * next = entry->next;
-    free(entry->key);
-    free(entry->value);
-    free(entry);
-    entry = next;
-  }
+  return findEntry(hashmap, key, hash(key))->value;
 }
 
 /**
  * @brief ハッシュマップを解放する
- * 
+ * キーは字句解析が、バリューは構文解析のアリーナが所有しているので解放しない
  * @param hashmap 開放するハッシュマップ
  */
 void freeHashMap(HashMap * hashmap)
 {
-  for (int i = 0; i < hashmap->size; i++) {
-    freeEntry(hashmap->entries[i]);
-  }
   free(hashmap->entries);
   free(hashmap);
-}
\ No newline at end of file
+}
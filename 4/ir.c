@@ -0,0 +1,859 @@
+#include "ir.h"
+
+/**
+ * @file
+ * トークン列から中間表現を組み立てる処理と、中間表現を表示する処理を実装している
+ *
+ * 構文解析が成功したトークン列を前提とし、型の検査はしない。
+ * 式は左から順に評価し、途中結果を一時変数に格納する。定数同士の演算は組み立てる時点で計算する。
+ * if文とwhile文の条件式は真偽値を求めずに比較の結果で直接分岐し、and, orは短絡評価する。
+ */
+
+//! 組み立て中のトークン列
+static TokenArray * tokens;
+
+//! 読んでいるトークンの位置
+static int cur;
+
+//! 組み立て中の副プログラムの名前。主プログラムの場合はNULL
+static char * procname;
+
+//! 組み立て中の関数
+static IrFunction * function;
+
+//! 命令を追加している基本ブロックの番号
+static int current;
+
+//! 命令を追加している基本ブロックが終端命令で閉じられていないかどうか
+static bool current_open;
+
+//! 基本ブロックの番号を、命令を追加し始めた順に並べた配列。配置する順序になる
+static int * block_order;
+
+//! block_orderに並べた基本ブロックの数
+static int num_ordered;
+
+//! 組み立て中の文の先頭のトークンの位置
+static int statement_tok;
+
+//! 組み立ての結果。定数式の評価でエラーを検出した場合はERRORになる
+static int build_status;
+
+//! 値がないことを表す値。式の組み立てに失敗したことも表す
+static const IrValue ir_none = {IR_NONE, TPRERROR, 0, NULL, NULL};
+
+//! 命令の種類の名前
+static const char * const opcode_names[] = {
+    "move", "neg",   "not",         "cast",      "add",        "sub",  "mul",  "div",
+    "and",  "or",    "eq",          "ne",        "lt",         "le",   "gt",   "ge",
+    "check_index",   "load_elem",   "store_elem", "arg",       "call", "read", "readln",
+    "write",         "writeln",     "jump",      "branch",     "return"};
+
+static IrValue buildExpression();
+static int buildStatement(int exit_block);
+
+//! 値が式の組み立てに失敗したことを表すかどうかを判定する関数
+static bool isIrError(IrValue value) { return value.type == TPRERROR; }
+
+//! 定数を表す値を返す関数
+static IrValue constValue(TYPE_KIND type, int num)
+{
+  IrValue value = {IR_CONST, type, num, NULL, NULL};
+  return value;
+}
+
+//! 配列の要素の型を返す関数
+static TYPE_KIND elementType(const Symbol * symbol)
+{
+  switch (symbol->type->etp->ttype) {
+    case TPARRAYCHAR:
+      return TPCHAR;
+    case TPARRAYBOOL:
+      return TPBOOL;
+    default:
+      return TPINT;
+  }
+}
+
+//! 変数を表す値を返す関数。配列の型は要素の型の側に格納されている
+static IrValue varValue(const Symbol * symbol)
+{
+  TYPE_KIND type = symbol->arraysize > 0 ? symbol->type->etp->ttype : symbol->type->ttype;
+  IrValue value = {IR_VAR, type, 0, symbol, NULL};
+  return value;
+}
+
+//! 新しい一時変数を返す関数
+static IrValue newTemp(TYPE_KIND type)
+{
+  IrValue value = {IR_TEMP, type, function->num_temps++, NULL, NULL};
+  return value;
+}
+
+//! トークンを一つ進める関数
+static void consumeToken()
+{
+  if (cur < tokens->size - 1) cur++;
+}
+
+/**
+ * @brief 現在のトークンが期待したものであれば読み進める関数
+ *
+ * @param id 期待するトークン
+ * @return true 期待したトークンだった場合
+ * @return false そうでない場合。エラーを報告する
+ */
+static bool expectToken(TokenID id)
+{
+  if (tokens->id[cur] == id) {
+    consumeToken();
+    return true;
+  }
+  build_status = ERROR;
+  error("Error at %d: Unexpected token %s", tokens->line_no[cur], tokenStr(tokens, cur));
+  return false;
+}
+
+//! 新しい基本ブロックを作って番号を返す関数。命令は後からstartBlockで追加し始める
+static int newBlock()
+{
+  function->blocks = realloc(function->blocks, sizeof(IrBlock) * (function->num_blocks + 1));
+  block_order = realloc(block_order, sizeof(int) * (function->num_blocks + 1));
+  if (function->blocks == NULL || block_order == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  IrBlock * block = &function->blocks[function->num_blocks];
+  block->instrs = NULL;
+  block->size = 0;
+  block->capacity = 0;
+  // 命令を追加し始めなかった基本ブロックは、到達しない場合に備えて戻り命令で閉じておく
+  block->term.op = IR_RETURN;
+  return function->num_blocks++;
+}
+
+//! 命令を追加している基本ブロックを終端命令で閉じる関数。既に閉じている場合は何もしない
+static void terminateBlock(IrInstr term)
+{
+  if (!current_open) return;
+  term.tok = statement_tok;
+  function->blocks[current].term = term;
+  current_open = false;
+}
+
+//! 基本ブロックtargetに分岐して、命令を追加している基本ブロックを閉じる関数
+static void jumpTo(int target)
+{
+  IrInstr term = {IR_JUMP, IR_JUMP, ir_none, ir_none, ir_none, target, target, 0};
+  terminateBlock(term);
+}
+
+//! 基本ブロックに命令を追加し始める関数。命令を追加している基本ブロックが閉じていなければ、そこから分岐する
+static void startBlock(int block)
+{
+  jumpTo(block);
+  current = block;
+  current_open = true;
+  block_order[num_ordered++] = block;
+}
+
+//! 命令を追加している基本ブロックに命令を追加する関数
+static void appendInstr(IrOpcode op, IrValue dst, IrValue a, IrValue b)
+{
+  IrBlock * block = &function->blocks[current];
+  if (block->size == block->capacity) {
+    block->capacity = block->capacity ? block->capacity * 2 : 8;
+    block->instrs = realloc(block->instrs, sizeof(IrInstr) * block->capacity);
+    if (block->instrs == NULL) {
+      error("Memory allocation error");
+      exit(1);
+    }
+  }
+  IrInstr instr = {op, op, dst, a, b, -1, -1, statement_tok};
+  block->instrs[block->size++] = instr;
+}
+
+//! 演算子のトークンに対応する命令の種類を返す関数
+static IrOpcode binaryOpcode(TokenID id)
+{
+  switch (id) {
+    case TPLUS:
+      return IR_ADD;
+    case TMINUS:
+      return IR_SUB;
+    case TSTAR:
+      return IR_MUL;
+    case TDIV:
+      return IR_DIV;
+    case TAND:
+      return IR_AND;
+    case TOR:
+      return IR_OR;
+    case TEQUAL:
+      return IR_EQ;
+    case TNOTEQ:
+      return IR_NE;
+    case TLE:
+      return IR_LT;
+    case TLEEQ:
+      return IR_LE;
+    case TGR:
+      return IR_GT;
+    default:
+      return IR_GE;
+  }
+}
+
+/**
+ * @brief 定数同士の二項演算を計算する関数
+ * 桁あふれや0除算の場合は実行時エラーと同じ内容のエラーを報告し、結果を0とする
+ * @param op 命令の種類
+ * @param a 左オペランドの値
+ * @param b 右オペランドの値
+ * @return int 計算結果
+ */
+static int foldConstants(IrOpcode op, int a, int b)
+{
+  static const TokenID operators[] = {
+    TPLUS, TMINUS, TSTAR, TDIV, TAND, TOR, TEQUAL, TNOTEQ, TLE, TLEEQ, TGR, TGREQ};
+  int result;
+  const char * message = foldWord(operators[op - IR_ADD], a, b, &result);
+  if (message != NULL) {
+    build_status = ERROR;
+    error("Error at %d: %s", tokens->line_no[cur], message);
+  }
+  return result;
+}
+
+//! 二項演算の命令を追加して結果の一時変数を返す関数。両方のオペランドが定数の場合は計算した結果を返す
+static IrValue buildBinary(IrOpcode op, TYPE_KIND type, IrValue a, IrValue b)
+{
+  if (a.kind == IR_CONST && b.kind == IR_CONST) return constValue(type, foldConstants(op, a.num, b.num));
+  IrValue dst = newTemp(type);
+  appendInstr(op, dst, a, b);
+  return dst;
+}
+
+/**
+ * @brief 変数を読み、配列の要素の場合は添字を求めて範囲を検査する命令を追加する関数
+ *
+ * @param base 変数を格納する
+ * @param index 配列の要素の場合は添字を格納する。配列でない場合はir_noneを格納する
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+static int buildVariable(IrValue * base, IrValue * index)
+{
+  const Symbol * symbol = resolveVar(tokens, cur, procname);
+  if (symbol == NULL) {
+    build_status = ERROR;
+    return error("Error at %d: Undefined variable %s", tokens->line_no[cur], tokenStr(tokens, cur));
+  }
+  consumeToken();
+  *base = varValue(symbol);
+  *index = ir_none;
+  if (tokens->id[cur] != TLSQPAREN) return NORMAL;
+
+  consumeToken();
+  if (isIrError(*index = buildExpression())) return ERROR;
+  if (!expectToken(TRSQPAREN)) return ERROR;
+  // 添字は検査と要素の参照の両方で使うので、変数の場合は一時変数に読み込んでおく
+  if (index->kind == IR_VAR) {
+    IrValue temp = newTemp(index->type);
+    appendInstr(IR_MOVE, temp, *index, ir_none);
+    *index = temp;
+  }
+  appendInstr(IR_CHECK_INDEX, ir_none, *base, *index);
+  return NORMAL;
+}
+
+//! 標準型への型変換から中間表現を組み立てる関数
+static IrValue buildCast(TYPE_KIND type)
+{
+  consumeToken();
+  if (!expectToken(TLPAREN)) return ir_none;
+  IrValue value = buildExpression();
+  if (isIrError(value) || !expectToken(TRPAREN)) return ir_none;
+  if (value.type == type) return value;
+
+  if (value.kind == IR_CONST) {
+    if (type == TPBOOL) return constValue(type, value.num != 0);
+    if (type == TPCHAR && value.type == TPINT) return constValue(type, value.num & 0x7F);
+    return constValue(type, value.num);
+  }
+  IrValue dst = newTemp(type);
+  appendInstr(IR_CAST, dst, value, ir_none);
+  return dst;
+}
+
+//! 因子から中間表現を組み立てる関数
+static IrValue buildFactor()
+{
+  IrValue value, base, index;
+  switch (tokens->id[cur]) {
+    case TNAME:
+      if (buildVariable(&base, &index) == ERROR) return ir_none;
+      if (index.kind == IR_NONE) return base;
+      value = newTemp(elementType(base.symbol));
+      appendInstr(IR_LOAD_ELEM, value, base, index);
+      return value;
+    case TNUMBER:
+      value = constValue(TPINT, tokens->num[cur]);
+      consumeToken();
+      return value;
+    case TTRUE:
+    case TFALSE:
+      value = constValue(TPBOOL, tokens->id[cur] == TTRUE);
+      consumeToken();
+      return value;
+    case TSTRING:
+      value = constValue(TPCHAR, (int)*tokens->loc[cur]);
+      consumeToken();
+      return value;
+    case TLPAREN:
+      consumeToken();
+      value = buildExpression();
+      if (isIrError(value) || !expectToken(TRPAREN)) return ir_none;
+      return value;
+    case TNOT:
+      consumeToken();
+      if (isIrError(value = buildFactor())) return ir_none;
+      if (value.kind == IR_CONST) return constValue(TPBOOL, value.num ^ 1);
+      base = value;
+      value = newTemp(TPBOOL);
+      appendInstr(IR_NOT, value, base, ir_none);
+      return value;
+    case TINTEGER:
+      return buildCast(TPINT);
+    case TBOOLEAN:
+      return buildCast(TPBOOL);
+    case TCHAR:
+      return buildCast(TPCHAR);
+    default:
+      build_status = ERROR;
+      error("Error at %d: Expected factor", tokens->line_no[cur]);
+      return ir_none;
+  }
+}
+
+//! 項から中間表現を組み立てる関数
+static IrValue buildTerm()
+{
+  IrValue value = buildFactor();
+  while (!isIrError(value) && isMulOp(tokens->id[cur])) {
+    TokenID opr = tokens->id[cur];
+    consumeToken();
+    IrValue rhs = buildFactor();
+    if (isIrError(rhs)) return ir_none;
+    value = buildBinary(binaryOpcode(opr), opr == TAND ? TPBOOL : TPINT, value, rhs);
+  }
+  return value;
+}
+
+//! 単純式から中間表現を組み立てる関数
+static IrValue buildSimpleExpression()
+{
+  IrValue value;
+  if (tokens->id[cur] == TMINUS) {
+    consumeToken();
+    IrValue term = buildTerm();
+    if (isIrError(term)) return ir_none;
+    if (term.kind == IR_CONST) {
+      value = constValue(TPINT, foldConstants(IR_SUB, 0, term.num));
+    } else {
+      value = newTemp(TPINT);
+      appendInstr(IR_NEG, value, term, ir_none);
+    }
+  } else {
+    if (tokens->id[cur] == TPLUS) consumeToken();
+    value = buildTerm();
+  }
+
+  while (!isIrError(value) && isAddOp(tokens->id[cur])) {
+    TokenID opr = tokens->id[cur];
+    consumeToken();
+    IrValue rhs = buildTerm();
+    if (isIrError(rhs)) return ir_none;
+    value = buildBinary(binaryOpcode(opr), opr == TOR ? TPBOOL : TPINT, value, rhs);
+  }
+  return value;
+}
+
+//! 式から中間表現を組み立てる関数
+static IrValue buildExpression()
+{
+  IrValue value = buildSimpleExpression();
+  while (!isIrError(value) && isRelOp(tokens->id[cur])) {
+    TokenID opr = tokens->id[cur];
+    consumeToken();
+    IrValue rhs = buildSimpleExpression();
+    if (isIrError(rhs)) return ir_none;
+    value = buildBinary(binaryOpcode(opr), TPBOOL, value, rhs);
+  }
+  return value;
+}
+
+/**
+ * @brief 比較の結果で分岐する終端命令を追加する関数
+ * 両方のオペランドが定数の場合は、分岐先が決まるので無条件分岐にする
+ * @param cond 比較の種類
+ * @param a 左オペランド
+ * @param b 右オペランド
+ * @param true_block 比較が成り立つ場合の分岐先
+ * @param false_block 比較が成り立たない場合の分岐先
+ */
+static void branchOn(IrOpcode cond, IrValue a, IrValue b, int true_block, int false_block)
+{
+  if (a.kind == IR_CONST && b.kind == IR_CONST) {
+    jumpTo(foldConstants(cond, a.num, b.num) ? true_block : false_block);
+    return;
+  }
+  IrInstr term = {IR_BRANCH, cond, ir_none, a, b, true_block, false_block, 0};
+  terminateBlock(term);
+}
+
+/**
+ * @brief 条件式の範囲 [cur, end) から、値が真ならtrue_blockに、偽ならfalse_blockに分岐する中間表現を組み立てる関数
+ * 関係演算子を一つだけ含む条件式は比較の結果で分岐し、and, orは短絡評価する
+ * @param end 条件式の直後のトークンの位置
+ * @param buildOperand 範囲を通常の式として組み立てる場合に使う関数。範囲の構文に合わせて因子、項、式のいずれかを渡す
+ * @param true_block 条件式が真の場合の分岐先
+ * @param false_block 条件式が偽の場合の分岐先
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+static int buildCondition(int end, IrValue (*buildOperand)(), int true_block, int false_block)
+{
+  ConditionShape shape = scanCondition(tokens, cur, end);
+
+  if (shape.relops == 1) {
+    IrValue lhs = buildSimpleExpression();
+    if (isIrError(lhs)) return ERROR;
+    IrOpcode cond = binaryOpcode(tokens->id[cur]);
+    consumeToken();
+    IrValue rhs = buildSimpleExpression();
+    if (isIrError(rhs)) return ERROR;
+    branchOn(cond, lhs, rhs, true_block, false_block);
+    return NORMAL;
+  }
+
+  // or: 真の項があればその時点でtrue_blockに分岐する
+  if (shape.relops == 0 && shape.ors > 0 && shape.other_addops == 0) {
+    int next;
+    while ((next = findTopLevel(tokens, cur, end, TOR)) != end) {
+      int rest = newBlock();
+      if (buildCondition(next, buildTerm, true_block, rest) == ERROR) return ERROR;
+      consumeToken();
+      startBlock(rest);
+    }
+    return buildCondition(end, buildTerm, true_block, false_block);
+  }
+
+  // and: 偽の因子があればその時点でfalse_blockに分岐する
+  if (shape.relops == 0 && shape.ors == 0 && shape.other_addops == 0 && shape.ands > 0 &&
+      shape.other_mulops == 0) {
+    int next;
+    while ((next = findTopLevel(tokens, cur, end, TAND)) != end) {
+      int rest = newBlock();
+      if (buildCondition(next, buildFactor, rest, false_block) == ERROR) return ERROR;
+      consumeToken();
+      startBlock(rest);
+    }
+    return buildCondition(end, buildFactor, true_block, false_block);
+  }
+
+  bool single_factor = shape.relops == 0 && shape.ors == 0 && shape.other_addops == 0 &&
+                       shape.ands == 0 && shape.other_mulops == 0;
+  if (single_factor && tokens->id[cur] == TNOT) {
+    consumeToken();
+    return buildCondition(end, buildFactor, false_block, true_block);
+  }
+  if (single_factor && tokens->id[cur] == TLPAREN && tokens->id[end - 1] == TRPAREN) {
+    consumeToken();
+    if (buildCondition(end - 1, buildExpression, true_block, false_block) == ERROR) return ERROR;
+    return expectToken(TRPAREN) ? NORMAL : ERROR;
+  }
+
+  // それ以外の条件式は真偽値を求めてから0と比較する
+  IrValue value = buildOperand();
+  if (isIrError(value)) return ERROR;
+  branchOn(IR_NE, value, constValue(TPBOOL, 0), true_block, false_block);
+  return NORMAL;
+}
+
+//! 代入文から中間表現を組み立てる関数
+static int buildAssignment()
+{
+  IrValue target, index;
+  if (buildVariable(&target, &index) == ERROR) return ERROR;
+  if (!expectToken(TASSIGN)) return ERROR;
+  IrValue value = buildExpression();
+  if (isIrError(value)) return ERROR;
+
+  if (index.kind != IR_NONE) {
+    appendInstr(IR_STORE_ELEM, target, index, value);
+    return NORMAL;
+  }
+  // 直前の命令が求めた一時変数を代入するだけの場合は、その命令が変数に直接格納する
+  IrBlock * block = &function->blocks[current];
+  IrInstr * last = block->size > 0 ? &block->instrs[block->size - 1] : NULL;
+  if (value.kind == IR_TEMP && last != NULL && last->dst.kind == IR_TEMP && last->dst.num == value.num) {
+    last->dst = target;
+    return NORMAL;
+  }
+  appendInstr(IR_MOVE, target, value, ir_none);
+  return NORMAL;
+}
+
+//! 条件分岐文から中間表現を組み立てる関数
+static int buildIfStatement(int exit_block)
+{
+  consumeToken();
+  int then_block = newBlock();
+  int else_block = newBlock();
+  int end = findTopLevel(tokens, cur, tokens->size - 1, TTHEN);
+  if (buildCondition(end, buildExpression, then_block, else_block) == ERROR) return ERROR;
+  if (!expectToken(TTHEN)) return ERROR;
+  startBlock(then_block);
+  if (buildStatement(exit_block) == ERROR) return ERROR;
+  if (tokens->id[cur] != TELSE) {
+    startBlock(else_block);
+    return NORMAL;
+  }
+
+  consumeToken();
+  int join_block = newBlock();
+  jumpTo(join_block);
+  startBlock(else_block);
+  if (buildStatement(exit_block) == ERROR) return ERROR;
+  startBlock(join_block);
+  return NORMAL;
+}
+
+//! 繰り返し文から中間表現を組み立てる関数
+static int buildWhileStatement()
+{
+  consumeToken();
+  int head_block = newBlock();
+  int body_block = newBlock();
+  int exit_block = newBlock();
+  startBlock(head_block);
+  int end = findTopLevel(tokens, cur, tokens->size - 1, TDO);
+  if (buildCondition(end, buildExpression, body_block, exit_block) == ERROR) return ERROR;
+  if (!expectToken(TDO)) return ERROR;
+  startBlock(body_block);
+  if (buildStatement(exit_block) == ERROR) return ERROR;
+  jumpTo(head_block);
+  startBlock(exit_block);
+  return NORMAL;
+}
+
+//! 手続き呼び出し文から中間表現を組み立てる関数
+static int buildCall()
+{
+  consumeToken();
+  const Symbol * procedure = findSymbol(tokenStr(tokens, cur), NULL);
+  if (procedure == NULL) {
+    build_status = ERROR;
+    return error("Error at %d: Undefined procedure %s", tokens->line_no[cur], tokenStr(tokens, cur));
+  }
+  consumeToken();
+  if (tokens->id[cur] == TLPAREN) {
+    do {
+      consumeToken();
+      IrValue value, index = ir_none;
+      // 変数だけからなる実引数はアドレスを渡す
+      if (isVariableArgument(tokens, cur, argumentEnd(tokens, cur))) {
+        if (buildVariable(&value, &index) == ERROR) return ERROR;
+      } else if (isIrError(value = buildExpression())) {
+        return ERROR;
+      }
+      appendInstr(IR_ARG, ir_none, value, index);
+    } while (tokens->id[cur] == TCOMMA);
+    if (!expectToken(TRPAREN)) return ERROR;
+  }
+  appendInstr(IR_CALL, ir_none, varValue(procedure), ir_none);
+  return NORMAL;
+}
+
+//! 入力文から中間表現を組み立てる関数
+static int buildInput()
+{
+  bool is_readln = tokens->id[cur] == TREADLN;
+  consumeToken();
+  if (tokens->id[cur] == TLPAREN) {
+    do {
+      consumeToken();
+      IrValue base, index;
+      if (buildVariable(&base, &index) == ERROR) return ERROR;
+      appendInstr(IR_READ, ir_none, base, index);
+    } while (tokens->id[cur] == TCOMMA);
+    if (!expectToken(TRPAREN)) return ERROR;
+  }
+  if (is_readln) appendInstr(IR_READLN, ir_none, ir_none, ir_none);
+  return NORMAL;
+}
+
+//! 出力文から中間表現を組み立てる関数
+static int buildOutput()
+{
+  bool is_writeln = tokens->id[cur] == TWRITELN;
+  consumeToken();
+  if (tokens->id[cur] == TLPAREN) {
+    do {
+      consumeToken();
+      IrValue value;
+      if (tokens->id[cur] == TSTRING && tokens->len[cur] != 1) {
+        IrValue str = {IR_STRING, TPCHAR, tokens->loc_len[cur], NULL, tokens->loc[cur]};
+        value = str;
+        consumeToken();
+      } else if (isIrError(value = buildExpression())) {
+        return ERROR;
+      }
+      int width = 0;
+      if (tokens->id[cur] == TCOLON) {
+        consumeToken();
+        width = tokens->num[cur];
+        consumeToken();
+      }
+      appendInstr(IR_WRITE, ir_none, value, constValue(TPINT, width));
+    } while (tokens->id[cur] == TCOMMA);
+    if (!expectToken(TRPAREN)) return ERROR;
+  }
+  if (is_writeln) appendInstr(IR_WRITELN, ir_none, ir_none, ir_none);
+  return NORMAL;
+}
+
+//! 複合文から中間表現を組み立てる関数
+static int buildCompoundStatement(int exit_block)
+{
+  if (!expectToken(TBEGIN)) return ERROR;
+  if (buildStatement(exit_block) == ERROR) return ERROR;
+  while (tokens->id[cur] == TSEMI) {
+    consumeToken();
+    if (buildStatement(exit_block) == ERROR) return ERROR;
+  }
+  return expectToken(TEND) ? NORMAL : ERROR;
+}
+
+/**
+ * @brief 文から中間表現を組み立てる関数
+ *
+ * @param exit_block 文を囲む最も内側の繰り返し文の直後の基本ブロック。繰り返し文の外では-1
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+static int buildStatement(int exit_block)
+{
+  statement_tok = cur;
+  switch (tokens->id[cur]) {
+    case TNAME:
+      return buildAssignment();
+    case TIF:
+      return buildIfStatement(exit_block);
+    case TWHILE:
+      return buildWhileStatement();
+    case TBREAK:
+      consumeToken();
+      if (exit_block >= 0) {
+        jumpTo(exit_block);
+        // 後に続く文は到達しない基本ブロックに置く
+        startBlock(newBlock());
+      }
+      return NORMAL;
+    case TCALL:
+      return buildCall();
+    case TRETURN: {
+      consumeToken();
+      IrInstr term = {IR_RETURN, IR_RETURN, ir_none, ir_none, ir_none, -1, -1, 0};
+      terminateBlock(term);
+      startBlock(newBlock());
+      return NORMAL;
+    }
+    case TREAD:
+    case TREADLN:
+      return buildInput();
+    case TWRITE:
+    case TWRITELN:
+      return buildOutput();
+    case TBEGIN:
+      return buildCompoundStatement(exit_block);
+    default:
+      // 空文
+      return NORMAL;
+  }
+}
+
+//! 基本ブロックを命令を追加し始めた順に並べ替え、分岐先の番号を付け替える関数
+static void orderBlocks()
+{
+  int num_blocks = function->num_blocks;
+  int * renumber = malloc(sizeof(int) * num_blocks);
+  IrBlock * blocks = malloc(sizeof(IrBlock) * num_blocks);
+  if (renumber == NULL || blocks == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  for (int i = 0; i < num_blocks; i++) renumber[i] = -1;
+  for (int i = 0; i < num_ordered; i++) renumber[block_order[i]] = i;
+  // 命令を追加し始めなかった基本ブロックは最後に置く
+  int next = num_ordered;
+  for (int i = 0; i < num_blocks; i++) {
+    if (renumber[i] < 0) renumber[i] = next++;
+  }
+  for (int i = 0; i < num_blocks; i++) {
+    IrBlock block = function->blocks[i];
+    if (block.term.op == IR_JUMP || block.term.op == IR_BRANCH) {
+      block.term.target = renumber[block.term.target];
+      block.term.other = renumber[block.term.other];
+    }
+    blocks[renumber[i]] = block;
+  }
+  free(function->blocks);
+  function->blocks = blocks;
+  free(renumber);
+}
+
+/**
+ * @brief 副プログラムもしくは主プログラムの複合文から中間表現を組み立てる関数
+ *
+ * @param tok トークン列
+ * @param pos 複合文の先頭のトークンの位置。組み立てた後は複合文の直後の位置に更新する
+ * @param proc 副プログラムの名前。主プログラムの場合はNULL
+ * @return IrFunction* 組み立てた中間表現。エラーの場合はNULL
+ */
+IrFunction * buildIrFunction(TokenArray * tok, int * pos, char * proc)
+{
+  tokens = tok;
+  cur = *pos;
+  procname = proc;
+  build_status = NORMAL;
+  statement_tok = cur;
+  num_ordered = 0;
+  block_order = NULL;
+  if ((function = calloc(1, sizeof(IrFunction))) == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  function->name = proc;
+  function->tokens = tok;
+
+  current_open = false;
+  startBlock(newBlock());
+  int status = buildCompoundStatement(-1);
+  IrInstr term = {IR_RETURN, IR_RETURN, ir_none, ir_none, ir_none, -1, -1, 0};
+  terminateBlock(term);
+  orderBlocks();
+  free(block_order);
+  *pos = cur;
+
+  if (status == ERROR || build_status == ERROR) {
+    freeIrFunction(function);
+    return NULL;
+  }
+  return function;
+}
+
+//! 中間表現を解放する関数
+void freeIrFunction(IrFunction * ir)
+{
+  for (int i = 0; i < ir->num_blocks; i++) free(ir->blocks[i].instrs);
+  free(ir->blocks);
+  free(ir);
+}
+
+//! 型の名前を返す関数
+static const char * typeName(TYPE_KIND type)
+{
+  switch (type) {
+    case TPINT:
+      return "integer";
+    case TPCHAR:
+      return "char";
+    case TPBOOL:
+      return "boolean";
+    case TPARRAYINT:
+      return "integer[]";
+    case TPARRAYCHAR:
+      return "char[]";
+    case TPARRAYBOOL:
+      return "boolean[]";
+    case TPPROC:
+      return "procedure";
+    default:
+      return "error";
+  }
+}
+
+//! 値を型とともに表示する関数
+static void printIrValue(FILE * fp, IrValue value)
+{
+  switch (value.kind) {
+    case IR_CONST:
+      if (value.type == TPBOOL) {
+        fputs(value.num ? "true" : "false", fp);
+      } else if (value.type == TPCHAR && isprint(value.num) && value.num != '\'') {
+        fprintf(fp, "'%c'", value.num);
+      } else {
+        fprintf(fp, "%d", value.num);
+      }
+      break;
+    case IR_TEMP:
+      fprintf(fp, "t%d", value.num);
+      break;
+    case IR_VAR:
+      fputs(value.symbol->name, fp);
+      if (value.symbol->procname != NULL) fprintf(fp, "@%s", value.symbol->procname);
+      break;
+    case IR_STRING:
+      fprintf(fp, "'%.*s'", value.num, value.str);
+      return;
+    default:
+      return;
+  }
+  fprintf(fp, ":%s", typeName(value.type));
+}
+
+/**
+ * @brief 中間表現を人が読める形式で表示する関数
+ *
+ * @param fp 出力先
+ * @param ir 表示する中間表現
+ */
+void printIrFunction(FILE * fp, const IrFunction * ir)
+{
+  if (ir->name != NULL) {
+    fprintf(fp, "procedure %s\n", ir->name);
+  } else {
+    fputs("program\n", fp);
+  }
+  int line = 0;
+  for (int i = 0; i < ir->num_blocks; i++) {
+    const IrBlock * block = &ir->blocks[i];
+    fprintf(fp, "B%d:\n", i);
+    for (int j = 0; j <= block->size; j++) {
+      const IrInstr * instr = j < block->size ? &block->instrs[j] : &block->term;
+      // 文が変わるところにソースの行番号を表示する
+      if (ir->tokens->line_no[instr->tok] != line) {
+        line = ir->tokens->line_no[instr->tok];
+        fprintf(fp, "\t; line %d\n", line);
+      }
+      fputc('\t', fp);
+      if (instr->dst.kind != IR_NONE && instr->op != IR_STORE_ELEM) {
+        printIrValue(fp, instr->dst);
+        fputs(" = ", fp);
+      }
+      fputs(opcode_names[instr->op], fp);
+      if (instr->op == IR_BRANCH) fprintf(fp, " %s", opcode_names[instr->cond]);
+      IrValue operands[3] = {ir_none, instr->a, instr->b};
+      if (instr->op == IR_STORE_ELEM) operands[0] = instr->dst;
+      const char * separator = " ";
+      for (int k = 0; k < 3; k++) {
+        if (operands[k].kind == IR_NONE) continue;
+        fputs(separator, fp);
+        printIrValue(fp, operands[k]);
+        separator = ", ";
+      }
+      if (instr->op == IR_JUMP) fprintf(fp, " B%d", instr->target);
+      if (instr->op == IR_BRANCH) fprintf(fp, " ? B%d : B%d", instr->target, instr->other);
+      fputc('\n', fp);
+    }
+  }
+}
@@ -0,0 +1,163 @@
+#ifndef IR_H
+#define IR_H
+#include <stdio.h>
+
+#include "lpp.h"
+
+/**
+ * @file
+ * コード生成に用いる型付きの三番地コードの中間表現
+ *
+ * 副プログラムと主プログラムの複合文をそれぞれ一つの関数として、トークン列から基本ブロックの並びを組み立てる。
+ * 値は定数、一時変数、変数のいずれかで、どの値も型を持つ。変数は記号表の要素を直接指す。
+ * 基本ブロックは命令の並びと、最後に置く一つの終端命令からなる。
+ *
+ * 中間表現を経由するコード生成は--irを指定した場合だけ使う実験的な経路で、既定の経路はトークン列から直接命令を生成する。
+ * 覗き穴最適化、到達しない副プログラムの除去、実行時ライブラリの選択、実引数のレジスタ渡しはどちらの経路にも効くが、
+ * 添字の値の範囲から範囲検査を省く解析(--bounds-check=auto)は既定の経路だけが行い、この経路では定数の添字の検査だけを省く。
+ * トークン列と記号表を調べる関数と定数式の計算はanalysis.cにあり、二つの経路で共有する。
+ */
+
+//! 中間表現の値の種類
+typedef enum {
+  //! 値がないことを表す
+  IR_NONE,
+  //! 定数
+  IR_CONST,
+  //! 一時変数。関数の中で番号を振る
+  IR_TEMP,
+  //! 記号表に登録された変数
+  IR_VAR,
+  //! 出力文に現れる長さが1でない文字列
+  IR_STRING,
+} IrValueKind;
+
+//! 中間表現の値
+typedef struct
+{
+  //! 値の種類
+  IrValueKind kind;
+  //! 型。配列の変数の場合は配列型
+  TYPE_KIND type;
+  //! 定数の値、一時変数の番号、文字列の長さのいずれか
+  int num;
+  //! 変数の場合は記号表の要素
+  const Symbol * symbol;
+  //! 文字列の場合はソース中の文字列の先頭。両端の'を含まない
+  const char * str;
+} IrValue;
+
+//! 中間表現の命令の種類
+typedef enum {
+  //! dst := a
+  IR_MOVE,
+  //! dst := -a
+  IR_NEG,
+  //! dst := not a
+  IR_NOT,
+  //! dst := dstの型(a)
+  IR_CAST,
+  //! dst := a + b
+  IR_ADD,
+  //! dst := a - b
+  IR_SUB,
+  //! dst := a * b
+  IR_MUL,
+  //! dst := a div b
+  IR_DIV,
+  //! dst := a and b
+  IR_AND,
+  //! dst := a or b
+  IR_OR,
+  //! dst := a = b
+  IR_EQ,
+  //! dst := a <> b
+  IR_NE,
+  //! dst := a < b
+  IR_LT,
+  //! dst := a <= b
+  IR_LE,
+  //! dst := a > b
+  IR_GT,
+  //! dst := a >= b
+  IR_GE,
+  //! 配列aの添字bが範囲内にあることを検査する
+  IR_CHECK_INDEX,
+  //! dst := a[b]
+  IR_LOAD_ELEM,
+  //! dst[a] := b
+  IR_STORE_ELEM,
+  //! 実引数を積む。aが変数の場合はそのアドレスを、bがある場合は配列aの要素a[b]のアドレスを積む
+  IR_ARG,
+  //! 手続きaを呼び出す
+  IR_CALL,
+  //! 変数a、もしくはbがある場合は配列aの要素a[b]に読み込む
+  IR_READ,
+  //! 入力の行の残りを読み飛ばす
+  IR_READLN,
+  //! aを桁数bで出力する
+  IR_WRITE,
+  //! 改行を出力する
+  IR_WRITELN,
+  //! targetに分岐する。終端命令
+  IR_JUMP,
+  //! a condの比較 b が成り立てばtargetに、成り立たなければotherに分岐する。終端命令
+  IR_BRANCH,
+  //! 関数から戻る。終端命令
+  IR_RETURN,
+} IrOpcode;
+
+//! 中間表現の命令
+typedef struct
+{
+  //! 命令の種類
+  IrOpcode op;
+  //! IR_BRANCHの比較の種類。IR_EQからIR_GEのいずれか
+  IrOpcode cond;
+  //! 結果を格納する先。IR_STORE_ELEMの場合は配列
+  IrValue dst;
+  //! 第1オペランド
+  IrValue a;
+  //! 第2オペランド
+  IrValue b;
+  //! 分岐先の基本ブロックの番号
+  int target;
+  //! IR_BRANCHの条件が成り立たない場合の分岐先の基本ブロックの番号
+  int other;
+  //! 命令を生成した文の先頭のトークンの位置
+  int tok;
+} IrInstr;
+
+//! 基本ブロック
+typedef struct
+{
+  //! 終端命令を除く命令の配列
+  IrInstr * instrs;
+  //! 命令の数
+  int size;
+  //! 確保済みの命令の数
+  int capacity;
+  //! 終端命令
+  IrInstr term;
+} IrBlock;
+
+//! 副プログラムもしくは主プログラムの中間表現
+typedef struct
+{
+  //! 副プログラムの名前。主プログラムの場合はNULL
+  const char * name;
+  //! 基本ブロックの配列。0番が入口で、配置する順に並ぶ
+  IrBlock * blocks;
+  //! 基本ブロックの数
+  int num_blocks;
+  //! 一時変数の数
+  int num_temps;
+  //! 組み立てたトークン列
+  const TokenArray * tokens;
+} IrFunction;
+
+IrFunction * buildIrFunction(TokenArray *, int *, char *);
+void printIrFunction(FILE *, const IrFunction *);
+void freeIrFunction(IrFunction *);
+
+#endif
@@ -10,6 +10,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include "emit.h"
+#include "peephole.h"
+
 /**
  * @brief 文字列の最大の長さを表す定数
  * @def MAXSTRSIZE
@@ -159,13 +162,35 @@ typedef enum {
  */
 #define ERROR -1
 
+/**
+ * @def MIN_WORD
+ * CASL IIの1語で表せる整数の最小値
+ */
+#define MIN_WORD (-32768)
+
+/**
+ * @def MAX_WORD
+ * CASL IIの1語で表せる整数の最大値
+ */
+#define MAX_WORD 32767
+
 /**
  * @def NORMAL
  * @brief 正常終了を示す定数
  */
 #define NORMAL 0
 
-#define HASHSIZE 1000
+/**
+ * @def HASHMAP_MIN_CAPACITY
+ * @brief ハッシュマップが最初に確保するエントリの数
+ */
+#define HASHMAP_MIN_CAPACITY 8
+
+/**
+ * @def HASHMAP_MAX_LOAD_PERCENT
+ * @brief ハッシュマップの負荷率の上限(%)。これを超えると容量を倍にする
+ */
+#define HASHMAP_MAX_LOAD_PERCENT 70
 
 /**
  * @enum TokenKind
@@ -187,36 +212,38 @@ typedef enum {
 } TokenKind;
 
 /**
- * @struct Token
- * @brief トークンの構造体
- */
-typedef struct Token Token;
-
-/**
- * @struct Token
- * @brief トークンの構造体
+ * @struct TokenArray
+ * @brief トークン列の構造体
+ * トークンの属性ごとに配列を持ち、i番目のトークンの属性は各配列のi番目の要素に格納される。
+ * 末尾のトークンは必ずTK_EOFである
  */
-struct Token
+typedef struct
 {
+  //! トークンの個数
+  int size;
+  //! 各配列の確保済みの要素数
+  int capacity;
   //! トークンの種類
-  TokenKind kind;
+  unsigned char * kind;
   //! トークンのID
-  int id;
-  //! 次のトークン
-  Token * next;
-  //! トークンの長さ
-  int len;
+  unsigned char * id;
   //! トークンの行
-  int line_no;
-  //! トークンの文字列
-  char * str;
+  int * line_no;
+  //! ソース中の字句の先頭。文字列の場合は両端の'を含まない
+  const char ** loc;
+  //! ソース中の字句の長さ
+  int * loc_len;
+  //! トークンの長さ。文字列の場合は''を1文字として数える
+  int * len;
   //! トークンの数値
-  int num;
+  int * num;
+  //! トークンの文字列。tokenStrを呼ぶまではNULL
+  char ** str;
   //! 行頭かどうか
-  bool at_bol;
+  bool * at_bol;
   //! トークンの前に空白があるか
-  bool has_space;
-};
+  bool * has_space;
+} TokenArray;
 
 typedef enum {
   //! 整数
@@ -254,6 +281,8 @@ typedef struct LINE LINE;
 struct LINE
 {
   int reflinenum;
+  //! 参照した副プログラムの名前。主プログラムから参照した場合はNULL
+  char * refprocname;
   LINE * nextlinep;
 };
 
@@ -265,26 +294,35 @@ struct ID
   TYPE * itp;
   bool ispara;
   int defline;
+  //! 参照された行番号のリストの先頭
   LINE * irefp;
+  //! 参照された行番号のリストの末尾。末尾への追加を定数時間で行うために保持する
+  LINE * ireftail;
 };
 
 typedef struct Entry Entry;
 struct Entry
 {
-  char * key;
+  //! キー。空きのエントリはNULL
+  const char * key;
+  //! キーのハッシュ値
+  unsigned int hash;
   ID * value;
-  Entry * next;
 };
 
+//! オープンアドレス法(線形探索)のハッシュマップ
 typedef struct HashMap HashMap;
 struct HashMap
 {
-  Entry ** entries;
-  int size;
+  Entry * entries;
+  //! エントリの配列の大きさ。2のべき乗
+  int capacity;
+  //! 格納されているエントリの数
+  int count;
 };
 
 HashMap * newHashMap(int);
-void insertToHashMap(const HashMap *, const char *, ID *);
+void insertToHashMap(HashMap *, const char *, ID *);
 ID * getValueFromHashMap(const HashMap *, const char *);
 void freeHashMap(HashMap *);
 int removeFromHashMap(const HashMap *, const char *);
@@ -340,26 +378,99 @@ int removeFromHashMap(const HashMap *, const char *);
   /* スタックが空かどうかを判定 */                                                   \
   static int TYPENAME##_is_empty(TYPENAME * stack) { return stack->size == 0; }
 
-//! 記号表の文字列と行数を格納する構造体
-typedef struct SymbolBuffer SymbolBuffer;
+//! コード生成に用いる記号表の要素
+typedef struct
+{
+  //! 名前
+  char * name;
+  //! 局所的な名前の場合は副プログラムの名前。大域的な名前の場合はNULL
+  char * procname;
+  //! 命令中で用いるラベル
+  char * label;
+  //! 型
+  TYPE * type;
+  //! 配列型の場合の要素数。配列型でない場合は0
+  int arraysize;
+  //! 仮引数かどうか
+  bool ispara;
+  //! 構文解析での名前のエントリ。参照された行の並びを持つ
+  const ID * id;
+  //! 副プログラムの場合、主プログラムから呼び出しをたどって到達できるかどうか
+  bool reachable;
+} Symbol;
 
-//! 記号表の文字列と行数を格納する構造体
-struct SymbolBuffer
+//! 構文解析で宣言された名前を宣言順に格納する記号表
+typedef struct
 {
-  char * buf;
-  int line_count;
-};
+  //! 記号表の要素の配列
+  Symbol * symbols;
+  //! 要素数
+  int size;
+  //! 確保済みの要素数
+  int capacity;
+  //! 名前とプロシージャ名の組から要素の添字を引くオープンアドレス法のハッシュ表。空きは-1
+  int * buckets;
+  //! ハッシュ表の大きさ。2のべき乗
+  int bucket_count;
+} SymbolTable;
+
+//! 条件式の範囲の中で、括弧の外側にある演算子を数えた結果
+typedef struct
+{
+  //! 関係演算子の数
+  int relops;
+  //! orの数
+  int ors;
+  //! or以外の加法演算子と符号の数
+  int other_addops;
+  //! andの数
+  int ands;
+  //! and以外の乗法演算子の数
+  int other_mulops;
+} ConditionShape;
+
+/**
+ * @enum BoundsCheck
+ * @brief 配列の添字の範囲検査を生成する方針
+ */
+typedef enum {
+  //! 全ての添字を実行時に検査する
+  BOUNDS_CHECK_ALWAYS,
+  //! 範囲内にあることを証明できない添字だけを実行時に検査する
+  BOUNDS_CHECK_AUTO,
+  //! 添字を検査しない
+  BOUNDS_CHECK_OFF,
+} BoundsCheck;
 
 TYPE_KIND error(char *, ...);
 
-Token * tokenizeFile(char *);
-int parse(Token *);
+TokenArray * tokenizeFile(char *);
+char * tokenStr(TokenArray *, int);
+int parse(TokenArray *);
 bool isMulOp(TokenID);
 bool isRelOp(TokenID);
 bool isAddOp(TokenID);
 bool isStdType();
-void outlib(FILE *);
-SymbolBuffer * getCrossrefBuf();
+void outlib(Emitter *, bool);
+SymbolTable * getSymbolTable();
+void freeSymbolTable();
+Symbol * findSymbol(const char *, const char *);
+void enableCrossref();
+char * getCrossref();
+
+Symbol * resolveVar(TokenArray *, int, const char *);
+int matchingBracket(const TokenArray *, int);
+int findTopLevel(const TokenArray *, int, int, TokenID);
+int argumentEnd(const TokenArray *, int);
+bool isVariableArgument(const TokenArray *, int, int);
+ConditionShape scanCondition(const TokenArray *, int, int);
+const char * foldWord(TokenID, int, int, int *);
 
-int codegen(Token *, FILE *);
+void setSourceComments(bool);
+void setBoundsCheck(BoundsCheck);
+void setOptimizationLevel(int);
+void setIrCodegen(bool);
+void setIrDump(bool);
+int codegen(TokenArray *, Emitter *);
+void printStripReport(FILE *);
 #endif
\ No newline at end of file
@@ -1,3 +1,5 @@
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "lpp.h"
 
@@ -14,11 +16,20 @@ static bool file_exists(char * path)
   return !stat(path, &st);
 }
 
-static FILE * openFile(const char * path)
+/**
+ * @brief 出力バッファの内容を出力ファイルに書き出す
+ * 
+ * @param emitter 出力バッファ
+ * @param path 出力ファイルのパス
+ * @return int 正常終了の場合は NORMAL、エラーの場合は ERROR を返す
+ */
+static int writeOutput(Emitter * emitter, const char * path)
 {
-  FILE * out = fopen(path, "w");
-  if (!out) error("Cannot open file: %s: %s", path, strerror(errno));
-  return out;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) return error("Cannot open file: %s: %s", path, strerror(errno));
+  int result = flushEmitter(emitter, fd);
+  close(fd);
+  return result;
 }
 
 static void getFileName(char * path, char * name)
@@ -51,22 +62,73 @@ static void getOutputFileName(char * path, char * name)
 
 int main(int argc, char ** argv)
 {
-  if (argc < 2) {
+  char * path = NULL;
+  bool print_crossref = false;
+  bool print_peephole_report = false;
+  bool print_strip_report = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--xref") == 0) {
+      print_crossref = true;
+    } else if (strcmp(argv[i], "--no-source-comments") == 0) {
+      setSourceComments(false);
+    } else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0) {
+      setOptimizationLevel(argv[i][2] - '0');
+    } else if (strcmp(argv[i], "--peephole-report") == 0) {
+      print_peephole_report = true;
+    } else if (strcmp(argv[i], "--strip-report") == 0) {
+      print_strip_report = true;
+    } else if (strcmp(argv[i], "--ir") == 0) {
+      // 中間表現を経由するコード生成は実験的な経路で、既定では使わない
+      setIrCodegen(true);
+    } else if (strcmp(argv[i], "--dump-ir") == 0) {
+      setIrCodegen(true);
+      setIrDump(true);
+    } else if (strncmp(argv[i], "--bounds-check=", 15) == 0) {
+      const char * mode = argv[i] + 15;
+      if (strcmp(mode, "always") == 0) {
+        setBoundsCheck(BOUNDS_CHECK_ALWAYS);
+      } else if (strcmp(mode, "auto") == 0) {
+        setBoundsCheck(BOUNDS_CHECK_AUTO);
+      } else if (strcmp(mode, "off") == 0) {
+        setBoundsCheck(BOUNDS_CHECK_OFF);
+      } else {
+        error("Unknown bounds check mode: %s", mode);
+        return -1;
+      }
+    } else {
+      path = argv[i];
+    }
+  }
+
+  if (path == NULL) {
     error("File name is not given.");
     return -1;
   }
-  if (!file_exists(argv[1])) {
-    error("File not found: %s", argv[1]);
+  if (!file_exists(path)) {
+    error("File not found: %s", path);
     return -1;
   }
 
-  Token * tok = tokenizeFile(argv[1]);
-  if (parse(tok) == ERROR) return ERROR;
+  TokenArray * tok = tokenizeFile(path);
   char * filename = (char *)malloc(sizeof(char) * MAXSTRSIZE);
-  getOutputFileName(argv[1], filename);
+  getOutputFileName(path, filename);
+  if (print_crossref) enableCrossref();
 
-  FILE * out = openFile(filename);
-  if (codegen(tok, out) == ERROR) return ERROR;
+  // 命令は出力バッファに溜めておき、最後に一度に出力ファイルへ書き出す
+  Emitter * emitter = newEmitter();
+  if (parse(tok) == ERROR) return ERROR;
+  // コード生成に失敗した場合も、それまでに生成した命令は出力ファイルに残す
+  int result = codegen(tok, emitter);
+  if (writeOutput(emitter, filename) == ERROR || result == ERROR) return ERROR;
+  freeEmitter(emitter);
 
+  // クロスリファレンス表は要求された場合のみ生成して標準出力に出す
+  if (print_crossref && getCrossref() != NULL) fputs(getCrossref(), stdout);
+  // 覗き穴最適化の変換規則ごとの適用回数は要求された場合のみ標準出力に出す
+  if (print_peephole_report) printPeepholeReport(stdout);
+  // 生成しなかった副プログラムと変数の集計は要求された場合のみ標準出力に出す
+  if (print_strip_report) printStripReport(stdout);
+  // 記号表を参照する処理はここまでなので、構文解析の結果を解放する
+  freeSymbolTable();
   return 0;
 }
@@ -1,7 +1,8 @@
+#include <stdint.h>
 #include <string.h>
 
+#include "arena.h"
 #include "lpp.h"
-#define HASHSIZE 1000
 /**
  * @brief 段付の深さを表す変数
  * 初期値は0であり、段付が深くなるごとにインクリメントされる
@@ -11,8 +12,10 @@ static int indent_level = 0;
 //! 行頭にいるかどうかを表す変数。トークンのリストにも改行されて段落の一番最初にあるかどうかを表すフラグがあるが、この変数は文脈に応じて改行されるべきかを判断するための変数である。トークンに付与されたものとこれの二つのフラグの論理和で改行されるべきかを判断する。
 static bool at_bol = false;
 
-//! 現在注目しているトークン
-static Token * cur;
+//! 構文解析の対象のトークン列
+static TokenArray * tokens;
+//! 現在注目しているトークンの添字
+static int cur;
 
 //! 現在注目しているトークンの位置を表す変数
 static int iteration_level = 0;
@@ -26,6 +29,9 @@ HashMap ** current_id;
 //! 定義されたプロシージャの名前を格納する変数
 static char * procname = NULL;
 
+//! 型情報やクロスリファレンス表の要素を確保するアリーナ
+static Arena * parse_arena;
+
 //! 副プログラムの仮引数のカウント用変数
 static uint parameter_num = 0;
 
@@ -42,7 +48,18 @@ TYPE * type = NULL;
 ID * node = NULL;
 
 char * crossref_buf = NULL;
-SymbolBuffer * symbol_buf = NULL;
+
+//! クロスリファレンス表の文字列の長さ
+static size_t crossref_len = 0;
+
+//! クロスリファレンス表の文字列に確保済みの容量
+static size_t crossref_capacity = 0;
+
+//! コード生成に渡す記号表
+static SymbolTable symbol_table;
+
+//! クロスリファレンス表を文字列として生成するかどうか
+static bool crossref_enabled = false;
 
 //! 定義された行番号を格納する変数
 
@@ -56,8 +73,8 @@ static const char * token_str[NUMOFTOKEN + 1] = {
   ":",      ";",      "read",      "write",   "break"};
 
 static void printIndent();
-static void printToken(const Token *);
-static void consumeToken(Token *);
+static void printToken(int);
+static void consumeToken(int);
 static TYPE_KIND parseType();
 static int parseVarNames();
 static int parseVarDeclaration();
@@ -89,7 +106,7 @@ static int parseOutputStatement();
 static TYPE * copyType(TYPE * src)
 {
   if (!src) return NULL;
-  TYPE * dst = malloc(sizeof(TYPE));
+  TYPE * dst = arenaAlloc(parse_arena, sizeof(TYPE));
   *dst = *src;
   dst->etp = copyType(src->etp);
   dst->paratp = copyType(src->paratp);
@@ -119,7 +136,7 @@ static TYPE_KIND decodeIDtoTYPEKIND(int id, bool is_array)
       case TBOOLEAN:
         return TPBOOL;
       default:
-        return error("\nError at %d: Expected type", cur->line_no);
+        return error("\nError at %d: Expected type", tokens->line_no[cur]);
     }
   } else {
     switch (id) {
@@ -134,7 +151,7 @@ static TYPE_KIND decodeIDtoTYPEKIND(int id, bool is_array)
       case TBOOLEAN:
         return TPARRAYBOOL;
       default:
-        return error("\nError at %d: Expected type", cur->line_no);
+        return error("\nError at %d: Expected type", tokens->line_no[cur]);
     }
   }
 }
@@ -158,25 +175,29 @@ static TokenID decodeTYPEKINDtoID(const int typekind)
     case TPARRAYBOOL:
       return TBOOLEAN;
     default:
-      error("\nError at %d: Invalid typekind %d", cur->line_no, typekind);
+      error("\nError at %d: Invalid typekind %d", tokens->line_no[cur], typekind);
       return TERROR;
   }
 }
 
 /**
- * @brief 参照されたときの行番号を追加する
- * 
- * @param iref TYPE構造体に含まれるirefpへのポインタ
+ * @brief 参照されたときの行番号と、参照した副プログラムの名前を追加する
+ * リストの末尾を保持しているので、参照回数によらず定数時間で追加できる
+ * @param id 参照された名前のエントリ
  * @param refline 参照されたときの行番号
  */
-static void pushIref(LINE ** iref, int refline)
+static void pushIref(ID * id, int refline)
 {
-  while (*iref != NULL) {
-    iref = &(*iref)->nextlinep;
+  LINE * line = arenaAlloc(parse_arena, sizeof(LINE));
+  line->reflinenum = refline;
+  line->refprocname = procname;
+  line->nextlinep = NULL;
+  if (id->irefp == NULL) {
+    id->irefp = line;
+  } else {
+    id->ireftail->nextlinep = line;
   }
-  *iref = malloc(sizeof(LINE));
-  (*iref)->reflinenum = refline;
-  (*iref)->nextlinep = NULL;
+  id->ireftail = line;
 }
 
 /**
@@ -195,29 +216,66 @@ static ID * lookupAndAddIref(const char * name, int line_no)
     entry = getValueFromHashMap(globalid, name);
   }
   if (entry != NULL) {
-    pushIref(&entry->irefp, line_no);
+    pushIref(entry, line_no);
   }
   return entry;
 }
 
-static void appendCrossRef(const char * fmt, ...)
+/**
+ * @brief クロスリファレンス表の文字列に少なくともlen文字を追加できる容量を確保する
+ * 容量は倍々に広げるので、追加にかかる時間は表全体の長さに対して線形になる
+ * @param len 追加したい文字数
+ */
+static void reserveCrossRef(size_t len)
 {
-  va_list ap;
-  va_list apcopy;
-  va_start(ap, fmt);
-  va_copy(apcopy, ap);
-  int needed = vsnprintf(NULL, 0, fmt, ap) + 1;
-  va_end(ap);
-
-  if (!crossref_buf) {
-    crossref_buf = malloc(needed);
-    crossref_buf[0] = '\0';
-  } else {
-    crossref_buf = realloc(crossref_buf, strlen(crossref_buf) + needed);
+  if (crossref_len + len + 1 <= crossref_capacity) return;
+  size_t capacity = crossref_capacity ? crossref_capacity : 4096;
+  while (capacity < crossref_len + len + 1) capacity *= 2;
+  crossref_buf = realloc(crossref_buf, capacity);
+  if (crossref_buf == NULL) {
+    error("Memory allocation error");
+    exit(1);
   }
+  crossref_capacity = capacity;
+}
+
+/**
+ * @brief クロスリファレンス表に長さを指定して文字列を追加する
+ * 
+ * @param str 追加したい文字列
+ * @param len 文字列の長さ
+ */
+static void appendCrossRefN(const char * str, size_t len)
+{
+  reserveCrossRef(len);
+  memcpy(crossref_buf + crossref_len, str, len);
+  crossref_len += len;
+  crossref_buf[crossref_len] = '\0';
+}
+
+/**
+ * @brief クロスリファレンス表に文字列を追加する
+ * 
+ * @param str 追加したい文字列
+ */
+static void appendCrossRef(const char * str) { appendCrossRefN(str, strlen(str)); }
 
-  vsprintf(crossref_buf + strlen(crossref_buf), fmt, apcopy);
-  va_end(apcopy);
+/**
+ * @brief クロスリファレンス表に整数を10進数で追加する
+ * 
+ * @param num 追加したい整数
+ */
+static void appendCrossRefInt(int num)
+{
+  char digits[16];
+  char * p = digits + sizeof(digits);
+  unsigned int n = num < 0 ? -(unsigned int)num : (unsigned int)num;
+  do {
+    *--p = '0' + n % 10;
+    n /= 10;
+  } while (n != 0);
+  if (num < 0) *--p = '-';
+  appendCrossRefN(p, digits + sizeof(digits) - p);
 }
 
 /**
@@ -227,15 +285,18 @@ static void appendCrossRef(const char * fmt, ...)
  */
 static void printName(Entry * entry)
 {
-  appendCrossRef("%s", entry->key);
-  if (entry->value->procname != NULL) appendCrossRef(":%s", entry->value->procname);
+  appendCrossRef(entry->key);
+  if (entry->value->procname != NULL) {
+    appendCrossRef(":");
+    appendCrossRef(entry->value->procname);
+  }
   appendCrossRef("|");
-  if (entry->value->ispara) {
-    appendCrossRef("$$%s", entry->key);
-  } else {
-    appendCrossRef("$%s", entry->key);
+  appendCrossRef(entry->value->ispara ? "$$" : "$");
+  appendCrossRef(entry->key);
+  if (entry->value->procname != NULL) {
+    appendCrossRef("%");
+    appendCrossRef(entry->value->procname);
   }
-  if (entry->value->procname != NULL) appendCrossRef("%%%s", entry->value->procname);
   appendCrossRef("|");
 }
 
@@ -254,7 +315,7 @@ static void printType(TYPE * tp)
         appendCrossRef("(");
         TYPE * param = tp->paratp;
         while (param != NULL) {
-          appendCrossRef("%s", token_str[decodeTYPEKINDtoID(param->ttype)]);
+          appendCrossRef(token_str[decodeTYPEKINDtoID(param->ttype)]);
           param = param->paratp;
           if (param != NULL) {
             appendCrossRef(", ");
@@ -266,11 +327,13 @@ static void printType(TYPE * tp)
     case TPINT:
     case TPCHAR:
     case TPBOOL:
-      appendCrossRef("%s", token_str[decodeTYPEKINDtoID(tp->ttype)]);
+      appendCrossRef(token_str[decodeTYPEKINDtoID(tp->ttype)]);
       break;
     default:
-      appendCrossRef(
-        "array[%d]of%s", tp->etp->arraysize, token_str[decodeTYPEKINDtoID(tp->etp->ttype)]);
+      appendCrossRef("array[");
+      appendCrossRefInt(tp->etp->arraysize);
+      appendCrossRef("]of");
+      appendCrossRef(token_str[decodeTYPEKINDtoID(tp->etp->ttype)]);
       break;
   }
 }
@@ -294,32 +357,24 @@ static int compareEntryKeys(const void * a, const void * b)
  */
 static void printCrossreferenceTable(HashMap * idroot)
 {
-  int count = 0;
-  for (int i = 0; i < idroot->size; i++) {
-    for (Entry * entry = idroot->entries[i]; entry; entry = entry->next) {
-      count++;
-    }
-  }
+  int count = idroot->count;
   Entry ** arr = malloc(sizeof(Entry *) * count);
   int idx = 0;
-  for (int i = 0; i < idroot->size; i++) {
-    for (Entry * entry = idroot->entries[i]; entry; entry = entry->next) {
-      arr[idx++] = entry;
-    }
+  for (int i = 0; i < idroot->capacity; i++) {
+    if (idroot->entries[i].key != NULL) arr[idx++] = &idroot->entries[i];
   }
 
   qsort(arr, count, sizeof(Entry *), compareEntryKeys);
-  symbol_buf->line_count += count;
   for (int i = 0; i < count; i++) {
     Entry * entry = arr[i];
     printName(entry);
     printType(entry->value->itp);
-    appendCrossRef("|%d", entry->value->ispara);
-    appendCrossRef("|%d|", entry->value->defline);
-    while (entry->value->irefp != NULL) {
-      appendCrossRef("%d", entry->value->irefp->reflinenum);
-      entry->value->irefp = entry->value->irefp->nextlinep;
-      if (entry->value->irefp != NULL) {
+    appendCrossRef(entry->value->ispara ? "|1|" : "|0|");
+    appendCrossRefInt(entry->value->defline);
+    appendCrossRef("|");
+    for (LINE * line = entry->value->irefp; line != NULL; line = line->nextlinep) {
+      appendCrossRefInt(line->reflinenum);
+      if (line->nextlinep != NULL) {
         appendCrossRef(",");
       }
     }
@@ -328,25 +383,107 @@ static void printCrossreferenceTable(HashMap * idroot)
   free(arr);
 }
 
+/**
+ * @brief 記号表のハッシュ表で用いるハッシュ値を計算する
+ * 名前とプロシージャ名はtokenStrでインターンされた文字列なので、文字列ではなくポインタからハッシュ値を求める
+ * @param name 名前
+ * @param proc プロシージャ名。大域的な名前の場合はNULL
+ * @return unsigned int ハッシュ値
+ */
+static unsigned int hashSymbolKey(const char * name, const char * proc)
+{
+  uint64_t h = ((uint64_t)(uintptr_t)name ^ ((uint64_t)(uintptr_t)proc << 1)) * 0x9E3779B97F4A7C15ULL;
+  return (unsigned int)(h >> 32);
+}
+
+/**
+ * @brief 記号表のハッシュ表に要素の添字を登録する
+ * 
+ * @param index 登録する要素の添字
+ */
+static void insertSymbolIndex(int index)
+{
+  const Symbol * symbol = &symbol_table.symbols[index];
+  unsigned int mask = symbol_table.bucket_count - 1;
+  unsigned int i = hashSymbolKey(symbol->name, symbol->procname) & mask;
+  while (symbol_table.buckets[i] != -1) i = (i + 1) & mask;
+  symbol_table.buckets[i] = index;
+}
+
+/**
+ * @brief 記号表のハッシュ表を倍の大きさにして登録し直す
+ * 
+ */
+static void growSymbolIndex()
+{
+  free(symbol_table.buckets);
+  symbol_table.bucket_count = symbol_table.bucket_count ? symbol_table.bucket_count * 2 : 128;
+  symbol_table.buckets = malloc(sizeof(int) * symbol_table.bucket_count);
+  if (symbol_table.buckets == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  memset(symbol_table.buckets, -1, sizeof(int) * symbol_table.bucket_count);
+  for (int i = 0; i < symbol_table.size; i++) insertSymbolIndex(i);
+}
+
+/**
+ * @brief 記号表に名前を追加する
+ * ラベルは大域的な名前は$name、局所的な名前は$name%proc、仮引数は$$name%procとする
+ * @param id 追加したい名前のエントリ
+ */
+static void addSymbol(ID * id)
+{
+  if (symbol_table.size == symbol_table.capacity) {
+    symbol_table.capacity = symbol_table.capacity ? symbol_table.capacity * 2 : 64;
+    symbol_table.symbols = realloc(symbol_table.symbols, sizeof(Symbol) * symbol_table.capacity);
+    if (symbol_table.symbols == NULL) {
+      error("Memory allocation error");
+      exit(1);
+    }
+  }
+
+  char label[MAXSTRSIZE * 2 + 4];
+  int len = snprintf(label, sizeof(label), "%s%s", id->ispara ? "$$" : "$", id->name);
+  if (id->procname != NULL)
+    len += snprintf(label + len, sizeof(label) - len, "%%%s", id->procname);
+
+  Symbol * symbol = &symbol_table.symbols[symbol_table.size++];
+  symbol->name = id->name;
+  symbol->procname = id->procname;
+  symbol->label = arenaStrndup(parse_arena, label, len);
+  symbol->type = id->itp;
+  symbol->arraysize = id->itp->etp != NULL ? id->itp->etp->arraysize : 0;
+  symbol->ispara = id->ispara;
+  symbol->id = id;
+  symbol->reachable = true;
+
+  // 負荷率を1/2以下に保つ
+  if (symbol_table.size * 2 > symbol_table.bucket_count)
+    growSymbolIndex();
+  else
+    insertSymbolIndex(symbol_table.size - 1);
+}
+
 /**
  * @brief ローカルなスコープに入る
  * currnet_idをlocalidに向けて、localidのハッシュマップの初期化する。
  */
 static void enterScope()
 {
-  localid = newHashMap(HASHSIZE);
+  localid = newHashMap(HASHMAP_MIN_CAPACITY);
   current_id = &localid;
 }
 
 /**
  * @brief グローバルなスコープに入る
- * ハッシュマップの中身をクロスリファレンス表として出力する。
+ * クロスリファレンス表が要求されている場合はハッシュマップの中身を出力する。
  * ローカルなハッシュマップはメモリから開放を行う。
  * 最後にcurrent_idをglobalidに向ける。
  */
 static void exitScope()
 {
-  printCrossreferenceTable(localid);
+  if (crossref_enabled) printCrossreferenceTable(localid);
   procname = NULL;
   freeHashMap(*current_id);
   current_id = &globalid;
@@ -360,7 +497,7 @@ static void exitScope()
 static void printIndent()
 {
   if (indent_level < 0) {
-    error("Line %d: Indent level is negative", cur->line_no);
+    error("Line %d: Indent level is negative", tokens->line_no[cur]);
     exit(1);
   }
   for (int i = 0; i < indent_level; i++) {
@@ -374,24 +511,24 @@ static void printIndent()
  * 半角の空白をトークンの前に挟む
  * @param tok 
  */
-static void printToken(const Token * tok)
+static void printToken(int tok)
 {
   // プリティプリント防止
   return;
-  if (!at_bol && !tok->at_bol && tok->has_space) printf(" ");
-  if ((tok->at_bol || at_bol) && tok->id != TPROGRAM) {
+  if (!at_bol && !tokens->at_bol[tok] && tokens->has_space[tok]) printf(" ");
+  if ((tokens->at_bol[tok] || at_bol) && tokens->id[tok] != TPROGRAM) {
     printf("\n");
     printIndent();
   }
 
-  if (tok->kind == TK_KEYWORD || tok->kind == TK_PUNCT) {
-    printf("%s", token_str[cur->id]);
-  } else if (cur->kind == TK_NUM) {
-    printf("%s", cur->str);
-  } else if (cur->kind == TK_STR) {
-    printf("'%s'", cur->str);
+  if (tokens->kind[tok] == TK_KEYWORD || tokens->kind[tok] == TK_PUNCT) {
+    printf("%s", token_str[tokens->id[tok]]);
+  } else if (tokens->kind[tok] == TK_NUM) {
+    printf("%s", tokenStr(tokens, tok));
+  } else if (tokens->kind[tok] == TK_STR) {
+    printf("'%s'", tokenStr(tokens, tok));
   } else {
-    printf("%s", cur->str);
+    printf("%s", tokenStr(tokens, tok));
   }
   fflush(stdout);
   at_bol = false;
@@ -408,7 +545,7 @@ static void printToken(const Token * tok)
  */
 static TYPE * newType(TYPE_KIND ttype, int arraysize, TYPE * etp, TYPE * paratp)
 {
-  TYPE * tp = malloc(sizeof(TYPE));
+  TYPE * tp = arenaAlloc(parse_arena, sizeof(TYPE));
   tp->ttype = ttype;
   tp->arraysize = arraysize;
   tp->etp = etp;
@@ -426,30 +563,29 @@ static TYPE * newType(TYPE_KIND ttype, int arraysize, TYPE * etp, TYPE * paratp)
  * @param defline 
  * @return ID* 
  */
-static ID * newID(const char * name, const char * _procname, TYPE * itp, int ispara, int defline)
+static ID * newID(char * name, char * _procname, TYPE * itp, int ispara, int defline)
 {
-  ID * id = malloc(sizeof(ID));
-  id->name = strdup(name);
-  if (_procname != NULL)
-    id->procname = strdup(_procname);
-  else
-    id->procname = NULL;
+  ID * id = arenaAlloc(parse_arena, sizeof(ID));
+  // 名前はtokenStrで格納されたものなので複製せずにそのまま保持する
+  id->name = name;
+  id->procname = _procname;
   id->itp = copyType(itp);
   id->ispara = ispara;
   id->irefp = NULL;
+  id->ireftail = NULL;
   id->defline = defline;
   return id;
 }
 
 /**
  * @brief トークンを標準出力して現在注目しているトークンの位置を一つ進める
- * 
+ * 末尾のTK_EOFに達した後はその位置に留まる
  * @param tok 
  */
-static void consumeToken(Token * tok)
+static void consumeToken(int tok)
 {
   printToken(tok);
-  cur = cur->next;
+  if (cur < tokens->size - 1) cur++;
 }
 
 /**
@@ -519,7 +655,7 @@ bool isAddOp(TokenID id)
  */
 bool isStdType()
 {
-  switch (cur->id) {
+  switch (tokens->id[cur]) {
     case TINTEGER:
     case TBOOLEAN:
     case TCHAR:
@@ -538,32 +674,32 @@ static TYPE_KIND parseType()
 {
   int vartype;
   if (isStdType()) {
-    vartype = decodeIDtoTYPEKIND(cur->id, false);
+    vartype = decodeIDtoTYPEKIND(tokens->id[cur], false);
     type = newType(vartype, -1, NULL, NULL);
     consumeToken(cur);
-  } else if (cur->id == TARRAY) {
+  } else if (tokens->id[cur] == TARRAY) {
     int arraysize = 0;
     consumeToken(cur);
-    if (cur->id != TLSQPAREN) return error("\nError at %d: Expected '['", cur->line_no);
+    if (tokens->id[cur] != TLSQPAREN) return error("\nError at %d: Expected '['", tokens->line_no[cur]);
     consumeToken(cur);
-    if (cur->id != TNUMBER) return error("\nError at %d: Expected number", cur->line_no);
-    arraysize = cur->num;
+    if (tokens->id[cur] != TNUMBER) return error("\nError at %d: Expected number", tokens->line_no[cur]);
+    arraysize = tokens->num[cur];
     if (arraysize == 0)
-      return error("\nError at %d: Array size must be greater than 0", cur->line_no);
+      return error("\nError at %d: Array size must be greater than 0", tokens->line_no[cur]);
     consumeToken(cur);
-    if (cur->id != TRSQPAREN) return error("\nError at %d: Expected ']'", cur->line_no);
+    if (tokens->id[cur] != TRSQPAREN) return error("\nError at %d: Expected ']'", tokens->line_no[cur]);
     consumeToken(cur);
-    if (cur->id != TOF) return error("\nError at %d: Expected 'of'", cur->line_no);
+    if (tokens->id[cur] != TOF) return error("\nError at %d: Expected 'of'", tokens->line_no[cur]);
     consumeToken(cur);
 
-    if (!isStdType()) return error("\nError at %d: Expected type", cur->line_no);
-    vartype = decodeIDtoTYPEKIND(cur->id, true);
+    if (!isStdType()) return error("\nError at %d: Expected type", tokens->line_no[cur]);
+    vartype = decodeIDtoTYPEKIND(tokens->id[cur], true);
 
     TYPE * etp = newType(vartype, arraysize, NULL, false);
     type = newType(-1, -1, etp, NULL);
     consumeToken(cur);
   } else {
-    return error("\nError at %d: Expected type", cur->line_no);
+    return error("\nError at %d: Expected type", tokens->line_no[cur]);
   }
 
   return vartype;
@@ -576,16 +712,16 @@ static TYPE_KIND parseType()
  */
 static int parseVarNames()
 {
-  if (cur->id != TNAME) return ERROR;
+  if (tokens->id[cur] != TNAME) return ERROR;
   parameter_num++;
-  VAR var = {cur->line_no, cur->str};
+  VAR var = {tokens->line_no[cur], tokenStr(tokens, cur)};
   VARNAME_push(&varname_stack, var);
   consumeToken(cur);
-  while (cur->id == TCOMMA) {
+  while (tokens->id[cur] == TCOMMA) {
     consumeToken(cur);
-    if (cur->id != TNAME) return error("\nError at %d: Expected variable name", cur->line_no);
+    if (tokens->id[cur] != TNAME) return error("\nError at %d: Expected variable name", tokens->line_no[cur]);
     parameter_num++;
-    VAR var = {cur->line_no, cur->str};
+    VAR var = {tokens->line_no[cur], tokenStr(tokens, cur)};
     VARNAME_push(&varname_stack, var);
     consumeToken(cur);
   }
@@ -606,6 +742,7 @@ static void processVarNameStack()
     if (value == NULL) {
       node = newID(var.varname, procname, type, false, var.line_no);
       insertToHashMap(*current_id, var.varname, node);
+      addSymbol(node);
     } else {
       if (strcmp(var.varname, value->name) == 0) {
         error("\nError at %d: Variable %s already defined", var.line_no, var.varname);
@@ -622,32 +759,32 @@ static void processVarNameStack()
  */
 static int parseVarDeclaration()
 {
-  if (cur->id != TVAR) return error("\nError at %d: Expected 'var'", cur->line_no);
+  if (tokens->id[cur] != TVAR) return error("\nError at %d: Expected 'var'", tokens->line_no[cur]);
   indent_level++;
   consumeToken(cur);
   indent_level++;
   at_bol = true;
-  if (parseVarNames() == ERROR) return error("\nError at %d: Expected variable name", cur->line_no);
+  if (parseVarNames() == ERROR) return error("\nError at %d: Expected variable name", tokens->line_no[cur]);
 
-  if (cur->id != TCOLON) return error("\nError at %d: Expected ':'", cur->line_no);
+  if (tokens->id[cur] != TCOLON) return error("\nError at %d: Expected ':'", tokens->line_no[cur]);
   consumeToken(cur);
 
   if (parseType() == TPRERROR) return ERROR;
 
-  if (cur->id != TSEMI) return error("\nError at %d: Expected ';'", cur->line_no);
+  if (tokens->id[cur] != TSEMI) return error("\nError at %d: Expected ';'", tokens->line_no[cur]);
   processVarNameStack();
   consumeToken(cur);
 
-  while (cur->id == TNAME) {
+  while (tokens->id[cur] == TNAME) {
     at_bol = true;
     if (parseVarNames() == ERROR)
-      return error("\nError at %d: Expected variable name", cur->line_no);
-    if (cur->id != TCOLON) return error("\nError at %d: Expected ':'", cur->line_no);
+      return error("\nError at %d: Expected variable name", tokens->line_no[cur]);
+    if (tokens->id[cur] != TCOLON) return error("\nError at %d: Expected ':'", tokens->line_no[cur]);
     consumeToken(cur);
 
     if (parseType() == TPRERROR) return ERROR;
 
-    if (cur->id != TSEMI) return error("\nError at %d: Expected ';'", cur->line_no);
+    if (tokens->id[cur] != TSEMI) return error("\nError at %d: Expected ';'", tokens->line_no[cur]);
     processVarNameStack();
     consumeToken(cur);
   }
@@ -666,19 +803,19 @@ static TYPE_KIND parseTerm()
   TYPE_KIND term_type;
   if ((term_type = parseFactor()) == TPRERROR) return ERROR;
 
-  while (isMulOp(cur->id)) {
-    TokenID mulop = cur->id;
+  while (isMulOp(tokens->id[cur])) {
+    TokenID mulop = tokens->id[cur];
     consumeToken(cur);
     TYPE_KIND factor_type;
     if ((factor_type = parseFactor()) == TPRERROR) return ERROR;
     if (mulop == TAND && term_type != TPBOOL) {
       error(
-        "\nError at %d: Expected boolean but got %s", cur->line_no,
+        "\nError at %d: Expected boolean but got %s", tokens->line_no[cur],
         token_str[decodeTYPEKINDtoID(term_type)]);
       return TPRERROR;
     } else if ((mulop == TSTAR || mulop == TDIV) && term_type != TPINT) {
       error(
-        "\nError at %d: Expected integer but got %s", cur->line_no,
+        "\nError at %d: Expected integer but got %s", tokens->line_no[cur],
         token_str[decodeTYPEKINDtoID(term_type)]);
       return TPRERROR;
     }
@@ -695,7 +832,7 @@ static TYPE_KIND parseSimpleExpression()
 {
   TYPE_KIND simple_expression_type;
   bool must_integer = false;
-  if (cur->id == TPLUS || cur->id == TMINUS) {
+  if (tokens->id[cur] == TPLUS || tokens->id[cur] == TMINUS) {
     consumeToken(cur);
     must_integer = true;
   }
@@ -703,13 +840,13 @@ static TYPE_KIND parseSimpleExpression()
   if ((simple_expression_type = parseTerm()) == TPRERROR) return TPRERROR;
   if (must_integer) {
     if (simple_expression_type != TPINT)
-      return error("\nError at %d: Expected integer", cur->line_no);
+      return error("\nError at %d: Expected integer", tokens->line_no[cur]);
     simple_expression_type = TPINT;
   }
 
-  while (isAddOp(cur->id)) {
-    TYPE_KIND addop = cur->id;
-    if (cur->id == TOR)
+  while (isAddOp(tokens->id[cur])) {
+    TYPE_KIND addop = tokens->id[cur];
+    if (tokens->id[cur] == TOR)
       addop = TPBOOL;
     else
       addop = TPINT;
@@ -718,7 +855,7 @@ static TYPE_KIND parseSimpleExpression()
     if ((term_type = parseTerm()) == TPRERROR) return TPRERROR;
     if (addop != term_type) {
       return error(
-        "\nError at %d: Type mismatch. Expected %s", cur->line_no,
+        "\nError at %d: Type mismatch. Expected %s", tokens->line_no[cur],
         token_str[decodeTYPEKINDtoID(addop)]);
     }
   }
@@ -734,7 +871,7 @@ static TYPE_KIND parseExpression()
 {
   TYPE_KIND expression_type;
   if ((expression_type = parseSimpleExpression()) == TPRERROR) return TPRERROR;
-  while (isRelOp(cur->id)) {
+  while (isRelOp(tokens->id[cur])) {
     consumeToken(cur);
     if (parseSimpleExpression() == TPRERROR) return TPRERROR;
     expression_type = TPBOOL;
@@ -750,7 +887,7 @@ static TYPE_KIND parseExpression()
 static TYPE_KIND parseFactor()
 {
   TYPE_KIND factor_type, expression_type;
-  switch (cur->id) {
+  switch (tokens->id[cur]) {
     // 変数
     case TNAME:
       if ((factor_type = parseVar()) == TPRERROR) return TPRERROR;
@@ -767,43 +904,43 @@ static TYPE_KIND parseFactor()
       break;
     case TSTRING:
       factor_type = type->ttype = TPCHAR;
-      if (cur->len != 1) return error("\nError at %d: Expected char", cur->line_no);
+      if (tokens->len[cur] != 1) return error("\nError at %d: Expected char", tokens->line_no[cur]);
       consumeToken(cur);
       break;
     case TLPAREN:
       consumeToken(cur);
       if ((factor_type = parseExpression()) == TPRERROR) return TPRERROR;
-      if (cur->id != TRPAREN) return error("\nError at %d: Expected ')'", cur->line_no);
+      if (tokens->id[cur] != TRPAREN) return error("\nError at %d: Expected ')'", tokens->line_no[cur]);
       consumeToken(cur);
       break;
     case TNOT:
       consumeToken(cur);
       if ((factor_type = parseFactor()) == TPRERROR) return TPRERROR;
-      if (factor_type != TPBOOL) return error("\nError at %d: Expected boolean", cur->line_no);
+      if (factor_type != TPBOOL) return error("\nError at %d: Expected boolean", tokens->line_no[cur]);
       break;
     case TINTEGER:
     case TBOOLEAN:
     case TCHAR:
-      factor_type = type->ttype = decodeIDtoTYPEKIND(cur->id, false);
+      factor_type = type->ttype = decodeIDtoTYPEKIND(tokens->id[cur], false);
       consumeToken(cur);
-      if (cur->id != TLPAREN) {
-        error("\nError at %d: Expected '('", cur->line_no);
+      if (tokens->id[cur] != TLPAREN) {
+        error("\nError at %d: Expected '('", tokens->line_no[cur]);
         return TPRERROR;
       }
       consumeToken(cur);
       if ((expression_type = parseExpression()) == TPRERROR) return TPRERROR;
       if (expression_type != TPINT && expression_type != TPCHAR && expression_type != TPBOOL) {
-        error("\nError at %d: Expected integer, char or boolean", cur->line_no);
+        error("\nError at %d: Expected integer, char or boolean", tokens->line_no[cur]);
         return TPRERROR;
       }
-      if (cur->id != TRPAREN) {
-        error("\nError at %d: Expected ')'", cur->line_no);
+      if (tokens->id[cur] != TRPAREN) {
+        error("\nError at %d: Expected ')'", tokens->line_no[cur]);
         return TPRERROR;
       }
       consumeToken(cur);
       break;
     default:
-      return error("\nError at %d: Expected factor", cur->line_no);
+      return error("\nError at %d: Expected factor", tokens->line_no[cur]);
       break;
   }
   return factor_type;
@@ -819,7 +956,7 @@ static int parseAssignment()
   TYPE_KIND var_type, expression_type;
   if ((var_type = parseVar()) == TPRERROR) return ERROR;
 
-  if (cur->id != TASSIGN) return error("\nError at %d: Expected ':='", cur->line_no);
+  if (tokens->id[cur] != TASSIGN) return error("\nError at %d: Expected ':='", tokens->line_no[cur]);
   consumeToken(cur);
 
   if ((expression_type = parseExpression()) == TPRERROR) return ERROR;
@@ -830,7 +967,7 @@ static int parseAssignment()
     0) {
     printf("var_type: %d, expression_type: %d\n", var_type, expression_type);
     return error(
-      "\nError at %d: Type mismatch. Expected %s but got %s", cur->line_no,
+      "\nError at %d: Type mismatch. Expected %s but got %s", tokens->line_no[cur],
       token_str[decodeTYPEKINDtoID(var_type)], token_str[decodeTYPEKINDtoID(expression_type)]);
   }
   return NORMAL;
@@ -844,24 +981,24 @@ static int parseAssignment()
 static int parseCondition()
 {
   TYPE_KIND condition_type;
-  if (cur->id != TIF) return error("\nError at %d: Expected 'if'", cur->line_no);
+  if (tokens->id[cur] != TIF) return error("\nError at %d: Expected 'if'", tokens->line_no[cur]);
   consumeToken(cur);
   if ((condition_type = parseExpression()) == TPRERROR) return ERROR;
   if (condition_type != TPBOOL && condition_type != TPARRAYBOOL)
     return error(
-      "\nError at %d: Expected boolean. But got %s", cur->line_no,
+      "\nError at %d: Expected boolean. But got %s", tokens->line_no[cur],
       token_str[decodeTYPEKINDtoID(condition_type)]);
-  if (cur->id != TTHEN) return error("\nError at %d: Expected 'then'", cur->line_no);
+  if (tokens->id[cur] != TTHEN) return error("\nError at %d: Expected 'then'", tokens->line_no[cur]);
   consumeToken(cur);
   at_bol = true;
-  bool is_begin = cur->id == TBEGIN;
+  bool is_begin = tokens->id[cur] == TBEGIN;
   if (!is_begin) indent_level++;
   if (parseStatement() == ERROR) return ERROR;
   if (!is_begin) indent_level--;
-  if (cur->id == TELSE) {
+  if (tokens->id[cur] == TELSE) {
     consumeToken(cur);
     at_bol = true;
-    is_begin = cur->id == TBEGIN;
+    is_begin = tokens->id[cur] == TBEGIN;
     if (!is_begin) indent_level++;
 
     if (parseStatement() == ERROR) return ERROR;
@@ -877,10 +1014,10 @@ static int parseCondition()
  */
 static int parseIteration()
 {
-  if (cur->id != TWHILE) return error("\nError at %d: Expected 'while'", cur->line_no);
+  if (tokens->id[cur] != TWHILE) return error("\nError at %d: Expected 'while'", tokens->line_no[cur]);
   consumeToken(cur);
   if (parseExpression() == TPRERROR) return ERROR;
-  if (cur->id != TDO) return error("\nError at %d: Expected 'do'", cur->line_no);
+  if (tokens->id[cur] != TDO) return error("\nError at %d: Expected 'do'", tokens->line_no[cur]);
   consumeToken(cur);
   iteration_level++;
   if (parseStatement() == ERROR) return ERROR;
@@ -894,59 +1031,62 @@ static int parseIteration()
  */
 static int parseCall()
 {
-  if (cur->id != TCALL) return error("\nError at %d: Expected 'call'", cur->line_no);
+  if (tokens->id[cur] != TCALL) return error("\nError at %d: Expected 'call'", tokens->line_no[cur]);
   consumeToken(cur);
-  if (cur->id != TNAME) return error("\nError at %d: Expected procedure name", cur->line_no);
-  ID * entry = lookupAndAddIref(cur->str, cur->line_no);
+  if (tokens->id[cur] != TNAME) return error("\nError at %d: Expected procedure name", tokens->line_no[cur]);
+  ID * entry = lookupAndAddIref(tokenStr(tokens, cur), tokens->line_no[cur]);
 
-  if (procname != NULL && strcmp(procname, cur->str) == 0) {
-    return error("\nError at %d: Recursive call", cur->line_no);
+  if (procname != NULL && strcmp(procname, tokenStr(tokens, cur)) == 0) {
+    return error("\nError at %d: Recursive call", tokens->line_no[cur]);
   }
 
   if (entry == NULL || entry->itp->ttype != TPPROC) {
-    return error("\nError at %d: Undefined procedure name %s", cur->line_no, cur->str);
+    return error(
+      "\nError at %d: Undefined procedure name %s", tokens->line_no[cur], tokenStr(tokens, cur));
   }
 
   consumeToken(cur);
 
   TYPE * param = entry->itp->paratp;
 
-  if (cur->id == TLPAREN) {
+  if (tokens->id[cur] == TLPAREN) {
     consumeToken(cur);
-    if (cur->id != TRPAREN) {
+    if (tokens->id[cur] != TRPAREN) {
       TYPE_KIND arg_type = parseExpression();
       if (arg_type == TPRERROR) return ERROR;
       if (param == NULL) {
-        return error("\nError at %d: Too many arguments for procedure %s", cur->line_no, cur->str);
+        return error(
+          "\nError at %d: Too many arguments for procedure %s", tokens->line_no[cur], tokenStr(tokens, cur));
       }
       if (arg_type != param->ttype) {
         return error(
-          "\nError at %d: Type mismatch in arguments for procedure %s", cur->line_no, cur->str);
+          "\nError at %d: Type mismatch in arguments for procedure %s", tokens->line_no[cur],
+          tokenStr(tokens, cur));
       }
       param = param->paratp;
 
-      while (cur->id == TCOMMA) {
+      while (tokens->id[cur] == TCOMMA) {
         consumeToken(cur);
         arg_type = parseExpression();
         if (arg_type == TPRERROR) return ERROR;
         if (param == NULL) {
           return error(
-            "\nError at %d: Too many arguments for procedure %s", cur->line_no, entry->name);
+            "\nError at %d: Too many arguments for procedure %s", tokens->line_no[cur], entry->name);
         }
         if (arg_type != param->ttype) {
           return error(
-            "\nError at %d: Type mismatch in arguments for procedure %s", cur->line_no,
+            "\nError at %d: Type mismatch in arguments for procedure %s", tokens->line_no[cur],
             entry->name);
         }
         param = param->paratp;
       }
     }
-    if (cur->id != TRPAREN) return error("\nError at %d: Expected ')'", cur->line_no);
+    if (tokens->id[cur] != TRPAREN) return error("\nError at %d: Expected ')'", tokens->line_no[cur]);
     consumeToken(cur);
   }
 
   if (param != NULL) {
-    return error("\nError at %d: Too few arguments for procedure %s", cur->line_no, entry->name);
+    return error("\nError at %d: Too few arguments for procedure %s", tokens->line_no[cur], entry->name);
   }
   return NORMAL;
 }
@@ -958,22 +1098,23 @@ static int parseCall()
  */
 static TYPE_KIND parseVar()
 {
-  if (cur->id != TNAME) return error("\nError at %d: Expected variable name", cur->line_no);
-  ID * entry = lookupAndAddIref(cur->str, cur->line_no);
+  if (tokens->id[cur] != TNAME) return error("\nError at %d: Expected variable name", tokens->line_no[cur]);
+  ID * entry = lookupAndAddIref(tokenStr(tokens, cur), tokens->line_no[cur]);
   if (entry == NULL)
-    return error("\nError at %d: Undefined variable name '%s'", cur->line_no, cur->str);
+    return error(
+      "\nError at %d: Undefined variable name '%s'", tokens->line_no[cur], tokenStr(tokens, cur));
 
   consumeToken(cur);
 
-  if (cur->id == TLSQPAREN) {
+  if (tokens->id[cur] == TLSQPAREN) {
     TYPE_KIND index_type;
     consumeToken(cur);
     if ((index_type = parseExpression()) == TPRERROR) return ERROR;
     if (index_type != TPINT)
       return error(
-        "\nError at %d: Expected integer. But got %s", cur->line_no,
+        "\nError at %d: Expected integer. But got %s", tokens->line_no[cur],
         token_str[decodeTYPEKINDtoID(index_type)]);
-    if (cur->id != TRSQPAREN) return error("\nError at %d: Expected ']'", cur->line_no);
+    if (tokens->id[cur] != TRSQPAREN) return error("\nError at %d: Expected ']'", tokens->line_no[cur]);
     consumeToken(cur);
     return entry->itp->etp->ttype;
   } else {
@@ -988,22 +1129,22 @@ static TYPE_KIND parseVar()
  */
 static int parseInput()
 {
-  if (cur->id != TREAD && cur->id != TREADLN)
-    return error("\nError at %d: Expected 'read' or 'readln'", cur->line_no);
+  if (tokens->id[cur] != TREAD && tokens->id[cur] != TREADLN)
+    return error("\nError at %d: Expected 'read' or 'readln'", tokens->line_no[cur]);
   consumeToken(cur);
-  if (cur->id == TLPAREN) {
+  if (tokens->id[cur] == TLPAREN) {
     TYPE_KIND var_type;
     consumeToken(cur);
     if ((var_type = parseVar()) == TPRERROR) return ERROR;
     if (var_type != TPINT && var_type != TPCHAR)
-      return error("\nError at %d: Expected integer", cur->line_no);
-    while (cur->id == TCOMMA) {
+      return error("\nError at %d: Expected integer", tokens->line_no[cur]);
+    while (tokens->id[cur] == TCOMMA) {
       consumeToken(cur);
       if ((var_type = parseVar()) == TPRERROR) return ERROR;
       if (var_type != TPINT && var_type != TPCHAR)
-        return error("\nError at %d: Expected integer", cur->line_no);
+        return error("\nError at %d: Expected integer", tokens->line_no[cur]);
     }
-    if (cur->id != TRPAREN) return error("\nError at %d: Expected ')'", cur->line_no);
+    if (tokens->id[cur] != TRPAREN) return error("\nError at %d: Expected ')'", tokens->line_no[cur]);
     consumeToken(cur);
   }
   return NORMAL;
@@ -1017,16 +1158,16 @@ static int parseInput()
 static int parseOutputFormat()
 {
   TYPE_KIND expression_type;
-  if (cur->id == TSTRING && cur->len != 1) {
+  if (tokens->id[cur] == TSTRING && tokens->len[cur] != 1) {
     consumeToken(cur);
   } else if ((expression_type = parseExpression()) != TPRERROR) {
     if (expression_type == TPRERROR)
       return error(
-        "\nError at %d: Expected 'integer', 'char' or 'boolean' but got %s", cur->line_no,
+        "\nError at %d: Expected 'integer', 'char' or 'boolean' but got %s", tokens->line_no[cur],
         token_str[decodeTYPEKINDtoID(expression_type)]);
-    if (cur->id != TCOLON) return NORMAL;
+    if (tokens->id[cur] != TCOLON) return NORMAL;
     consumeToken(cur);
-    if (cur->id != TNUMBER) return error("\nError at %d: Expected number", cur->line_no);
+    if (tokens->id[cur] != TNUMBER) return error("\nError at %d: Expected number", tokens->line_no[cur]);
     consumeToken(cur);
   } else
     return ERROR;
@@ -1040,19 +1181,19 @@ static int parseOutputFormat()
  */
 static int parseOutputStatement()
 {
-  if (cur->id != TWRITE && cur->id != TWRITELN)
-    return error("\nError at %d: Expected 'write' or 'writeln'", cur->line_no);
+  if (tokens->id[cur] != TWRITE && tokens->id[cur] != TWRITELN)
+    return error("\nError at %d: Expected 'write' or 'writeln'", tokens->line_no[cur]);
   consumeToken(cur);
 
-  if (cur->id != TLPAREN) return NORMAL;
+  if (tokens->id[cur] != TLPAREN) return NORMAL;
   consumeToken(cur);
   if (parseOutputFormat() == ERROR) return ERROR;
 
-  while (cur->id == TCOMMA) {
+  while (tokens->id[cur] == TCOMMA) {
     consumeToken(cur);
     if (parseOutputFormat() == ERROR) return ERROR;
   }
-  if (cur->id != TRPAREN) return error("\nError at %d: Expected ')'", cur->line_no);
+  if (tokens->id[cur] != TRPAREN) return error("\nError at %d: Expected ')'", tokens->line_no[cur]);
   consumeToken(cur);
   return NORMAL;
 }
@@ -1064,7 +1205,7 @@ static int parseOutputStatement()
  */
 static int parseStatement()
 {
-  switch (cur->id) {
+  switch (tokens->id[cur]) {
     // 代入文
     case TNAME:
       if (parseAssignment() == ERROR) return ERROR;
@@ -1080,7 +1221,7 @@ static int parseStatement()
     // 脱出文
     case TBREAK:
       if (iteration_level == 0)
-        return error("\nError at %d: 'break' statement not within loop", cur->line_no);
+        return error("\nError at %d: 'break' statement not within loop", tokens->line_no[cur]);
       consumeToken(cur);
       break;
     // 手続き呼び出し文
@@ -1122,19 +1263,19 @@ static int parseStatement()
  */
 static int parseCompoundStatement()
 {
-  if (cur->id != TBEGIN) return error("\nError at %d: Expected 'begin'", cur->line_no);
+  if (tokens->id[cur] != TBEGIN) return error("\nError at %d: Expected 'begin'", tokens->line_no[cur]);
 
   consumeToken(cur);
   indent_level++;
   at_bol = true;
 
   if (parseStatement() == ERROR) return ERROR;
-  while (cur->id == TSEMI) {
+  while (tokens->id[cur] == TSEMI) {
     consumeToken(cur);
     at_bol = true;
     if (parseStatement() == ERROR) return ERROR;
   }
-  if (cur->id != TEND) return error("\nError at %d: Expected 'end'", cur->line_no);
+  if (tokens->id[cur] != TEND) return error("\nError at %d: Expected 'end'", tokens->line_no[cur]);
   indent_level--;
   consumeToken(cur);
 
@@ -1152,7 +1293,7 @@ static int registerProcedureParameters(const char * procname, TYPE * param_type_
 {
   // 手続きの ID を取得
   ID * procnode = getValueFromHashMap(globalid, procname);
-  if (procnode == NULL) return error("\nError at %d: Undefined procedure name", cur->line_no);
+  if (procnode == NULL) return error("\nError at %d: Undefined procedure name", tokens->line_no[cur]);
 
   // 仮引数の型リストを設定
   procnode->itp->paratp = param_type_list;
@@ -1166,7 +1307,7 @@ static int registerProcedureParameters(const char * procname, TYPE * param_type_
  */
 static int parseFormalParamters()
 {
-  if (cur->id != TLPAREN) return error("\nError at %d: Expected '('", cur->line_no);
+  if (tokens->id[cur] != TLPAREN) return error("\nError at %d: Expected '('", tokens->line_no[cur]);
   consumeToken(cur);
 
   TYPE * param_type_list = NULL;  // 仮引数の型リストの先頭
@@ -1174,13 +1315,13 @@ static int parseFormalParamters()
 
   do {
     if (parseVarNames() == ERROR)
-      return error("\nError at %d: Expected variable name", cur->line_no);
+      return error("\nError at %d: Expected variable name", tokens->line_no[cur]);
 
-    if (cur->id != TCOLON) return error("\nError at %d: Expected ':'", cur->line_no);
+    if (tokens->id[cur] != TCOLON) return error("\nError at %d: Expected ':'", tokens->line_no[cur]);
     consumeToken(cur);
 
-    if (!isStdType()) return error("\nError at %d: Expected type", cur->line_no);
-    int vartype = decodeIDtoTYPEKIND(cur->id, false);
+    if (!isStdType()) return error("\nError at %d: Expected type", tokens->line_no[cur]);
+    int vartype = decodeIDtoTYPEKIND(tokens->id[cur], false);
     consumeToken(cur);
 
     // 仮引数名ごとに型を設定
@@ -1200,12 +1341,13 @@ static int parseFormalParamters()
       if (getValueFromHashMap(localid, var.varname) == NULL) {
         ID * param_id = newID(var.varname, procname, param_type, true, var.line_no);
         insertToHashMap(localid, var.varname, param_id);
+        addSymbol(param_id);
       }
     }
 
-  } while (cur->id == TSEMI && (consumeToken(cur), true));
+  } while (tokens->id[cur] == TSEMI && (consumeToken(cur), true));
 
-  if (cur->id != TRPAREN) return error("\nError at %d: Expected ')'", cur->line_no);
+  if (tokens->id[cur] != TRPAREN) return error("\nError at %d: Expected ')'", tokens->line_no[cur]);
   consumeToken(cur);
 
   // 仮引数の型リストを登録する関数を呼び出す
@@ -1221,36 +1363,38 @@ static int parseFormalParamters()
  */
 static int parseSubProgram()
 {
-  if (cur->id != TPROCEDURE) return error("\nError at %d: Expected 'procedure'", cur->line_no);
+  if (tokens->id[cur] != TPROCEDURE) return error("\nError at %d: Expected 'procedure'", tokens->line_no[cur]);
   // ローカルなスコープに入る
   enterScope();
   indent_level = 1;
   consumeToken(cur);
 
-  if (cur->id != TNAME) return error("\nError at %d: Expected procedure name", cur->line_no);
+  if (tokens->id[cur] != TNAME) return error("\nError at %d: Expected procedure name", tokens->line_no[cur]);
 
-  if (getValueFromHashMap(globalid, cur->str) != NULL)
-    return error("\nError at %d: Procedure name %s already defined", cur->line_no, cur->str);
+  if (getValueFromHashMap(globalid, tokenStr(tokens, cur)) != NULL)
+    return error(
+      "\nError at %d: Procedure name %s already defined", tokens->line_no[cur], tokenStr(tokens, cur));
 
   type = newType(TPPROC, -1, NULL, NULL);
-  node = newID(cur->str, NULL, type, false, cur->line_no);
-  insertToHashMap(globalid, cur->str, node);
+  node = newID(tokenStr(tokens, cur), NULL, type, false, tokens->line_no[cur]);
+  insertToHashMap(globalid, tokenStr(tokens, cur), node);
+  addSymbol(node);
 
-  procname = strdup(cur->str);
+  procname = tokenStr(tokens, cur);
 
   consumeToken(cur);
 
-  if (cur->id == TLPAREN) parseFormalParamters();
+  if (tokens->id[cur] == TLPAREN) parseFormalParamters();
 
-  if (cur->id != TSEMI) return error("\nError at %d: Expected ';'", cur->line_no);
+  if (tokens->id[cur] != TSEMI) return error("\nError at %d: Expected ';'", tokens->line_no[cur]);
   consumeToken(cur);
 
-  if (cur->id == TVAR)
+  if (tokens->id[cur] == TVAR)
     if (parseVarDeclaration() == ERROR) return ERROR;
 
   if (parseCompoundStatement() == ERROR) return ERROR;
 
-  if (cur->id != TSEMI) return error("\nError at %d: Expected ';'", cur->line_no);
+  if (tokens->id[cur] != TSEMI) return error("\nError at %d: Expected ';'", tokens->line_no[cur]);
   consumeToken(cur);
   indent_level--;
   exitScope();
@@ -1265,12 +1409,12 @@ static int parseSubProgram()
 static int parseBlock()
 {
   for (;;) {
-    if (cur->id == TVAR) {
+    if (tokens->id[cur] == TVAR) {
       // 変数宣言部は行頭から1段落付けされる。
       // parseVarDeclaration内でインクリメントされるので0にして辻褄を合わせる。
       indent_level = 0;
       if (parseVarDeclaration() == ERROR) return ERROR;
-    } else if (cur->id == TPROCEDURE) {
+    } else if (tokens->id[cur] == TPROCEDURE) {
       if (parseSubProgram() == ERROR) return ERROR;
     } else
       break;
@@ -1287,19 +1431,19 @@ static int parseBlock()
  */
 static int parseProgram()
 {
-  if (cur->id != TPROGRAM)
-    return error("\nError at %d: Expected 'program' at the beginning of the program", cur->line_no);
+  if (tokens->id[cur] != TPROGRAM)
+    return error("\nError at %d: Expected 'program' at the beginning of the program", tokens->line_no[cur]);
   consumeToken(cur);
 
-  if (cur->id != TNAME) return error("\nError at %d: Expected program name", cur->line_no);
+  if (tokens->id[cur] != TNAME) return error("\nError at %d: Expected program name", tokens->line_no[cur]);
   consumeToken(cur);
 
-  if (cur->id != TSEMI)
-    return error("\nError at %d: Expected ';' at the end of the program name.", cur->line_no);
+  if (tokens->id[cur] != TSEMI)
+    return error("\nError at %d: Expected ';' at the end of the program name.", tokens->line_no[cur]);
   consumeToken(cur);
 
   if (parseBlock() == ERROR) return ERROR;
-  if (cur->id != TDOT) return error("\nError at %d: Expected '.'", cur->line_no);
+  if (tokens->id[cur] != TDOT) return error("\nError at %d: Expected '.'", tokens->line_no[cur]);
   consumeToken(cur);
 
   return NORMAL;
@@ -1308,22 +1452,74 @@ static int parseProgram()
 /**
  * @brief 構文解析を行う関数
  * 
- * @param tok トークンの連結リストの先頭を示すポインタ
+ * @param tok 字句解析の結果のトークン列
  */
-int parse(Token * tok)
+int parse(TokenArray * tok)
 {
-  cur = tok;
-  globalid = newHashMap(HASHSIZE);
+  tokens = tok;
+  cur = 0;
+  parse_arena = newArena();
+  globalid = newHashMap(HASHMAP_MIN_CAPACITY);
   current_id = &globalid;
-  symbol_buf = malloc(sizeof(SymbolBuffer));
   VARNAME_init(&varname_stack);
   if (parseProgram() == ERROR) {
     error("Parser aborted with error.");
     return ERROR;
   }
-  printCrossreferenceTable(globalid);
-  if (crossref_buf != NULL) symbol_buf->buf = strdup(crossref_buf);
+  if (crossref_enabled) printCrossreferenceTable(globalid);
   return NORMAL;
 }
 
-SymbolBuffer * getCrossrefBuf() { return symbol_buf; }
\ No newline at end of file
+/**
+ * @brief 構文解析で宣言された名前の記号表を返す
+ * 
+ * @return SymbolTable* 記号表
+ */
+SymbolTable * getSymbolTable() { return &symbol_table; }
+
+/**
+ * @brief 記号表と、構文解析のアリーナに確保した型情報や名前のエントリをまとめて解放する関数
+ * コード生成と集計の出力が記号表を参照し終えた後に呼ぶ。名前の文字列は字句解析のアリーナにあるので残る
+ */
+void freeSymbolTable()
+{
+  free(symbol_table.symbols);
+  free(symbol_table.buckets);
+  symbol_table = (SymbolTable){NULL, 0, 0, NULL, 0};
+  freeHashMap(globalid);
+  globalid = NULL;
+  freeArena(parse_arena);
+  parse_arena = NULL;
+}
+
+/**
+ * @brief 記号表から名前を探す
+ * 名前とプロシージャ名はtokenStrでインターンされた文字列であり、ポインタが等しければ同じ名前である
+ * @param name 探したい名前
+ * @param proc 局所的な名前を探す場合はプロシージャ名。大域的な名前を探す場合はNULL
+ * @return Symbol* 見つかった場合はその要素を返す。見つからなかった場合はNULLを返す。
+ */
+Symbol * findSymbol(const char * name, const char * proc)
+{
+  if (symbol_table.bucket_count == 0) return NULL;
+  unsigned int mask = symbol_table.bucket_count - 1;
+  for (unsigned int i = hashSymbolKey(name, proc) & mask; symbol_table.buckets[i] != -1;
+       i = (i + 1) & mask) {
+    Symbol * symbol = &symbol_table.symbols[symbol_table.buckets[i]];
+    if (symbol->name == name && symbol->procname == proc) return symbol;
+  }
+  return NULL;
+}
+
+/**
+ * @brief 構文解析時にクロスリファレンス表を文字列として生成するようにする
+ * 
+ */
+void enableCrossref() { crossref_enabled = true; }
+
+/**
+ * @brief クロスリファレンス表の文字列を返す
+ * 
+ * @return char* クロスリファレンス表。生成していない場合はNULL
+ */
+char * getCrossref() { return crossref_buf; }
\ No newline at end of file
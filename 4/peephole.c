@@ -0,0 +1,667 @@
+#include "peephole.h"
+
+#include "arena.h"
+#include "lpp.h"
+
+/**
+ * @file
+ * 覗き穴最適化を実装している
+ *
+ * 変換はいずれも基本ブロックの中に閉じている。ラベル、分岐、CALL、RET、SVCと
+ * 擬似命令はブロックの境界として扱い、境界を越えてレジスタの値を追跡しない。
+ * コード生成は条件分岐の直前に必ずCPAを置くので、フラグは境界を越えて使われないが、
+ * フラグを設定する命令を省く場合は念のため後続の条件分岐がその値を使わないことを確かめる。
+ */
+
+/**
+ * @def MAX_PEEPHOLE_PASSES
+ * 変換を繰り返す回数の上限
+ */
+#define MAX_PEEPHOLE_PASSES 16
+
+/**
+ * @def MAX_OPERAND_FIELDS
+ * オペランドをコンマで区切った要素の数の上限
+ */
+#define MAX_OPERAND_FIELDS 3
+
+//! 行の種類
+typedef enum {
+  //! コメントや空行
+  LINE_COMMENT,
+  //! ラベルだけの行
+  LINE_LABEL,
+  //! 命令や擬似命令の行。ラベルを持つこともある
+  LINE_CODE,
+} LineKind;
+
+//! 命令列の1行。文字列は出力バッファか、書き換えた場合はアリーナを指す
+typedef struct
+{
+  //! 行の種類
+  LineKind kind;
+  //! 行全体。改行は含まない
+  const char * text;
+  //! 行全体の長さ
+  int text_len;
+  //! ラベル
+  const char * label;
+  //! ラベルの長さ。ラベルがない場合は0
+  int label_len;
+  //! 命令コード
+  const char * opcode;
+  //! 命令コードの長さ
+  int opcode_len;
+  //! オペランド
+  const char * operand;
+  //! オペランドの長さ。オペランドがない場合は0
+  int operand_len;
+  //! 書き換えた行かどうか。書き換えた行はラベル、命令コード、オペランドから組み立てて出力する
+  bool modified;
+  //! 削除した行かどうか
+  bool deleted;
+} Line;
+
+//! オペランドをコンマで区切った要素
+typedef struct
+{
+  //! 要素の先頭
+  const char * str;
+  //! 要素の長さ
+  int len;
+} Field;
+
+//! 命令の性質
+typedef struct
+{
+  //! 命令コード
+  const char * name;
+  //! 第1オペランドのレジスタに書き込むかどうか
+  bool writes;
+  //! 第1オペランドのレジスタを読むかどうか
+  bool reads_first;
+  //! フラグを設定するかどうか
+  bool sets_flags;
+} OpInfo;
+
+//! ブロックの中に現れてよい命令の性質。ここにない命令はブロックの境界として扱う
+static const OpInfo op_infos[] = {
+    {"LD", true, false, true},    {"LAD", true, false, false},  {"ST", false, true, false},
+    {"ADDA", true, true, true},   {"ADDL", true, true, true},   {"SUBA", true, true, true},
+    {"SUBL", true, true, true},   {"MULA", true, true, true},   {"MULL", true, true, true},
+    {"DIVA", true, true, true},   {"DIVL", true, true, true},   {"AND", true, true, true},
+    {"OR", true, true, true},     {"XOR", true, true, true},    {"SLA", true, true, true},
+    {"SRA", true, true, true},    {"SLL", true, true, true},    {"SRL", true, true, true},
+    {"CPA", false, true, true},   {"CPL", false, true, true},   {"PUSH", false, false, false},
+    {"POP", true, false, false},  {"NOP", false, false, false},
+};
+
+//! 変換規則の名前
+static const char * const pattern_names[NUM_PEEPHOLE_PATTERNS] = {
+    "push-pop", "load-after-store", "dead-load", "copy-folding", "jump-to-next", "jump-threading", "unreachable",
+    "dead-label"};
+
+//! 変換規則ごとの適用回数
+static long pattern_hits[NUM_PEEPHOLE_PATTERNS];
+
+//! 最適化の前後の命令数
+static long instructions_before, instructions_after;
+
+//! 命令列
+static Line * lines;
+
+//! 命令列の行数
+static int num_lines;
+
+//! 書き換えた行の文字列を確保するアリーナ
+static Arena * peephole_arena;
+
+//! 生成したラベルを番号から引いて、定義している行の位置を返す表。定義されていない場合は-1
+static int * label_lines;
+
+//! 生成したラベルを番号から引いて、参照されている回数を返す表
+static int * label_refs;
+
+//! label_linesとlabel_refsの大きさ
+static int num_labels;
+
+//! 文字列が命令コードと一致するかを判定する関数
+static bool isOp(const Line * line, const char * name)
+{
+  return line->kind == LINE_CODE && (int)strlen(name) == line->opcode_len &&
+         memcmp(line->opcode, name, line->opcode_len) == 0;
+}
+
+//! 命令の性質を返す関数。ブロックの中に現れてよい命令でない場合はNULLを返す
+static const OpInfo * findOp(const Line * line)
+{
+  if (line->kind != LINE_CODE) return NULL;
+  for (size_t i = 0; i < sizeof(op_infos) / sizeof(op_infos[0]); i++) {
+    if (isOp(line, op_infos[i].name)) return &op_infos[i];
+  }
+  return NULL;
+}
+
+//! 分岐命令かどうかを判定する関数
+static bool isJump(const Line * line)
+{
+  return isOp(line, "JUMP") || isOp(line, "JPL") || isOp(line, "JMI") || isOp(line, "JNZ") || isOp(line, "JZE") ||
+         isOp(line, "JOV");
+}
+
+//! フラグを読む条件分岐命令かどうかを判定する関数
+static bool isConditionalJump(const Line * line) { return isJump(line) && !isOp(line, "JUMP"); }
+
+//! 行がブロックの境界かどうかを判定する関数
+static bool isBoundary(const Line * line) { return line->label_len > 0 || findOp(line) == NULL; }
+
+//! 擬似命令ではない機械語命令の行かどうかを判定する関数
+static bool isInstruction(const Line * line)
+{
+  return line->kind == LINE_CODE && !isOp(line, "START") && !isOp(line, "END") && !isOp(line, "DC") &&
+         !isOp(line, "DS");
+}
+
+/**
+ * @brief オペランドをコンマで区切る関数。文字列定数の中のコンマでは区切らない
+ *
+ * @param line 行
+ * @param fields 区切った要素を格納する配列
+ * @return int 要素の数。MAX_OPERAND_FIELDSより多い場合は-1
+ */
+static int splitOperand(const Line * line, Field fields[MAX_OPERAND_FIELDS])
+{
+  if (line->operand_len == 0) return 0;
+  int count = 0;
+  bool quoted = false;
+  const char * start = line->operand;
+  for (int i = 0; i <= line->operand_len; i++) {
+    if (i < line->operand_len && line->operand[i] == '\'') quoted = !quoted;
+    if (i < line->operand_len && (quoted || line->operand[i] != ',')) continue;
+    if (count == MAX_OPERAND_FIELDS) return -1;
+    fields[count].str = start;
+    fields[count].len = (int)(line->operand + i - start);
+    count++;
+    start = line->operand + i + 1;
+  }
+  return count;
+}
+
+//! 要素が汎用レジスタの場合にその番号を返す関数。そうでない場合は-1を返す
+static int regOf(Field field)
+{
+  if (field.len != 3 || field.str[0] != 'G' || field.str[1] != 'R') return -1;
+  if (field.str[2] < '0' || field.str[2] > '7') return -1;
+  return field.str[2] - '0';
+}
+
+//! 要素がコード生成の作ったラベル(Lと数字の並び)の場合にその番号を返す関数。そうでない場合は-1を返す
+static int labelNumOf(const char * str, int len)
+{
+  if (len < 2 || str[0] != 'L') return -1;
+  int num = 0;
+  for (int i = 1; i < len; i++) {
+    if (!isdigit((unsigned char)str[i])) return -1;
+    num = num * 10 + (str[i] - '0');
+  }
+  return num;
+}
+
+//! 命令が書き込むレジスタの番号を返す関数。書き込まない場合は-1を返す
+static int writtenReg(const Line * line)
+{
+  const OpInfo * info = findOp(line);
+  Field fields[MAX_OPERAND_FIELDS];
+  if (info == NULL || !info->writes || splitOperand(line, fields) < 1) return -1;
+  return regOf(fields[0]);
+}
+
+//! 命令がレジスタregを読むかどうかを判定する関数。性質の分からない命令は全てのレジスタを読むとみなす
+static bool readsReg(const Line * line, int reg)
+{
+  const OpInfo * info = findOp(line);
+  Field fields[MAX_OPERAND_FIELDS];
+  int count = splitOperand(line, fields);
+  if (info == NULL || count < 0) return true;
+  for (int i = info->reads_first ? 0 : 1; i < count; i++) {
+    if (regOf(fields[i]) == reg) return true;
+  }
+  return false;
+}
+
+//! 削除していない次の行の位置を返す関数。コメントの行は飛ばす
+static int nextLine(int i)
+{
+  for (i++; i < num_lines; i++) {
+    if (!lines[i].deleted && lines[i].kind != LINE_COMMENT) return i;
+  }
+  return num_lines;
+}
+
+//! 行iの直後のフラグを、後続の条件分岐が使うかどうかを判定する関数
+static bool flagsNeeded(int i)
+{
+  for (int j = nextLine(i); j < num_lines; j = nextLine(j)) {
+    if (lines[j].kind == LINE_LABEL) continue;
+    if (isConditionalJump(&lines[j])) return true;
+    const OpInfo * info = findOp(&lines[j]);
+    if (info == NULL || info->sets_flags) return false;
+  }
+  return false;
+}
+
+//! 行iの直後でレジスタregの値が読まれずに上書きされるかどうかを判定する関数。ブロックの終わりまで分からない場合はfalse
+static bool isRegDeadAfter(int i, int reg)
+{
+  for (int j = nextLine(i); j < num_lines; j = nextLine(j)) {
+    if (isBoundary(&lines[j]) || readsReg(&lines[j], reg)) return false;
+    if (writtenReg(&lines[j]) == reg) return true;
+  }
+  return false;
+}
+
+//! 行を削除する関数
+static void deleteLine(int i) { lines[i].deleted = true; }
+
+//! 行のオペランドを書き換える関数
+static void rewriteOperand(int i, const char * operand, int operand_len)
+{
+  lines[i].operand = arenaStrndup(peephole_arena, operand, operand_len);
+  lines[i].operand_len = operand_len;
+  lines[i].modified = true;
+}
+
+//! 行の命令コードとオペランドを書き換える関数
+static void rewriteLine(int i, const char * opcode, const char * operand, int operand_len)
+{
+  lines[i].opcode = opcode;
+  lines[i].opcode_len = (int)strlen(opcode);
+  rewriteOperand(i, operand, operand_len);
+}
+
+//! 行をレジスタ間の転送命令に書き換える関数
+static void rewriteRegs(int i, const char * opcode, int dst, int src)
+{
+  char operand[16];
+  int len = snprintf(operand, sizeof(operand), strcmp(opcode, "LAD") == 0 ? "GR%d,0,GR%d" : "GR%d,GR%d", dst, src);
+  rewriteLine(i, opcode, operand, len);
+}
+
+/**
+ * @brief PUSH 0,GRa と POP GRb の組を、PUSHの位置での LD GRb,GRa に置き換える
+ * 間の命令がGRbを使わなければ、GRbにはPOPと同じ値が入る。GRaとGRbが同じ場合は、間でGRaが変わらなければ両方を省く
+ * @param i PUSHの行の位置
+ * @return bool 置き換えた場合はtrue
+ */
+static bool foldPushPop(int i)
+{
+  Field fields[MAX_OPERAND_FIELDS];
+  if (!isOp(&lines[i], "PUSH") || splitOperand(&lines[i], fields) != 2) return false;
+  if (fields[0].len != 1 || fields[0].str[0] != '0') return false;
+  int src = regOf(fields[1]);
+  if (src < 0) return false;
+
+  bool flags_set = false;
+  int j;
+  for (j = nextLine(i); j < num_lines; j = nextLine(j)) {
+    if (isBoundary(&lines[j]) || isOp(&lines[j], "PUSH")) return false;
+    if (isOp(&lines[j], "POP")) break;
+    flags_set |= findOp(&lines[j])->sets_flags;
+  }
+  if (j == num_lines) return false;
+  int dst = writtenReg(&lines[j]);
+  if (dst < 0) return false;
+  for (int k = nextLine(i); k < j; k = nextLine(k)) {
+    if (writtenReg(&lines[k]) == dst || (dst != src && readsReg(&lines[k], dst))) return false;
+  }
+
+  if (dst == src) {
+    deleteLine(i);
+  } else {
+    // POPはフラグを変えないので、POPの後でフラグが使われる場合はフラグを変えないLADで転送する
+    rewriteRegs(i, !flags_set && flagsNeeded(j) ? "LAD" : "LD", dst, src);
+  }
+  deleteLine(j);
+  return true;
+}
+
+/**
+ * @brief ST GRa,adr の直後の LD GRb,adr を省くか、レジスタ間の転送に置き換える
+ *
+ * @param i STの行の位置
+ * @return bool 置き換えた場合はtrue
+ */
+static bool foldLoadAfterStore(int i)
+{
+  Field store[MAX_OPERAND_FIELDS], load[MAX_OPERAND_FIELDS];
+  if (!isOp(&lines[i], "ST") || splitOperand(&lines[i], store) < 2) return false;
+  int j = nextLine(i);
+  if (j == num_lines || lines[j].label_len > 0 || !isOp(&lines[j], "LD")) return false;
+  if (splitOperand(&lines[j], load) < 2 || regOf(load[1]) >= 0) return false;
+
+  // 第1オペランドより後ろの番地の指定が一致するかを比べる
+  int store_rest = lines[i].operand_len - (int)(store[1].str - lines[i].operand);
+  int load_rest = lines[j].operand_len - (int)(load[1].str - lines[j].operand);
+  if (store_rest != load_rest || memcmp(store[1].str, load[1].str, store_rest) != 0) return false;
+
+  int src = regOf(store[0]), dst = regOf(load[0]);
+  if (src < 0 || dst < 0) return false;
+  if (src == dst && !flagsNeeded(j)) {
+    deleteLine(j);
+  } else {
+    rewriteRegs(j, "LD", dst, src);
+  }
+  return true;
+}
+
+/**
+ * @brief 読まれずに上書きされるレジスタへのLDとLADを省く
+ *
+ * @param i LDかLADの行の位置
+ * @return bool 省いた場合はtrue
+ */
+static bool removeDeadLoad(int i)
+{
+  if (!isOp(&lines[i], "LD") && !isOp(&lines[i], "LAD")) return false;
+  int reg = writtenReg(&lines[i]);
+  if (reg < 0 || !isRegDeadAfter(i, reg)) return false;
+  if (isOp(&lines[i], "LD") && flagsNeeded(i)) return false;
+  deleteLine(i);
+  return true;
+}
+
+/**
+ * @brief LD GRa,adr と LD GRb,GRa の組で、その後GRaが使われない場合に LD GRb,adr にまとめる
+ *
+ * @param i 1つ目の命令の行の位置
+ * @return bool まとめた場合はtrue
+ */
+static bool foldCopy(int i)
+{
+  Field fields[MAX_OPERAND_FIELDS], copy[MAX_OPERAND_FIELDS];
+  if (!isOp(&lines[i], "LD") && !isOp(&lines[i], "LAD")) return false;
+  if (splitOperand(&lines[i], fields) < 2) return false;
+  int src = regOf(fields[0]);
+  int j = nextLine(i);
+  if (src < 0 || j == num_lines || lines[j].label_len > 0 || !isOp(&lines[j], "LD")) return false;
+  if (splitOperand(&lines[j], copy) != 2 || regOf(copy[1]) != src) return false;
+  int dst = regOf(copy[0]);
+  if (dst < 0 || dst == src || !isRegDeadAfter(j, src)) return false;
+  // LADはフラグを変えないので、転送で設定したフラグが使われる場合はまとめられない
+  if (isOp(&lines[i], "LAD") && flagsNeeded(j)) return false;
+
+  char operand[MAXSTRSIZE];
+  int rest = lines[i].operand_len - (int)(fields[1].str - lines[i].operand);
+  int len = snprintf(operand, sizeof(operand), "GR%d,%.*s", dst, rest, fields[1].str);
+  if (len >= (int)sizeof(operand)) return false;
+  rewriteOperand(i, operand, len);
+  deleteLine(j);
+  return true;
+}
+
+//! 分岐命令の分岐先のラベルの番号を返す関数。コード生成の作ったラベルへの分岐でない場合は-1を返す
+static int jumpTarget(const Line * line)
+{
+  Field fields[MAX_OPERAND_FIELDS];
+  if (!isJump(line) || splitOperand(line, fields) != 1) return -1;
+  int num = labelNumOf(fields[0].str, fields[0].len);
+  return num < num_labels ? num : -1;
+}
+
+/**
+ * @brief 直後のラベルへの分岐を省く
+ *
+ * @param i 分岐命令の行の位置
+ * @return bool 省いた場合はtrue
+ */
+static bool removeJumpToNext(int i)
+{
+  int target = jumpTarget(&lines[i]);
+  if (target < 0) return false;
+  for (int j = nextLine(i); j < num_lines && lines[j].kind == LINE_LABEL; j = nextLine(j)) {
+    if (labelNumOf(lines[j].label, lines[j].label_len) == target) {
+      deleteLine(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief 分岐先のラベルの最初の命令が無条件分岐の場合に、その分岐先へ直接分岐させる
+ *
+ * @param i 分岐命令の行の位置
+ * @return bool 分岐先を書き換えた場合はtrue
+ */
+static bool threadJump(int i)
+{
+  int target = jumpTarget(&lines[i]);
+  if (target < 0 || label_lines[target] < 0) return false;
+  int j = nextLine(label_lines[target]);
+  while (j < num_lines && lines[j].kind == LINE_LABEL) j = nextLine(j);
+  if (j == num_lines || !isOp(&lines[j], "JUMP")) return false;
+  int next_target = jumpTarget(&lines[j]);
+  if (next_target < 0 || next_target == target) return false;
+  rewriteOperand(i, lines[j].operand, lines[j].operand_len);
+  return true;
+}
+
+/**
+ * @brief 無条件分岐や戻りの後にある、ラベルのない命令を省く
+ *
+ * @param i 命令の行の位置
+ * @return bool 省いた場合はtrue
+ */
+static bool removeUnreachable(int i)
+{
+  if (!isOp(&lines[i], "JUMP") && !isOp(&lines[i], "RET")) return false;
+  bool removed = false;
+  for (int j = nextLine(i); j < num_lines; j = nextLine(j)) {
+    if (lines[j].label_len > 0 || !isInstruction(&lines[j])) break;
+    deleteLine(j);
+    pattern_hits[PEEPHOLE_UNREACHABLE]++;
+    removed = true;
+  }
+  return removed;
+}
+
+//! 出力バッファの範囲を1行ずつの命令列に分解する関数
+static void splitLines(const char * buf, size_t len)
+{
+  int capacity = 1024;
+  lines = malloc(sizeof(Line) * capacity);
+  if (lines == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  num_lines = 0;
+  const char * end = buf + len;
+  for (const char * p = buf; p < end;) {
+    const char * eol = memchr(p, '\n', end - p);
+    if (eol == NULL) eol = end;
+    if (num_lines == capacity) {
+      capacity *= 2;
+      lines = realloc(lines, sizeof(Line) * capacity);
+      if (lines == NULL) {
+        error("Memory allocation error");
+        exit(1);
+      }
+    }
+    Line * line = &lines[num_lines++];
+    memset(line, 0, sizeof(Line));
+    line->text = p;
+    line->text_len = (int)(eol - p);
+
+    if (p == eol || *p == ';') {
+      line->kind = LINE_COMMENT;
+    } else {
+      const char * q = p;
+      while (q < eol && *q != '\t' && *q != ' ') q++;
+      line->label = p;
+      line->label_len = (int)(q - p);
+      while (q < eol && (*q == '\t' || *q == ' ')) q++;
+      line->opcode = q;
+      while (q < eol && *q != '\t' && *q != ' ') q++;
+      line->opcode_len = (int)(q - line->opcode);
+      while (q < eol && (*q == '\t' || *q == ' ')) q++;
+      const char * operand_end = eol;
+      while (operand_end > q && (operand_end[-1] == ' ' || operand_end[-1] == '\t')) operand_end--;
+      line->operand = q;
+      line->operand_len = (int)(operand_end - q);
+      line->kind = line->opcode_len > 0 ? LINE_CODE : LINE_LABEL;
+    }
+    p = eol + 1;
+  }
+}
+
+//! 生成したラベルの定義位置と参照回数の表を作り直す関数
+static void indexLabels()
+{
+  for (int i = 0; i < num_labels; i++) {
+    label_lines[i] = -1;
+    label_refs[i] = 0;
+  }
+  for (int i = 0; i < num_lines; i++) {
+    if (lines[i].deleted) continue;
+    int num = labelNumOf(lines[i].label, lines[i].label_len);
+    if (num >= 0 && num < num_labels) label_lines[num] = i;
+
+    Field fields[MAX_OPERAND_FIELDS];
+    int count = lines[i].kind == LINE_CODE ? splitOperand(&lines[i], fields) : 0;
+    for (int k = 0; k < count; k++) {
+      num = labelNumOf(fields[k].str, fields[k].len);
+      if (num >= 0 && num < num_labels) label_refs[num]++;
+    }
+  }
+}
+
+//! 生成したラベルの番号の最大値に合わせて、ラベルの表を確保する関数
+static void allocateLabels()
+{
+  num_labels = 0;
+  for (int i = 0; i < num_lines; i++) {
+    int num = labelNumOf(lines[i].label, lines[i].label_len);
+    if (num >= num_labels) num_labels = num + 1;
+  }
+  label_lines = malloc(sizeof(int) * (num_labels + 1));
+  label_refs = malloc(sizeof(int) * (num_labels + 1));
+  if (label_lines == NULL || label_refs == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+}
+
+//! 全ての変換規則を命令列に1回ずつ適用する関数
+static bool runPass()
+{
+  bool changed = false;
+  indexLabels();
+  for (int i = 0; i < num_lines; i++) {
+    Line * line = &lines[i];
+    if (line->deleted) continue;
+    if (line->kind == LINE_LABEL) {
+      int num = labelNumOf(line->label, line->label_len);
+      if (num >= 0 && num < num_labels && label_refs[num] == 0) {
+        deleteLine(i);
+        pattern_hits[PEEPHOLE_DEAD_LABEL]++;
+        changed = true;
+      }
+      continue;
+    }
+    if (line->kind != LINE_CODE) continue;
+
+    PeepholePattern pattern;
+    if (foldPushPop(i)) {
+      pattern = PEEPHOLE_PUSH_POP;
+    } else if (foldLoadAfterStore(i)) {
+      pattern = PEEPHOLE_LOAD_AFTER_STORE;
+    } else if (foldCopy(i)) {
+      pattern = PEEPHOLE_COPY_FOLDING;
+    } else if (removeDeadLoad(i)) {
+      pattern = PEEPHOLE_DEAD_LOAD;
+    } else if (removeJumpToNext(i)) {
+      pattern = PEEPHOLE_JUMP_TO_NEXT;
+    } else if (threadJump(i)) {
+      pattern = PEEPHOLE_JUMP_THREADING;
+    } else {
+      changed |= removeUnreachable(i);
+      continue;
+    }
+    pattern_hits[pattern]++;
+    changed = true;
+  }
+  return changed;
+}
+
+//! 命令列の中の機械語命令の数を数える関数
+static long countInstructions()
+{
+  long count = 0;
+  for (int i = 0; i < num_lines; i++) {
+    if (!lines[i].deleted && isInstruction(&lines[i])) count++;
+  }
+  return count;
+}
+
+/**
+ * @brief 出力バッファのstart以降に生成した命令を覗き穴最適化する
+ *
+ * @param emitter 出力バッファ
+ * @param start 最適化する範囲の先頭の位置
+ */
+void optimizePeephole(Emitter * emitter, size_t start)
+{
+  peephole_arena = newArena();
+  splitLines(emitter->buf + start, emitter->len - start);
+  allocateLabels();
+  long before = countInstructions();
+
+  for (int pass = 0; pass < MAX_PEEPHOLE_PASSES && runPass(); pass++) {
+  }
+
+  // 変換後の命令列を新しいバッファに組み立ててから、元のバッファと入れ替える
+  Emitter * optimized = newEmitter();
+  if (start > 0) emitStr(optimized, emitter->buf, start);
+  for (int i = 0; i < num_lines; i++) {
+    const Line * line = &lines[i];
+    if (line->deleted) continue;
+    if (line->modified) {
+      emitStr(optimized, line->label, line->label_len);
+      emitChar(optimized, '\t');
+      emitStr(optimized, line->opcode, line->opcode_len);
+      if (line->operand_len > 0) {
+        emitChar(optimized, '\t');
+        emitStr(optimized, line->operand, line->operand_len);
+      }
+    } else {
+      emitStr(optimized, line->text, line->text_len);
+    }
+    emitChar(optimized, '\n');
+  }
+  long after = countInstructions();
+  instructions_before += before;
+  instructions_after += after;
+  optimized->instructions = emitter->instructions - (before - after);
+
+  free(emitter->buf);
+  *emitter = *optimized;
+  free(optimized);
+  free(lines);
+  free(label_lines);
+  free(label_refs);
+  freeArena(peephole_arena);
+}
+
+/**
+ * @brief 変換規則ごとの適用回数と、最適化の前後の命令数を出力する
+ *
+ * @param fp 出力先
+ */
+void printPeepholeReport(FILE * fp)
+{
+  fprintf(fp, "Peephole optimization\n");
+  for (int i = 0; i < NUM_PEEPHOLE_PATTERNS; i++) {
+    fprintf(fp, "  %-18s%8ld\n", pattern_names[i], pattern_hits[i]);
+  }
+  fprintf(fp, "  %-18s%8ld -> %ld\n", "instructions", instructions_before, instructions_after);
+}
@@ -0,0 +1,42 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+#include <stddef.h>
+#include <stdio.h>
+
+#include "emit.h"
+
+/**
+ * @file
+ * 出力バッファに生成したCASL IIの命令を覗き穴最適化する
+ *
+ * 出力バッファの内容を1行ずつの命令列に分解し、隣り合う数命令の並びを
+ * より短い並びに置き換える変換を、変化がなくなるまで繰り返してから書き戻す。
+ * 書き換えていない行は出力バッファの文字列をそのまま出力する。
+ */
+
+//! 覗き穴最適化の変換規則
+typedef enum {
+  //! PUSHとPOPの組をレジスタ間の転送に置き換える
+  PEEPHOLE_PUSH_POP,
+  //! 格納した直後に同じ番地から読み込む命令を省く
+  PEEPHOLE_LOAD_AFTER_STORE,
+  //! 読まれずに上書きされるレジスタへの読み込みを省く
+  PEEPHOLE_DEAD_LOAD,
+  //! 読み込んだ値を別のレジスタに移すだけの命令を、移し先への直接の読み込みにまとめる
+  PEEPHOLE_COPY_FOLDING,
+  //! 直後のラベルへの分岐を省く
+  PEEPHOLE_JUMP_TO_NEXT,
+  //! 無条件分岐だけがあるラベルへの分岐を、その分岐先へ直接分岐させる
+  PEEPHOLE_JUMP_THREADING,
+  //! 無条件分岐や戻りの後の到達しない命令を省く
+  PEEPHOLE_UNREACHABLE,
+  //! 参照されないラベルを省く
+  PEEPHOLE_DEAD_LABEL,
+  //! 変換規則の数
+  NUM_PEEPHOLE_PATTERNS,
+} PeepholePattern;
+
+void optimizePeephole(Emitter *, size_t);
+void printPeepholeReport(FILE *);
+
+#endif
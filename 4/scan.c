@@ -1,44 +1,24 @@
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "arena.h"
 #include "lpp.h"
 
+#include "keyword.h"
+
 /**
  * @file
  * 字句解析を行う為の関数を纏めている
  */
 
-#define NUMOFPUNCT 18
-
 /**
- * @brief キーワードの種類を表す列挙型
- * 
+ * @brief 区切り記号の先頭の1文字からトークンIDを引く表
+ * 区切り記号にならない文字は0とする。2文字の区切り記号はcheckPunctで1文字先読みして判定する
  */
-static struct KEY
-{
-  char * keyword;
-  int keytoken;
-} key[KEYWORDSIZE];
-
-/**
- * @brief 予約語のリスト
- * 
- */
-static struct KEY key[KEYWORDSIZE] = {
-  {"and", TAND},       {"array", TARRAY},         {"begin", TBEGIN},     {"boolean", TBOOLEAN},
-  {"break", TBREAK},   {"call", TCALL},           {"char", TCHAR},       {"div", TDIV},
-  {"do", TDO},         {"else", TELSE},           {"end", TEND},         {"false", TFALSE},
-  {"if", TIF},         {"integer", TINTEGER},     {"not", TNOT},         {"of", TOF},
-  {"or", TOR},         {"procedure", TPROCEDURE}, {"program", TPROGRAM}, {"read", TREAD},
-  {"readln", TREADLN}, {"return", TRETURN},       {"then", TTHEN},       {"true", TTRUE},
-  {"var", TVAR},       {"while", TWHILE},         {"write", TWRITE},     {"writeln", TWRITELN}};
-
-/**
- * @brief 区切り文字のリスト
- * 
- */
-
-static struct KEY punct[PUNCTSIZE] = {
-  {":=", TASSIGN},  {"<>", TNOTEQ},   {">=", TGREQ}, {"<=", TLEEQ}, {"+", TPLUS},   {"-", TMINUS},
-  {"*", TSTAR},     {"=", TEQUAL},    {"<", TLE},    {">", TGR},    {"(", TLPAREN}, {")", TRPAREN},
-  {"[", TLSQPAREN}, {"]", TRSQPAREN}, {".", TDOT},   {",", TCOMMA}, {":", TCOLON},  {";", TSEMI}};
+static const unsigned char punct_table[256] = {
+  ['+'] = TPLUS,   ['-'] = TMINUS,  ['*'] = TSTAR,     ['='] = TEQUAL,    ['<'] = TLE,
+  ['>'] = TGR,     ['('] = TLPAREN, [')'] = TRPAREN,   ['['] = TLSQPAREN, [']'] = TRSQPAREN,
+  ['.'] = TDOT,    [','] = TCOMMA,  [':'] = TCOLON,    [';'] = TSEMI};
 
 /**
  * @brief 現在のトークンの位置が行頭かどうかを表す変数
@@ -53,16 +33,30 @@ static bool at_bol;
 static bool has_space;
 
 /**
- * @brief ひとかたまりの数字トークンを一時的に格納する
- * 
+ * @brief 字句解析で生成する名前の文字列を確保するアリーナ
+ * 名前は記号表やコード生成からも参照されるので、プログラムの終了まで解放しない
  */
-static int num_attr;
+static Arena * scan_arena;
 
 /**
- * @brief ひとかたまりの文字列トークンを一時的に格納する
+ * @brief 字句解析の結果を格納するトークン列
  * 
  */
-static char string_attr[MAXSTRSIZE];
+static TokenArray * tokens;
+
+/**
+ * @brief 名前を重複なく格納する表
+ * 同じ綴りの名前には同じポインタを返す。開番地法で管理し、要素数が半分を超えたら倍に広げる
+ */
+static struct
+{
+  //! 格納された文字列の配列
+  char ** entries;
+  //! 配列の大きさ(2の冪)
+  size_t size;
+  //! 格納された文字列の数
+  size_t count;
+} intern_table;
 
 /**
  * @brief 先読みした時点での行番号を格納する変数
@@ -84,52 +78,142 @@ static FILE * openFile(const char * path)
 }
 
 /**
- * @brief ファイルの読み込みを行う
+ * @brief 通常のファイルをメモリに写像して読み込む
+ * ファイルの直後まで無名のページを確保してから写像するので、コピーを行わずに
+ * 末尾へ改行文字と終端文字を書き足すことができる
+ * @param fd ファイル記述子
+ * @param size ファイルの大きさ(1以上)
+ * @return char* ファイルの中身を指すポインタ。写像に失敗した場合はNULLを返す
+ */
+static char * mapFile(int fd, size_t size)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t maplen = (size + 2 + page - 1) / page * page;
+  char * buf = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) return NULL;
+  if (mmap(buf, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(buf, maplen);
+    return NULL;
+  }
+  if (buf[size - 1] != '\n') buf[size++] = '\n';
+  buf[size] = '\0';
+  return buf;
+}
+
+/**
+ * @brief パイプや標準入力のように写像できない入力を読み込む
  * 
+ * @param fp 読み込むファイル
+ * @return char* ファイルの中身を指すポインタ
+ */
+static char * readStream(FILE * fp)
+{
+  size_t cap = 4096;
+  size_t len = 0;
+  char * buf = malloc(cap);
+  for (;;) {
+    // 改行文字と終端文字を書き足す分の余白を常に残しておく
+    if (buf == NULL) {
+      error("Memory allocation error");
+      exit(1);
+    }
+    if (cap - len <= 2) {
+      cap *= 2;
+      buf = realloc(buf, cap);
+      continue;
+    }
+    size_t n = fread(buf + len, 1, cap - len - 2, fp);
+    if (n == 0) break;
+    len += n;
+  }
+  if (len == 0 || buf[len - 1] != '\n') buf[len++] = '\n';
+  buf[len] = '\0';
+  return buf;
+}
+
+/**
+ * @brief ファイルの読み込みを行う
+ * 通常のファイルはメモリに写像し、それ以外はバッファを介して読み込む
  * @param path 
  * @return char* 
- * ファイルの中身を文字列として返す
+ * ファイルの中身を改行文字と終端文字で終わる文字列として返す
  */
 static char * readFile(char * path)
 {
   FILE * fp;
   fp = openFile(path);
+  if (!fp) return NULL;
 
-  char * buf;
-  size_t buflen;
-  FILE * out = open_memstream(&buf, &buflen);
-
-  for (;;) {
-    char buf2[4096];
-    int n = fread(buf2, 1, sizeof(buf2), fp);
-    if (n == 0) break;
-    fwrite(buf2, 1, n, out);
-  }
+  char * buf = NULL;
+  struct stat st;
+  if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    buf = mapFile(fileno(fp), st.st_size);
+  if (buf == NULL) buf = readStream(fp);
   fclose(fp);
-  fflush(out);
-  if (buflen == 0 || buf[buflen - 1] != '\n') fputc('\n', out);
-  fputc('\0', out);
-  fclose(out);
   return buf;
 }
 
 /**
- * @brief 新しいトークンを生成する関数
+ * @brief 配列を指定された要素数に拡張する
+ * 
+ * @param p 拡張する配列
+ * @param size 要素1つの大きさ
+ * @param capacity 拡張後の要素数
+ * @return void* 拡張した配列
+ */
+static void * growArray(void * p, size_t size, int capacity)
+{
+  p = realloc(p, size * capacity);
+  if (p == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  return p;
+}
+
+/**
+ * @brief トークン列の容量を倍に広げる
+ * 
+ */
+static void growTokenArray()
+{
+  int capacity = tokens->capacity ? tokens->capacity * 2 : 1024;
+  tokens->kind = growArray(tokens->kind, sizeof(*tokens->kind), capacity);
+  tokens->id = growArray(tokens->id, sizeof(*tokens->id), capacity);
+  tokens->line_no = growArray(tokens->line_no, sizeof(*tokens->line_no), capacity);
+  tokens->loc = growArray(tokens->loc, sizeof(*tokens->loc), capacity);
+  tokens->loc_len = growArray(tokens->loc_len, sizeof(*tokens->loc_len), capacity);
+  tokens->len = growArray(tokens->len, sizeof(*tokens->len), capacity);
+  tokens->num = growArray(tokens->num, sizeof(*tokens->num), capacity);
+  tokens->str = growArray(tokens->str, sizeof(*tokens->str), capacity);
+  tokens->at_bol = growArray(tokens->at_bol, sizeof(*tokens->at_bol), capacity);
+  tokens->has_space = growArray(tokens->has_space, sizeof(*tokens->has_space), capacity);
+  tokens->capacity = capacity;
+}
+
+/**
+ * @brief 新しいトークンをトークン列の末尾に追加する関数
  * 
  * @param kind トークンの種類
  * @param id トークン識別ID
+ * @param loc ソース中の字句の先頭を指すポインタ
  * @param len トークンの長さ
- * @return Token* 生成したトークンのポインタ
+ * @return int 追加したトークンの添字
  */
-static Token * newToken(TokenKind kind, int id, int len)
+static int newToken(TokenKind kind, int id, const char * loc, int len)
 {
-  Token * tok = calloc(1, sizeof(Token));
-  tok->kind = kind;
-  tok->id = id;
-  tok->len = len;
-  tok->at_bol = at_bol;
-  tok->has_space = has_space;
-  tok->line_no = line_num;
+  if (tokens->size == tokens->capacity) growTokenArray();
+  int tok = tokens->size++;
+  tokens->kind[tok] = kind;
+  tokens->id[tok] = id;
+  tokens->len[tok] = len;
+  tokens->loc[tok] = loc;
+  tokens->loc_len[tok] = len;
+  tokens->num[tok] = 0;
+  tokens->str[tok] = NULL;
+  tokens->at_bol[tok] = at_bol;
+  tokens->has_space[tok] = has_space;
+  tokens->line_no[tok] = line_num;
 
   at_bol = has_space = false;
 
@@ -139,37 +223,58 @@ static Token * newToken(TokenKind kind, int id, int len)
 /**
  * @brief keyword listに含まれていかをチェックする
  * 予約語が含まれていた場合、その予約語トークンを返す。もし含まれていなければ識別子トークンを返す
- * @return Token* トークンの連結リストの最後尾を示すポインタ
- * @param cur トークンの連結リストの最後尾を示すポインタ
+ * @return int 追加したトークンの添字
+ * @param p 名前の先頭を指すポインタ
+ * @param len 名前の長さ
  */
-static Token * checkKeyword(Token * cur)
+static int checkKeyword(const char * p, int len)
 {
-  for (int i = 0; i < KEYWORDSIZE; i++) {
-    if (strcmp(string_attr, key[i].keyword) == 0) {
-      cur = cur->next = newToken(TK_KEYWORD, key[i].keytoken, strlen(key[i].keyword));
-      return cur;
-    }
-  }
-  cur = cur->next = newToken(TK_IDENT, TNAME, strlen(string_attr));
-  cur->str = strdup(string_attr);
-  cur->has_space = true;
-  return cur;
+  int keytoken = lookupKeyword(p, len);
+  if (keytoken != TNAME) return newToken(TK_KEYWORD, keytoken, p, len);
+  int tok = newToken(TK_IDENT, TNAME, p, len);
+  tokens->has_space[tok] = true;
+  return tok;
 }
 
 /**
  * @brief 句読点が含まれているかをチェックする
  * 句読点が含まれていた場合、そのトークンのIDを返す。もし含まれていなければ-1を返す
+ * 先頭の1文字で表を引き、':=', '<>', '<=', '>='のみ次の1文字を先読みする
  * @param p ファイルの中身の文字列
+ * @param len 見つかった句読点の長さを格納する変数へのポインタ
  * @return int 見つかればそのトークンのID、見つからなければ-1
  */
-static int checkPunct(char * p)
+static int checkPunct(const char * p, int * len)
 {
-  for (int i = 0; i < PUNCTSIZE; i++) {
-    if (strncmp(p, punct[i].keyword, strlen(punct[i].keyword)) == 0) {
-      return punct[i].keytoken;
-    }
+  int id = punct_table[(unsigned char)*p];
+  if (id == 0) return -1;
+  *len = 1;
+  switch (id) {
+    case TCOLON:
+      if (p[1] == '=') {
+        id = TASSIGN;
+        *len = 2;
+      }
+      break;
+    case TLE:
+      if (p[1] == '>') {
+        id = TNOTEQ;
+        *len = 2;
+      } else if (p[1] == '=') {
+        id = TLEEQ;
+        *len = 2;
+      }
+      break;
+    case TGR:
+      if (p[1] == '=') {
+        id = TGREQ;
+        *len = 2;
+      }
+      break;
+    default:
+      break;
   }
-  return -1;
+  return id;
 }
 
 /**
@@ -196,122 +301,103 @@ static char * checkLinenum(char * p)
  * @brief 名前の読み込みを行う関数
  * 
  * @param p ファイルの中身の文字列
- * @param cur トークンの連結リストの最後尾を示すポインタ
- * @return Token* 
+ * @return int 追加したトークンの添字
  */
-static Token * readName(char * p, Token * cur)
+static int readName(char * p)
 {
-  int i = 0;
+  const char * start = p;
   do {
-    string_attr[i++] = *p;
-    if (i < MAXSTRSIZE - 1)
-      string_attr[i] = '\0';
-    else {
-      error("Too long string at %d line.", line_num);
-      cur = cur->next = newToken(TK_EOF, 0, 0);
-      return cur;
-    }
     p++;
   } while (isalnum(*p));
-  cur = checkKeyword(cur);
-  int id = cur->id;
+  if (p - start >= MAXSTRSIZE - 1) {
+    error("Too long string at %d line.", line_num);
+    return newToken(TK_EOF, 0, p, 0);
+  }
+  int tok = checkKeyword(start, p - start);
+  int id = tokens->id[tok];
   if (
     id == TPROGRAM || id == TPROCEDURE || id == TVAR || id == TBEGIN || id == TEND || id == TELSE ||
     id == TIF) {
-    cur->at_bol = true;
-    cur->has_space = false;
+    tokens->at_bol[tok] = true;
+    tokens->has_space[tok] = false;
   } else if (id == TINTEGER || id == TBOOLEAN || id == TCHAR || id == TTRUE || id == TFALSE) {
-    cur->has_space = true;
+    tokens->has_space[tok] = true;
   }
-  return cur;
+  return tok;
 }
 
 /**
  * @brief 数字の読み込みを行う関数
  * 
  * @param p ファイルの中身の文字列
- * @param cur トークンの連結リストの最後尾を示すポインタ
- * @return Token* 
+ * @return int 追加したトークンの添字
  */
-static Token * readNumber(char * p, Token * cur)
+static int readNumber(char * p)
 {
-  int num_len = 0;
-  num_attr = 0;
+  const char * start = p;
+  int num = 0;
   do {
-    string_attr[num_len++] = *p;
-    num_attr = num_attr * 10 + (*p - '0');
-    if (num_attr > MAXNUM) {
+    num = num * 10 + (*p - '0');
+    if (num > MAXNUM) {
       error("Error at %d: Number must not be larger than 32767.", line_num);
-      cur = cur->next = newToken(TK_EOF, 0, 0);
-      return cur;
+      return newToken(TK_EOF, 0, p, 0);
     }
     p++;
   } while (isdigit(*p));
-  string_attr[num_len] = '\0';
-  cur = cur->next = newToken(TK_NUM, TNUMBER, num_len);
-  cur->num = num_attr;
-  cur->str = strdup(string_attr);
+  int tok = newToken(TK_NUM, TNUMBER, start, p - start);
+  tokens->num[tok] = num;
 
-  cur->has_space = true;
-  return cur;
+  tokens->has_space[tok] = true;
+  return tok;
 }
 
 /**
  * @brief 文字列の読み込みを行う関数
  * 
  * @param p ファイルの中身の文字列
- * @param cur トークンの連結リストの最後尾を示すポインタ
- * @return Token* 
+ * @return int 追加したトークンの添字
  */
-static Token * readString(char * p, Token * cur)
+static int readString(char * p)
 {
-  int str_len = 0;
   int apostrophe_count = 0;
   p++;  // 最初の'を読み飛ばす
+  const char * start = p;
   for (;;) {
-    if (str_len >= MAXSTRSIZE - 1) {
+    if (p - start >= MAXSTRSIZE - 1) {
       error("Too long string at %d line.", line_num);
-      cur = cur->next = newToken(TK_EOF, 0, 0);
-      return cur;
+      return newToken(TK_EOF, 0, p, 0);
     }
     if (*p == '\0') {
-      cur = cur->next = newToken(TK_EOF, 0, 0);  // 'で閉じる前にEOFになった場合
-      return cur;
+      return newToken(TK_EOF, 0, p, 0);  // 'で閉じる前にEOFになった場合
     }
     if (*p == '\'') {
+      if (p[1] != '\'') break;
       p++;
-      if (*p != '\'') break;
-      string_attr[str_len++] = *p;
       apostrophe_count++;
     }
-    string_attr[str_len++] = *p;
     p++;
   }
 
-  if (*p == '\0') {
-    cur = cur->next = newToken(TK_EOF, 0, 0);  // 'で閉じる前にEOFになった場合
-    return cur;
-  }
-  string_attr[str_len] = '\0';
-  cur = cur->next = newToken(TK_STR, TSTRING, str_len - apostrophe_count);
-  cur->str = strdup(string_attr);
-  cur->has_space = true;
-  return cur;
+  // 字句は''を含んだままの形で保持し、長さには''を1文字として数えたものを格納する
+  int str_len = p - start;
+  int tok = newToken(TK_STR, TSTRING, start, str_len - apostrophe_count);
+  tokens->loc_len[tok] = str_len;
+  tokens->has_space[tok] = true;
+  return tok;
 }
 
 /**
  * @brief コメントの読み飛ばしを行う関数
  * 
  * @param p ファイルの中身の文字列
- * @param cur トークンの連結リストの最後尾を示すポインタ
  * @return char* 
  */
-static char * skipComment(char * p, Token * cur)
+static char * skipComment(char * p)
 {
   while (*(p++) != '}') {
     p = checkLinenum(p);
     if (*p == '\0') {
-      cur = cur->next = newToken(TK_EOF, 0, 0);
+      newToken(TK_EOF, 0, p, 0);
       return NULL;
     }
   }
@@ -322,16 +408,15 @@ static char * skipComment(char * p, Token * cur)
  * @brief ブロックコメントの読み飛ばしを行う関数
  * 
  * @param p ファイルの中身の文字列
- * @param cur トークンの連結リストの最後尾を示すポインタ
  * @return char* 
  */
-static char * skipBlockComment(char * p, Token * cur)
+static char * skipBlockComment(char * p)
 {
   while (1) {
     while (*(p++) != '*') {
       p = checkLinenum(p);
       if (*p == '\0') {
-        cur = cur->next = newToken(TK_EOF, 0, 0);
+        newToken(TK_EOF, 0, p, 0);
         return NULL;
       }
     }
@@ -343,21 +428,19 @@ static char * skipBlockComment(char * p, Token * cur)
 }
 
 /**
- * @brief トークナイズする対象の文字列に字句解析を行い、トークンのリストを返す関数
- * 
+ * @brief トークナイズする対象の文字列に字句解析を行い、トークン列の末尾に追加する関数
+ * トークン列は必ずTK_EOFのトークンで終わる
  * @param p ファイル内の1文字を指すポインタ
- * @param head トークンのリストの先頭
- * @return Token* 構文解析が終了した後のトークンのリストの先頭ポインタ
  */
-static Token * scan(char * p, Token * head)
+static void scan(char * p)
 {
-  Token * cur = head;
+  int tok;
   at_bol = false;
   has_space = false;
   for (;;) {
     if (*p == '\0') {
-      cur = cur->next = newToken(TK_EOF, 0, 0);
-      return head->next;
+      newToken(TK_EOF, 0, p, 0);
+      return;
     }
     switch (*p) {
       // 空白とタブは読み飛ばす
@@ -374,85 +457,155 @@ static Token * scan(char * p, Token * head)
         continue;
       // {}による注釈を読み飛ばす
       case '{':
-        p = skipComment(p, cur);
-        if (p == NULL) return head->next;
+        p = skipComment(p);
+        if (p == NULL) return;
         has_space = true;
         continue;
       // /* */による注釈を読み飛ばす
       case '/':
         p++;
         if (*p == '*') {
-          p = skipBlockComment(p, cur);
-          if (p == NULL) return head->next;
+          p = skipBlockComment(p);
+          if (p == NULL) return;
           has_space = true;
           continue;
         } else {
           fprintf(stderr, "Illegal character: %c\n at %d line.", *p, line_num);
-          cur = cur->next = newToken(TK_EOF, 0, 0);
-          return head->next;
+          newToken(TK_EOF, 0, p, 0);
+          return;
         }
     }
 
     if (isalpha(*p)) {
       // 名前の読み込み
-      if ((cur = readName(p, cur))->kind == TK_EOF) return head->next;
-      p += strlen(string_attr);
+      tok = readName(p);
+      if (tokens->kind[tok] == TK_EOF) return;
+      p += tokens->loc_len[tok];
       continue;
     } else if (isdigit(*p)) {
       // 数字の読み込み
-      if ((cur = readNumber(p, cur))->kind == TK_EOF) return head->next;
-      p += strlen(string_attr);
+      tok = readNumber(p);
+      if (tokens->kind[tok] == TK_EOF) return;
+      p += tokens->loc_len[tok];
       continue;
     } else if (*p == '\'') {
       // 'で囲まれた文字列の読み込み
-      if ((cur = readString(p, cur))->kind == TK_EOF) return head->next;
-      p += strlen(string_attr) + 2;  // 文字列の長さ + 両端のアポストロフィ
+      tok = readString(p);
+      if (tokens->kind[tok] == TK_EOF) return;
+      p += tokens->loc_len[tok] + 2;  // 文字列の長さ + 両端のアポストロフィ
       continue;
     } else {
       // その他の記号
-      int punct_id = checkPunct(p);
+      int punct_len;
+      int punct_id = checkPunct(p, &punct_len);
       if (punct_id != -1) {
-        const char * token_str[NUMOFPUNCT + 1] = {"",   "+", "-",  "*", "=", "<>", "<",
-                                                  "<=", ">", ">=", "(", ")", "[",  "]",
-                                                  ":=", ".", ",",  ":", ";"};
-        cur = cur->next = newToken(TK_PUNCT, punct_id, strlen(token_str[punct_id - 28]));
-        if (cur->id == TSEMI || cur->id == TDOT)
-          cur->has_space = false;
+        tok = newToken(TK_PUNCT, punct_id, p, punct_len);
+        if (punct_id == TSEMI || punct_id == TDOT)
+          tokens->has_space[tok] = false;
         else
-          cur->has_space = true;
+          tokens->has_space[tok] = true;
 
-        p += strlen(token_str[punct_id - 28]);
+        p += punct_len;
       } else {
         fprintf(stderr, "\nIllegal character: %c\n at %d line.\n", *p, line_num);
-        cur = cur->next = newToken(TK_EOF, 0, 0);
-        return head->next;
+        newToken(TK_EOF, 0, p, 0);
+        return;
       }
     }
   }
-  // Unreachable
-  return head->next;
 }
 
 /**
- * @brief トークンのリストを返す関数
- * トークンのリストは単方向の連結リストで表現される
+ * @brief 名前のハッシュ値(FNV-1a)を計算する
+ * 
+ * @param s 名前の先頭を指すポインタ
+ * @param len 名前の長さ
+ * @return unsigned int ハッシュ値
+ */
+static unsigned int hashString(const char * s, size_t len)
+{
+  unsigned int h = 2166136261u;
+  for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+  return h;
+}
+
+/**
+ * @brief 名前を表に格納し、格納された文字列を返す
+ * 既に同じ綴りの名前が格納されていればその文字列を返す
+ * @param s 名前の先頭を指すポインタ(終端文字は不要)
+ * @param len 名前の長さ
+ * @return char* 表に格納された終端文字付きの文字列
+ */
+static char * internString(const char * s, int len)
+{
+  if (intern_table.count * 2 >= intern_table.size) {
+    size_t old_size = intern_table.size;
+    char ** old_entries = intern_table.entries;
+    intern_table.size = old_size ? old_size * 2 : 256;
+    intern_table.entries = calloc(intern_table.size, sizeof(char *));
+    if (intern_table.entries == NULL) {
+      error("Memory allocation error");
+      exit(1);
+    }
+    for (size_t i = 0; i < old_size; i++) {
+      if (old_entries[i] == NULL) continue;
+      size_t j = hashString(old_entries[i], strlen(old_entries[i])) & (intern_table.size - 1);
+      while (intern_table.entries[j] != NULL) j = (j + 1) & (intern_table.size - 1);
+      intern_table.entries[j] = old_entries[i];
+    }
+    free(old_entries);
+  }
+
+  size_t i = hashString(s, len) & (intern_table.size - 1);
+  for (char * e; (e = intern_table.entries[i]) != NULL; i = (i + 1) & (intern_table.size - 1)) {
+    if (strncmp(e, s, len) == 0 && e[len] == '\0') return e;
+  }
+  char * str = arenaStrndup(scan_arena, s, len);
+  intern_table.entries[i] = str;
+  intern_table.count++;
+  return str;
+}
+
+/**
+ * @brief トークンの字句を終端文字付きの文字列として返す
+ * 文字列は必要になった時点で初めて生成し、トークン列に保持しておく。
+ * 文字列トークンの場合は''を含んだままの形で返す
+ * @param tokens 対象のトークン列
+ * @param tok 対象のトークンの添字
+ * @return char* トークンの字句
+ */
+char * tokenStr(TokenArray * tokens, int tok)
+{
+  if (tokens->str[tok] == NULL)
+    tokens->str[tok] = internString(tokens->loc[tok], tokens->loc_len[tok]);
+  return tokens->str[tok];
+}
+
+/**
+ * @brief トークン列を返す関数
+ * トークン列はトークンの属性ごとの配列に分けて格納される
  * @param p ファイルの中身の文字列
- * @return Token* 字句解析が終了した後のトークンのリストの先頭ポインタ
+ * @return TokenArray* 字句解析が終了した後のトークン列
  */
-Token * tokenize(char * p)
+TokenArray * tokenize(char * p)
 {
-  Token head = {};
-  head.next = scan(p, &head);
-  return head.next;
+  if (scan_arena == NULL) scan_arena = newArena();
+  tokens = calloc(1, sizeof(TokenArray));
+  if (tokens == NULL) {
+    error("Memory allocation error");
+    exit(1);
+  }
+  scan(p);
+  return tokens;
 }
 
 /**
- * @brief トークンのリストを返す関数
- * 入力されたファイルに対して構文解析を行い、tokenize関数でトークンのリストを返す
+ * @brief トークン列を返す関数
+ * 入力されたファイルに対して構文解析を行い、tokenize関数でトークン列を返す
  * @param path ファイルのパス
- * @return Token* 構文解析が終了した後のトークンのリストの先頭ポインタ
+ * @return TokenArray* 字句解析が終了した後のトークン列
  */
-Token * tokenizeFile(char * path)
+TokenArray * tokenizeFile(char * path)
 {
   char * p = readFile(path);
 
@@ -1,13 +1,16 @@
 #!/bin/bash
 rm *.gcda *.gcno *.o *.gcov mpplc
 
-gcc -coverage -c *.c *h
+gcc -coverage -I../common -c *.c *h
 gcc -coverage -o mpplc *.o
 
 for file in ../test/*.mpl; do
   if [ -f "$file" ]; then
     echo "Processing $file..."
     ./mpplc "$file" >/dev/null
+    # 最適化と中間表現を経由するコード生成の経路も通す
+    ./mpplc -O1 "$file" >/dev/null
+    ./mpplc --ir -O1 "$file" >/dev/null
   else
     echo "No .mpl files found in test directory."
   fi
@@ -17,251 +17,734 @@ TYPE_KIND error(char * fmt, ...)
   return ERROR;
 }
 
-void outlib(FILE * output_file)
+/**
+ * @brief 実行時ライブラリのルーチン
+ * 並びは出力する順で、RDCHを除くすべてのルーチンを出力した場合は分割する前の実行時ライブラリと一致する
+ */
+typedef enum {
+  RUNTIME_EOVF,
+  RUNTIME_E0DIV,
+  RUNTIME_EROV,
+  RUNTIME_WRITECHAR,
+  RUNTIME_WRITESTR,
+  RUNTIME_BOVFCHECK,
+  RUNTIME_WRITEINT,
+  RUNTIME_WRITEBOOL,
+  RUNTIME_WRITELINE,
+  RUNTIME_FLUSH,
+  RUNTIME_READCHAR,
+  RUNTIME_READINT,
+  //! 最適化した実行時ライブラリにだけあるルーチン
+  RUNTIME_RDCH,
+  RUNTIME_READLINE,
+  RUNTIME_ONE,
+  RUNTIME_SIX,
+  RUNTIME_TEN,
+  RUNTIME_SPACE,
+  RUNTIME_MINUS,
+  RUNTIME_TAB,
+  RUNTIME_ZERO,
+  RUNTIME_NINE,
+  RUNTIME_NEWLINE,
+  RUNTIME_INTBUF,
+  RUNTIME_OBUFSIZE,
+  RUNTIME_IBUFSIZE,
+  RUNTIME_INP,
+  RUNTIME_OBUF,
+  RUNTIME_IBUF,
+  RUNTIME_RPBBUF,
+  //! ルーチンの数
+  NUM_RUNTIME_ROUTINES,
+} RuntimeRoutine;
+
+//! ルーチンの集合を表すビット列での、ルーチンnameのビット
+#define RUNTIME_BIT(name) (1ULL << RUNTIME_##name)
+
+//! 実行時ライブラリのルーチンの定義
+typedef struct
 {
-  fprintf(
-    output_file,
-    ""
+  //! ルーチンの先頭のラベル
+  const char * name;
+  //! ルーチンのCASL IIのプログラム
+  const char * text;
+  //! ルーチンが参照する他のルーチンの集合
+  unsigned long long deps;
+} RuntimeDefinition;
+
+//! 実行時ライブラリの先頭に置くコメント
+static const char runtime_header[] =
     "; ------------------------\n"
     "; Utility functions\n"
-    "; ------------------------\n"
-    "EOVF            CALL    WRITELINE\n"
-    "                LAD     gr1, EOVF1\n"
-    "                LD      gr2, gr0\n"
-    "                CALL    WRITESTR\n"
-    "                CALL    WRITELINE\n"
-    "                SVC     1  ;  overflow error stop\n"
-    "EOVF1           DC      '***** Run-Time Error : Overflow *****'\n"
-    "E0DIV           JNZ     EOVF\n"
-    "                CALL    WRITELINE\n"
-    "                LAD     gr1, E0DIV1\n"
-    "                LD      gr2, gr0\n"
-    "                CALL    WRITESTR\n"
-    "                CALL    WRITELINE\n"
-    "                SVC     2  ;  0-divide error stop\n"
-    "E0DIV1          DC      '***** Run-Time Error : Zero-Divide *****'\n"
-    "EROV            CALL    WRITELINE\n"
-    "                LAD     gr1, EROV1\n"
-    "                LD      gr2, gr0\n"
-    "                CALL    WRITESTR\n"
-    "                CALL    WRITELINE\n"
-    "                SVC     3  ;  range-over error stop\n"
-    "EROV1           DC      '***** Run-Time Error : Range-Over in Array Index *****'\n"
-    "; gr1の値（文字）をgr2のけた数で出力する．\n"
-    "; gr2が0なら必要最小限の桁数で出力する\n"
-    "WRITECHAR       RPUSH\n"
-    "                LD      gr6, SPACE\n"
-    "                LD      gr7, OBUFSIZE\n"
-    "WC1             SUBA    gr2, ONE  ; while(--c > 0) {\n"
-    "                JZE     WC2\n"
-    "                JMI     WC2\n"
-    "                ST      gr6, OBUF,gr7  ;  *p++ = ' ';\n"
-    "                CALL    BOVFCHECK\n"
-    "                JUMP    WC1  ; }\n"
-    "WC2             ST      gr1, OBUF,gr7  ; *p++ = gr1;\n"
-    "                CALL    BOVFCHECK\n"
-    "                ST      gr7, OBUFSIZE\n"
-    "                RPOP\n"
-    "                RET\n"
-    "; gr1が指す文字列をgr2のけた数で出力する．\n"
-    "; gr2が0なら必要最小限の桁数で出力する\n"
-    "WRITESTR        RPUSH\n"
-    "                LD      gr6, gr1  ; p = gr1;\n"
-    "WS1             LD      gr4, 0,gr6  ; while(*p != 0) {\n"
-    "                JZE     WS2\n"
-    "                ADDA    gr6, ONE  ;  p++;\n"
-    "                SUBA    gr2, ONE  ;  c--;\n"
-    "                JUMP    WS1  ; }\n"
-    "WS2             LD      gr7, OBUFSIZE  ; q = OBUFSIZE;\n"
-    "                LD      gr5, SPACE\n"
-    "WS3             SUBA    gr2, ONE  ; while(--c >= 0) {\n"
-    "                JMI     WS4\n"
-    "                ST      gr5, OBUF,gr7  ;  *q++ = ' ';\n"
-    "                CALL    BOVFCHECK\n"
-    "                JUMP    WS3  ; }\n"
-    "WS4             LD      gr4, 0,gr1  ; while(*gr1 != 0) {\n"
-    "                JZE     WS5\n"
-    "                ST      gr4, OBUF,gr7  ;  *q++ = *gr1++;\n"
-    "                ADDA    gr1, ONE\n"
-    "                CALL    BOVFCHECK\n"
-    "                JUMP    WS4  ; }\n"
-    "WS5             ST      gr7, OBUFSIZE  ; OBUFSIZE = q;\n"
-    "                RPOP\n"
-    "                RET\n"
-    "BOVFCHECK       ADDA    gr7, ONE\n"
-    "                CPA     gr7, BOVFLEVEL\n"
-    "                JMI     BOVF1\n"
-    "                CALL    WRITELINE\n"
-    "                LD      gr7, OBUFSIZE\n"
-    "BOVF1           RET\n"
-    "BOVFLEVEL       DC      256\n"
-    "; gr1の値（整数）をgr2のけた数で出力する．\n"
-    "; gr2が0なら必要最小限の桁数で出力する\n"
-    "WRITEINT        RPUSH\n"
-    "                LD      gr7, gr0  ; flag = 0;\n"
-    "                CPA     gr1, gr0  ; if(gr1>=0) goto WI1;\n"
-    "                JPL     WI1\n"
-    "                JZE     WI1\n"
-    "                LD      gr4, gr0  ; gr1= - gr1;\n"
-    "                SUBA    gr4, gr1\n"
-    "                CPA     gr4, gr1\n"
-    "                JZE     WI6\n"
-    "                LD      gr1, gr4\n"
-    "                LD      gr7, ONE  ; flag = 1;\n"
-    "WI1             LD      gr6, SIX  ; p = INTBUF+6;\n"
-    "                ST      gr0, INTBUF,gr6  ; *p = 0;\n"
-    "                SUBA    gr6, ONE  ; p--;\n"
-    "                CPA     gr1, gr0  ; if(gr1 == 0)\n"
-    "                JNZ     WI2\n"
-    "                LD      gr4, ZERO  ;  *p = '0';\n"
-    "                ST      gr4, INTBUF,gr6\n"
-    "                JUMP    WI5  ; }\n"
-    "; else {\n"
-    "WI2             CPA     gr1, gr0  ;  while(gr1 != 0) {\n"
-    "                JZE     WI3\n"
-    "                LD      gr5, gr1  ;   gr5 = gr1 - (gr1 / 10) * 10;\n"
-    "                DIVA    gr1, TEN  ;   gr1 /= 10;\n"
-    "                LD      gr4, gr1\n"
-    "                MULA    gr4, TEN\n"
-    "                SUBA    gr5, gr4\n"
-    "                ADDA    gr5, ZERO  ;   gr5 += '0';\n"
-    "                ST      gr5, INTBUF,gr6  ;   *p = gr5;\n"
-    "                SUBA    gr6, ONE  ;   p--;\n"
-    "                JUMP    WI2  ;  }\n"
-    "WI3             CPA     gr7, gr0  ;  if(flag != 0) {\n"
-    "                JZE     WI4\n"
-    "                LD      gr4, MINUS  ;   *p = '-';\n"
-    "                ST      gr4, INTBUF,gr6\n"
-    "                JUMP    WI5  ;  }\n"
-    "WI4             ADDA    gr6, ONE  ;  else p++;\n"
-    "; }\n"
-    "WI5             LAD     gr1, INTBUF,gr6  ; gr1 = p;\n"
-    "                CALL    WRITESTR  ; WRITESTR();\n"
-    "                RPOP\n"
-    "                RET\n"
-    "WI6             LAD     gr1, MMINT\n"
-    "                CALL    WRITESTR  ; WRITESTR();\n"
-    "                RPOP\n"
-    "                RET\n"
-    "MMINT           DC      '-32768'\n"
-    "; gr1の値（真理値）が0なら'FALSE'を\n"
-    "; 0以外なら'TRUE'をgr2のけた数で出力する．\n"
-    "; gr2が0なら必要最小限の桁数で出力する\n"
-    "WRITEBOOL       RPUSH\n"
-    "                CPA     gr1, gr0  ; if(gr1 != 0)\n"
-    "                JZE     WB1\n"
-    "                LAD     gr1, WBTRUE  ;  gr1 = TRUE;\n"
-    "                JUMP    WB2\n"
-    "; else\n"
-    "WB1             LAD     gr1, WBFALSE  ;  gr1 = FALSE;\n"
-    "WB2             CALL    WRITESTR  ; WRITESTR();\n"
-    "                RPOP\n"
-    "                RET\n"
-    "WBTRUE          DC      'TRUE'\n"
-    "WBFALSE         DC      'FALSE'\n"
-    "; 改行を出力する\n"
-    "WRITELINE       RPUSH\n"
-    "                LD      gr7, OBUFSIZE\n"
-    "                LD      gr6, NEWLINE\n"
-    "                ST      gr6, OBUF,gr7\n"
-    "                ADDA    gr7, ONE\n"
-    "                ST      gr7, OBUFSIZE\n"
-    "                OUT     OBUF, OBUFSIZE\n"
-    "                ST      gr0, OBUFSIZE\n"
-    "                RPOP\n"
-    "                RET\n"
-    "; FLUSH\n"
-    "; 出力バッファをすべて表示する\n"
-    "FLUSH           RPUSH\n"
-    "                LD      gr7, OBUFSIZE\n"
-    "                JZE     FL1\n"
-    "                CALL    WRITELINE\n"
-    "FL1             RPOP\n"
-    "                RET\n"
-    "; gr1が指す番地に文字一つを読み込む\n"
-    "READCHAR        RPUSH\n"
-    "                LD      gr5, RPBBUF  ; if(RPBBUF != 0) {\n"
-    "                JZE     RC0\n"
-    "                ST      gr5, 0,gr1  ;  *gr1 = RPBBUF;\n"
-    "                ST      gr0, RPBBUF  ;  RPBBUF = 0\n"
-    "                JUMP    RC3  ;  return; }\n"
-    "RC0             LD      gr7, INP  ; inp = INP;\n"
-    "                LD      gr6, IBUFSIZE  ; if(IBUFSIZE == 0) {\n"
-    "                JNZ     RC1\n"
-    "                IN      IBUF, IBUFSIZE  ;  IN();\n"
-    "                LD      gr7, gr0  ;  inp = 0;\n"
-    "; }\n"
-    "RC1             CPA     gr7, IBUFSIZE  ; if(inp == IBUFSIZE) {\n"
-    "                JNZ     RC2\n"
-    "                LD      gr5, NEWLINE  ;  *gr1 = '\\n';\n"
-    "                ST      gr5, 0,gr1\n"
-    "                ST      gr0, IBUFSIZE  ;  IBUFSIZE = INP = 0;\n"
-    "                ST      gr0, INP\n"
-    "                JUMP    RC3  ; }\n"
-    "; else {\n"
-    "RC2             LD      gr5, IBUF,gr7  ;  *gr1 = *inp++;\n"
-    "                ADDA    gr7, ONE\n"
-    "                ST      gr5, 0,gr1\n"
-    "                ST      gr7, INP  ;  INP = inp;\n"
-    "; }\n"
-    "RC3             RPOP\n"
-    "                RET\n"
-    "; gr1が指す番地に整数値一つを読み込む\n"
-    "READINT         RPUSH\n"
-    "; do {\n"
-    "RI1             CALL    READCHAR  ;  ch = READCHAR();\n"
-    "                LD      gr7, 0,gr1\n"
-    "                CPA     gr7, SPACE  ; } while(ch==' ' || ch=='\\t' || ch=='\\n');\n"
-    "                JZE     RI1\n"
-    "                CPA     gr7, TAB\n"
-    "                JZE     RI1\n"
-    "                CPA     gr7, NEWLINE\n"
-    "                JZE     RI1\n"
-    "                LD      gr5, ONE  ; flag = 1\n"
-    "                CPA     gr7, MINUS  ; if(ch == '-') {\n"
-    "                JNZ     RI4\n"
-    "                LD      gr5, gr0  ;  flag = 0;\n"
-    "                CALL    READCHAR  ;  ch = READCHAR();\n"
-    "                LD      gr7, 0,gr1\n"
-    "RI4             LD      gr6, gr0  ; v = 0;     ; }\n"
-    "RI2             CPA     gr7, ZERO  ; while('0' <= ch && ch <= '9') {\n"
-    "                JMI     RI3\n"
-    "                CPA     gr7, NINE\n"
-    "                JPL     RI3\n"
-    "                MULA    gr6, TEN  ;  v = v*10+ch-'0';\n"
-    "                ADDA    gr6, gr7\n"
-    "                SUBA    gr6, ZERO\n"
-    "                CALL    READCHAR  ;  ch = READSCHAR();\n"
-    "                LD      gr7, 0,gr1\n"
-    "                JUMP    RI2  ; }\n"
-    "RI3             ST      gr7, RPBBUF  ; ReadPushBack();\n"
-    "                ST      gr6, 0,gr1  ; *gr1 = v;\n"
-    "                CPA     gr5, gr0  ; if(flag == 0) {\n"
-    "                JNZ     RI5\n"
-    "                SUBA    gr5, gr6  ;  *gr1 = -v;\n"
-    "                ST      gr5, 0,gr1\n"
-    "; }\n"
-    "RI5             RPOP\n"
-    "                RET\n"
-    "; 入力を改行コードまで（改行コードも含む）読み飛ばす\n"
-    "READLINE        ST      gr0, IBUFSIZE\n"
-    "                ST      gr0, INP\n"
-    "                ST      gr0, RPBBUF\n"
-    "                RET\n"
-    "ONE             DC      1\n"
-    "SIX             DC      6\n"
-    "TEN             DC      10\n"
-    "SPACE           DC      #0020  ; ' '\n"
-    "MINUS           DC      #002D  ; '-'\n"
-    "TAB             DC      #0009  ; '\\t'\n"
-    "ZERO            DC      #0030  ; '0'\n"
-    "NINE            DC      #0039  ; '9'\n"
-    "NEWLINE         DC      #000A  ; '\\n'\n"
-    "INTBUF          DS      8\n"
-    "OBUFSIZE        DC      0\n"
-    "IBUFSIZE        DC      0\n"
-    "INP             DC      0\n"
-    "OBUF            DS      257\n"
-    "IBUF            DS      257\n"
-    "RPBBUF          DC      0\n");
+    "; ------------------------\n";
+
+//! 実行時ライブラリのルーチン。RuntimeRoutineの順に並ぶ
+static const RuntimeDefinition runtime_library[NUM_RUNTIME_ROUTINES] = {
+    [RUNTIME_EOVF] =
+        {"EOVF",
+         "EOVF            CALL    WRITELINE\n"
+         "                LAD     gr1, EOVF1\n"
+         "                LD      gr2, gr0\n"
+         "                CALL    WRITESTR\n"
+         "                CALL    WRITELINE\n"
+         "                SVC     1  ;  overflow error stop\n"
+         "EOVF1           DC      '***** Run-Time Error : Overflow *****'\n",
+         RUNTIME_BIT(WRITELINE) | RUNTIME_BIT(WRITESTR)},
+    [RUNTIME_E0DIV] =
+        {"E0DIV",
+         "E0DIV           JNZ     EOVF\n"
+         "                CALL    WRITELINE\n"
+         "                LAD     gr1, E0DIV1\n"
+         "                LD      gr2, gr0\n"
+         "                CALL    WRITESTR\n"
+         "                CALL    WRITELINE\n"
+         "                SVC     2  ;  0-divide error stop\n"
+         "E0DIV1          DC      '***** Run-Time Error : Zero-Divide *****'\n",
+         RUNTIME_BIT(EOVF) | RUNTIME_BIT(WRITELINE) | RUNTIME_BIT(WRITESTR)},
+    [RUNTIME_EROV] =
+        {"EROV",
+         "EROV            CALL    WRITELINE\n"
+         "                LAD     gr1, EROV1\n"
+         "                LD      gr2, gr0\n"
+         "                CALL    WRITESTR\n"
+         "                CALL    WRITELINE\n"
+         "                SVC     3  ;  range-over error stop\n"
+         "EROV1           DC      '***** Run-Time Error : Range-Over in Array Index *****'\n",
+         RUNTIME_BIT(WRITELINE) | RUNTIME_BIT(WRITESTR)},
+    [RUNTIME_WRITECHAR] =
+        {"WRITECHAR",
+         "; gr1の値（文字）をgr2のけた数で出力する．\n"
+         "; gr2が0なら必要最小限の桁数で出力する\n"
+         "WRITECHAR       RPUSH\n"
+         "                LD      gr6, SPACE\n"
+         "                LD      gr7, OBUFSIZE\n"
+         "WC1             SUBA    gr2, ONE  ; while(--c > 0) {\n"
+         "                JZE     WC2\n"
+         "                JMI     WC2\n"
+         "                ST      gr6, OBUF,gr7  ;  *p++ = ' ';\n"
+         "                CALL    BOVFCHECK\n"
+         "                JUMP    WC1  ; }\n"
+         "WC2             ST      gr1, OBUF,gr7  ; *p++ = gr1;\n"
+         "                CALL    BOVFCHECK\n"
+         "                ST      gr7, OBUFSIZE\n"
+         "                RPOP\n"
+         "                RET\n",
+         RUNTIME_BIT(BOVFCHECK) | RUNTIME_BIT(ONE) | RUNTIME_BIT(SPACE) | RUNTIME_BIT(OBUFSIZE) |
+         RUNTIME_BIT(OBUF)},
+    [RUNTIME_WRITESTR] =
+        {"WRITESTR",
+         "; gr1が指す文字列をgr2のけた数で出力する．\n"
+         "; gr2が0なら必要最小限の桁数で出力する\n"
+         "WRITESTR        RPUSH\n"
+         "                LD      gr6, gr1  ; p = gr1;\n"
+         "WS1             LD      gr4, 0,gr6  ; while(*p != 0) {\n"
+         "                JZE     WS2\n"
+         "                ADDA    gr6, ONE  ;  p++;\n"
+         "                SUBA    gr2, ONE  ;  c--;\n"
+         "                JUMP    WS1  ; }\n"
+         "WS2             LD      gr7, OBUFSIZE  ; q = OBUFSIZE;\n"
+         "                LD      gr5, SPACE\n"
+         "WS3             SUBA    gr2, ONE  ; while(--c >= 0) {\n"
+         "                JMI     WS4\n"
+         "                ST      gr5, OBUF,gr7  ;  *q++ = ' ';\n"
+         "                CALL    BOVFCHECK\n"
+         "                JUMP    WS3  ; }\n"
+         "WS4             LD      gr4, 0,gr1  ; while(*gr1 != 0) {\n"
+         "                JZE     WS5\n"
+         "                ST      gr4, OBUF,gr7  ;  *q++ = *gr1++;\n"
+         "                ADDA    gr1, ONE\n"
+         "                CALL    BOVFCHECK\n"
+         "                JUMP    WS4  ; }\n"
+         "WS5             ST      gr7, OBUFSIZE  ; OBUFSIZE = q;\n"
+         "                RPOP\n"
+         "                RET\n",
+         RUNTIME_BIT(BOVFCHECK) | RUNTIME_BIT(ONE) | RUNTIME_BIT(SPACE) | RUNTIME_BIT(OBUFSIZE) |
+         RUNTIME_BIT(OBUF)},
+    [RUNTIME_BOVFCHECK] =
+        {"BOVFCHECK",
+         "BOVFCHECK       ADDA    gr7, ONE\n"
+         "                CPA     gr7, BOVFLEVEL\n"
+         "                JMI     BOVF1\n"
+         "                CALL    WRITELINE\n"
+         "                LD      gr7, OBUFSIZE\n"
+         "BOVF1           RET\n"
+         "BOVFLEVEL       DC      256\n",
+         RUNTIME_BIT(WRITELINE) | RUNTIME_BIT(ONE) | RUNTIME_BIT(OBUFSIZE)},
+    [RUNTIME_WRITEINT] =
+        {"WRITEINT",
+         "; gr1の値（整数）をgr2のけた数で出力する．\n"
+         "; gr2が0なら必要最小限の桁数で出力する\n"
+         "WRITEINT        RPUSH\n"
+         "                LD      gr7, gr0  ; flag = 0;\n"
+         "                CPA     gr1, gr0  ; if(gr1>=0) goto WI1;\n"
+         "                JPL     WI1\n"
+         "                JZE     WI1\n"
+         "                LD      gr4, gr0  ; gr1= - gr1;\n"
+         "                SUBA    gr4, gr1\n"
+         "                CPA     gr4, gr1\n"
+         "                JZE     WI6\n"
+         "                LD      gr1, gr4\n"
+         "                LD      gr7, ONE  ; flag = 1;\n"
+         "WI1             LD      gr6, SIX  ; p = INTBUF+6;\n"
+         "                ST      gr0, INTBUF,gr6  ; *p = 0;\n"
+         "                SUBA    gr6, ONE  ; p--;\n"
+         "                CPA     gr1, gr0  ; if(gr1 == 0)\n"
+         "                JNZ     WI2\n"
+         "                LD      gr4, ZERO  ;  *p = '0';\n"
+         "                ST      gr4, INTBUF,gr6\n"
+         "                JUMP    WI5  ; }\n"
+         "; else {\n"
+         "WI2             CPA     gr1, gr0  ;  while(gr1 != 0) {\n"
+         "                JZE     WI3\n"
+         "                LD      gr5, gr1  ;   gr5 = gr1 - (gr1 / 10) * 10;\n"
+         "                DIVA    gr1, TEN  ;   gr1 /= 10;\n"
+         "                LD      gr4, gr1\n"
+         "                MULA    gr4, TEN\n"
+         "                SUBA    gr5, gr4\n"
+         "                ADDA    gr5, ZERO  ;   gr5 += '0';\n"
+         "                ST      gr5, INTBUF,gr6  ;   *p = gr5;\n"
+         "                SUBA    gr6, ONE  ;   p--;\n"
+         "                JUMP    WI2  ;  }\n"
+         "WI3             CPA     gr7, gr0  ;  if(flag != 0) {\n"
+         "                JZE     WI4\n"
+         "                LD      gr4, MINUS  ;   *p = '-';\n"
+         "                ST      gr4, INTBUF,gr6\n"
+         "                JUMP    WI5  ;  }\n"
+         "WI4             ADDA    gr6, ONE  ;  else p++;\n"
+         "; }\n"
+         "WI5             LAD     gr1, INTBUF,gr6  ; gr1 = p;\n"
+         "                CALL    WRITESTR  ; WRITESTR();\n"
+         "                RPOP\n"
+         "                RET\n"
+         "WI6             LAD     gr1, MMINT\n"
+         "                CALL    WRITESTR  ; WRITESTR();\n"
+         "                RPOP\n"
+         "                RET\n"
+         "MMINT           DC      '-32768'\n",
+         RUNTIME_BIT(WRITESTR) | RUNTIME_BIT(ONE) | RUNTIME_BIT(SIX) | RUNTIME_BIT(TEN) |
+         RUNTIME_BIT(MINUS) | RUNTIME_BIT(ZERO) | RUNTIME_BIT(INTBUF)},
+    [RUNTIME_WRITEBOOL] =
+        {"WRITEBOOL",
+         "; gr1の値（真理値）が0なら'FALSE'を\n"
+         "; 0以外なら'TRUE'をgr2のけた数で出力する．\n"
+         "; gr2が0なら必要最小限の桁数で出力する\n"
+         "WRITEBOOL       RPUSH\n"
+         "                CPA     gr1, gr0  ; if(gr1 != 0)\n"
+         "                JZE     WB1\n"
+         "                LAD     gr1, WBTRUE  ;  gr1 = TRUE;\n"
+         "                JUMP    WB2\n"
+         "; else\n"
+         "WB1             LAD     gr1, WBFALSE  ;  gr1 = FALSE;\n"
+         "WB2             CALL    WRITESTR  ; WRITESTR();\n"
+         "                RPOP\n"
+         "                RET\n"
+         "WBTRUE          DC      'TRUE'\n"
+         "WBFALSE         DC      'FALSE'\n",
+         RUNTIME_BIT(WRITESTR)},
+    [RUNTIME_WRITELINE] =
+        {"WRITELINE",
+         "; 改行を出力する\n"
+         "WRITELINE       RPUSH\n"
+         "                LD      gr7, OBUFSIZE\n"
+         "                LD      gr6, NEWLINE\n"
+         "                ST      gr6, OBUF,gr7\n"
+         "                ADDA    gr7, ONE\n"
+         "                ST      gr7, OBUFSIZE\n"
+         "                OUT     OBUF, OBUFSIZE\n"
+         "                ST      gr0, OBUFSIZE\n"
+         "                RPOP\n"
+         "                RET\n",
+         RUNTIME_BIT(ONE) | RUNTIME_BIT(NEWLINE) | RUNTIME_BIT(OBUFSIZE) | RUNTIME_BIT(OBUF)},
+    [RUNTIME_FLUSH] =
+        {"FLUSH",
+         "; FLUSH\n"
+         "; 出力バッファをすべて表示する\n"
+         "FLUSH           RPUSH\n"
+         "                LD      gr7, OBUFSIZE\n"
+         "                JZE     FL1\n"
+         "                CALL    WRITELINE\n"
+         "FL1             RPOP\n"
+         "                RET\n",
+         RUNTIME_BIT(WRITELINE) | RUNTIME_BIT(OBUFSIZE)},
+    [RUNTIME_READCHAR] =
+        {"READCHAR",
+         "; gr1が指す番地に文字一つを読み込む\n"
+         "READCHAR        RPUSH\n"
+         "                LD      gr5, RPBBUF  ; if(RPBBUF != 0) {\n"
+         "                JZE     RC0\n"
+         "                ST      gr5, 0,gr1  ;  *gr1 = RPBBUF;\n"
+         "                ST      gr0, RPBBUF  ;  RPBBUF = 0\n"
+         "                JUMP    RC3  ;  return; }\n"
+         "RC0             LD      gr7, INP  ; inp = INP;\n"
+         "                LD      gr6, IBUFSIZE  ; if(IBUFSIZE == 0) {\n"
+         "                JNZ     RC1\n"
+         "                IN      IBUF, IBUFSIZE  ;  IN();\n"
+         "                LD      gr7, gr0  ;  inp = 0;\n"
+         "; }\n"
+         "RC1             CPA     gr7, IBUFSIZE  ; if(inp == IBUFSIZE) {\n"
+         "                JNZ     RC2\n"
+         "                LD      gr5, NEWLINE  ;  *gr1 = '\\n';\n"
+         "                ST      gr5, 0,gr1\n"
+         "                ST      gr0, IBUFSIZE  ;  IBUFSIZE = INP = 0;\n"
+         "                ST      gr0, INP\n"
+         "                JUMP    RC3  ; }\n"
+         "; else {\n"
+         "RC2             LD      gr5, IBUF,gr7  ;  *gr1 = *inp++;\n"
+         "                ADDA    gr7, ONE\n"
+         "                ST      gr5, 0,gr1\n"
+         "                ST      gr7, INP  ;  INP = inp;\n"
+         "; }\n"
+         "RC3             RPOP\n"
+         "                RET\n",
+         RUNTIME_BIT(ONE) | RUNTIME_BIT(NEWLINE) | RUNTIME_BIT(IBUFSIZE) | RUNTIME_BIT(INP) |
+         RUNTIME_BIT(IBUF) | RUNTIME_BIT(RPBBUF)},
+    [RUNTIME_READINT] =
+        {"READINT",
+         "; gr1が指す番地に整数値一つを読み込む\n"
+         "READINT         RPUSH\n"
+         "; do {\n"
+         "RI1             CALL    READCHAR  ;  ch = READCHAR();\n"
+         "                LD      gr7, 0,gr1\n"
+         "                CPA     gr7, SPACE  ; } while(ch==' ' || ch=='\\t' || ch=='\\n');\n"
+         "                JZE     RI1\n"
+         "                CPA     gr7, TAB\n"
+         "                JZE     RI1\n"
+         "                CPA     gr7, NEWLINE\n"
+         "                JZE     RI1\n"
+         "                LD      gr5, ONE  ; flag = 1\n"
+         "                CPA     gr7, MINUS  ; if(ch == '-') {\n"
+         "                JNZ     RI4\n"
+         "                LD      gr5, gr0  ;  flag = 0;\n"
+         "                CALL    READCHAR  ;  ch = READCHAR();\n"
+         "                LD      gr7, 0,gr1\n"
+         "RI4             LD      gr6, gr0  ; v = 0;     ; }\n"
+         "RI2             CPA     gr7, ZERO  ; while('0' <= ch && ch <= '9') {\n"
+         "                JMI     RI3\n"
+         "                CPA     gr7, NINE\n"
+         "                JPL     RI3\n"
+         "                MULA    gr6, TEN  ;  v = v*10+ch-'0';\n"
+         "                ADDA    gr6, gr7\n"
+         "                SUBA    gr6, ZERO\n"
+         "                CALL    READCHAR  ;  ch = READSCHAR();\n"
+         "                LD      gr7, 0,gr1\n"
+         "                JUMP    RI2  ; }\n"
+         "RI3             ST      gr7, RPBBUF  ; ReadPushBack();\n"
+         "                ST      gr6, 0,gr1  ; *gr1 = v;\n"
+         "                CPA     gr5, gr0  ; if(flag == 0) {\n"
+         "                JNZ     RI5\n"
+         "                SUBA    gr5, gr6  ;  *gr1 = -v;\n"
+         "                ST      gr5, 0,gr1\n"
+         "; }\n"
+         "RI5             RPOP\n"
+         "                RET\n",
+         RUNTIME_BIT(READCHAR) | RUNTIME_BIT(ONE) | RUNTIME_BIT(TEN) | RUNTIME_BIT(SPACE) |
+         RUNTIME_BIT(MINUS) | RUNTIME_BIT(TAB) | RUNTIME_BIT(ZERO) | RUNTIME_BIT(NINE) |
+         RUNTIME_BIT(NEWLINE) | RUNTIME_BIT(RPBBUF)},
+    [RUNTIME_READLINE] =
+        {"READLINE",
+         "; 入力を改行コードまで（改行コードも含む）読み飛ばす\n"
+         "READLINE        ST      gr0, IBUFSIZE\n"
+         "                ST      gr0, INP\n"
+         "                ST      gr0, RPBBUF\n"
+         "                RET\n",
+         RUNTIME_BIT(IBUFSIZE) | RUNTIME_BIT(INP) | RUNTIME_BIT(RPBBUF)},
+    [RUNTIME_ONE] =
+        {"ONE",
+         "ONE             DC      1\n",
+         0},
+    [RUNTIME_SIX] =
+        {"SIX",
+         "SIX             DC      6\n",
+         0},
+    [RUNTIME_TEN] =
+        {"TEN",
+         "TEN             DC      10\n",
+         0},
+    [RUNTIME_SPACE] =
+        {"SPACE",
+         "SPACE           DC      #0020  ; ' '\n",
+         0},
+    [RUNTIME_MINUS] =
+        {"MINUS",
+         "MINUS           DC      #002D  ; '-'\n",
+         0},
+    [RUNTIME_TAB] =
+        {"TAB",
+         "TAB             DC      #0009  ; '\\t'\n",
+         0},
+    [RUNTIME_ZERO] =
+        {"ZERO",
+         "ZERO            DC      #0030  ; '0'\n",
+         0},
+    [RUNTIME_NINE] =
+        {"NINE",
+         "NINE            DC      #0039  ; '9'\n",
+         0},
+    [RUNTIME_NEWLINE] =
+        {"NEWLINE",
+         "NEWLINE         DC      #000A  ; '\\n'\n",
+         0},
+    [RUNTIME_INTBUF] =
+        {"INTBUF",
+         "INTBUF          DS      8\n",
+         0},
+    [RUNTIME_OBUFSIZE] =
+        {"OBUFSIZE",
+         "OBUFSIZE        DC      0\n",
+         0},
+    [RUNTIME_IBUFSIZE] =
+        {"IBUFSIZE",
+         "IBUFSIZE        DC      0\n",
+         0},
+    [RUNTIME_INP] =
+        {"INP",
+         "INP             DC      0\n",
+         0},
+    [RUNTIME_OBUF] =
+        {"OBUF",
+         "OBUF            DS      257\n",
+         0},
+    [RUNTIME_IBUF] =
+        {"IBUF",
+         "IBUF            DS      257\n",
+         0},
+    [RUNTIME_RPBBUF] =
+        {"RPBBUF",
+         "RPBBUF          DC      0\n",
+         0},
+};
+
+//! 最適化した実行時ライブラリのルーチン。定義のないルーチンはruntime_libraryのものを使う
+static const RuntimeDefinition fast_runtime_library[NUM_RUNTIME_ROUTINES] = {
+    [RUNTIME_WRITECHAR] =
+        {"WRITECHAR",
+         "; gr1の値（文字）をgr2のけた数で出力する．\n"
+         "; gr2が0なら必要最小限の桁数で出力する\n"
+         "; 使うレジスタだけを退避し，出力バッファの検査はBOVFCHECKを呼ばずに行う\n"
+         "WRITECHAR       PUSH    0,gr2\n"
+         "                PUSH    0,gr5\n"
+         "                PUSH    0,gr6\n"
+         "                PUSH    0,gr7\n"
+         "                LAD     gr5, 256\n"
+         "                LD      gr6, SPACE\n"
+         "                LD      gr7, OBUFSIZE\n"
+         "WC1             SUBA    gr2, ONE  ; while(--c > 0) {\n"
+         "                JZE     WC2\n"
+         "                JMI     WC2\n"
+         "                ST      gr6, OBUF,gr7  ;  *q++ = ' ';\n"
+         "                LAD     gr7, 1,gr7\n"
+         "                CPA     gr7, gr5  ;  if(q == 256) {\n"
+         "                JMI     WC1\n"
+         "                CALL    WRITELINE  ;   WRITELINE();\n"
+         "                LD      gr7, OBUFSIZE  ;   q = OBUFSIZE; }\n"
+         "                JUMP    WC1  ; }\n"
+         "WC2             ST      gr1, OBUF,gr7  ; *q++ = gr1;\n"
+         "                LAD     gr7, 1,gr7\n"
+         "                CPA     gr7, gr5  ; if(q == 256) {\n"
+         "                JMI     WC3\n"
+         "                CALL    WRITELINE  ;  WRITELINE();\n"
+         "                LD      gr7, OBUFSIZE  ;  q = OBUFSIZE; }\n"
+         "WC3             ST      gr7, OBUFSIZE  ; OBUFSIZE = q;\n"
+         "                POP     gr7\n"
+         "                POP     gr6\n"
+         "                POP     gr5\n"
+         "                POP     gr2\n"
+         "                RET\n",
+         RUNTIME_BIT(WRITELINE) | RUNTIME_BIT(ONE) | RUNTIME_BIT(SPACE) | RUNTIME_BIT(OBUFSIZE) |
+         RUNTIME_BIT(OBUF)},
+    [RUNTIME_WRITESTR] =
+        {"WRITESTR",
+         "; gr1が指す文字列をgr2のけた数で出力する．\n"
+         "; gr2が0なら必要最小限の桁数で出力する\n"
+         "; けた数の指定がなければ文字列を一度だけたどり，出力バッファの検査はBOVFCHECKを呼ばずに行う\n"
+         "WRITESTR        RPUSH\n"
+         "                LD      gr7, OBUFSIZE  ; q = OBUFSIZE;\n"
+         "                LAD     gr5, 256\n"
+         "                LAD     gr3, 1\n"
+         "                CPA     gr2, gr0  ; if(c != 0) {\n"
+         "                JZE     WS4\n"
+         "                LD      gr6, gr1  ;  p = gr1;\n"
+         "WS1             LD      gr4, 0,gr6  ;  while(*p != 0) {\n"
+         "                JZE     WS2\n"
+         "                LAD     gr6, 1,gr6  ;   p++;\n"
+         "                SUBA    gr2, gr3  ;   c--;\n"
+         "                JUMP    WS1  ;  }\n"
+         "WS2             LD      gr4, SPACE\n"
+         "WS3             SUBA    gr2, gr3  ;  while(--c >= 0) {\n"
+         "                JMI     WS4\n"
+         "                ST      gr4, OBUF,gr7  ;   *q++ = ' ';\n"
+         "                LAD     gr7, 1,gr7\n"
+         "                CPA     gr7, gr5  ;   if(q == 256) {\n"
+         "                JMI     WS3\n"
+         "                CALL    WRITELINE  ;    WRITELINE();\n"
+         "                LD      gr7, OBUFSIZE  ;    q = OBUFSIZE; }\n"
+         "                JUMP    WS3  ;  }\n"
+         "; }\n"
+         "WS4             LD      gr4, 0,gr1  ; while(*gr1 != 0) {\n"
+         "                JZE     WS5\n"
+         "                ST      gr4, OBUF,gr7  ;  *q++ = *gr1++;\n"
+         "                LAD     gr1, 1,gr1\n"
+         "                LAD     gr7, 1,gr7\n"
+         "                CPA     gr7, gr5  ;  if(q == 256) {\n"
+         "                JMI     WS4\n"
+         "                CALL    WRITELINE  ;   WRITELINE();\n"
+         "                LD      gr7, OBUFSIZE  ;   q = OBUFSIZE; }\n"
+         "                JUMP    WS4  ; }\n"
+         "WS5             ST      gr7, OBUFSIZE  ; OBUFSIZE = q;\n"
+         "                RPOP\n"
+         "                RET\n",
+         RUNTIME_BIT(WRITELINE) | RUNTIME_BIT(SPACE) | RUNTIME_BIT(OBUFSIZE) | RUNTIME_BIT(OBUF)},
+    [RUNTIME_WRITEINT] =
+        {"WRITEINT",
+         "; gr1の値（整数）をgr2のけた数で出力する．\n"
+         "; gr2が0なら必要最小限の桁数で出力する\n"
+         "; 上の桁から10のべき乗を引いて各桁を求め，出力バッファに収まる場合は直接書き込む．\n"
+         "; 収まらない場合はINTBUFに書き込んでWRITESTRで出力する\n"
+         "WRITEINT        RPUSH\n"
+         "                LD      gr3, gr0  ; neg = 0;\n"
+         "                CPA     gr1, gr0  ; if(gr1 < 0) {\n"
+         "                JPL     WI1\n"
+         "                JZE     WI1\n"
+         "                LD      gr4, gr0  ;  gr1 = -gr1;\n"
+         "                SUBA    gr4, gr1\n"
+         "                JOV     WI9  ;  if(overflow) goto WI9;\n"
+         "                LD      gr1, gr4\n"
+         "                LAD     gr3, 1  ;  neg = 1; }\n"
+         "WI1             LD      gr6, gr0  ; i = 0;\n"
+         "WI2             CPA     gr1, WIPOW,gr6  ; while(gr1 < WIPOW[i]) i++;\n"
+         "                JPL     WI3\n"
+         "                JZE     WI3\n"
+         "                LAD     gr6, 1,gr6\n"
+         "                JUMP    WI2\n"
+         "WI3             LAD     gr5, 5,gr3  ; len = neg + 5 - i;\n"
+         "                SUBA    gr5, gr6\n"
+         "                LD      gr4, gr2  ; w = max(c, len);\n"
+         "                CPA     gr4, gr5\n"
+         "                JPL     WI4\n"
+         "                LD      gr4, gr5\n"
+         "WI4             LD      gr7, OBUFSIZE  ; if(OBUFSIZE + w >= 256) {\n"
+         "                LAD     gr4, -256,gr4\n"
+         "                ADDA    gr4, gr7\n"
+         "                JMI     WI5\n"
+         "                LAD     gr7, INTBUF  ;  p = INTBUF;\n"
+         "                JUMP    WI7  ; }\n"
+         "WI5             SUBA    gr2, gr5  ; else { c -= len;\n"
+         "                LAD     gr7, OBUF,gr7  ;  p = OBUF + OBUFSIZE;\n"
+         "                LD      gr4, SPACE\n"
+         "                LAD     gr5, 1\n"
+         "WI6             SUBA    gr2, gr5  ;  while(--c >= 0) *p++ = ' ';\n"
+         "                JMI     WI7\n"
+         "                ST      gr4, 0,gr7\n"
+         "                LAD     gr7, 1,gr7\n"
+         "                JUMP    WI6  ; }\n"
+         "WI7             CPA     gr3, gr0  ; if(neg) *p++ = '-';\n"
+         "                JZE     WI8\n"
+         "                LD      gr4, MINUS\n"
+         "                ST      gr4, 0,gr7\n"
+         "                LAD     gr7, 1,gr7\n"
+         "WI8             LD      gr5, WIPOW,gr6  ; for(; WIPOW[i] != 0; i++) {\n"
+         "                JZE     WIA\n"
+         "                LAD     gr4, #002F  ;  d = '0' - 1;\n"
+         "WIB             LAD     gr4, 1,gr4  ;  do d++;\n"
+         "                SUBA    gr1, gr5  ;  while((gr1 -= WIPOW[i]) >= 0);\n"
+         "                JPL     WIB\n"
+         "                JZE     WIB\n"
+         "                ADDA    gr1, gr5  ;  gr1 += WIPOW[i];\n"
+         "                ST      gr4, 0,gr7  ;  *p++ = d;\n"
+         "                LAD     gr7, 1,gr7\n"
+         "                LAD     gr6, 1,gr6\n"
+         "                JUMP    WI8  ; }\n"
+         "WIA             ADDA    gr1, ZERO  ; *p++ = gr1 + '0';\n"
+         "                ST      gr1, 0,gr7\n"
+         "                LAD     gr7, 1,gr7\n"
+         "                CPA     gr2, gr0  ; if(p points into INTBUF) {\n"
+         "                JMI     WIC\n"
+         "                ST      gr0, 0,gr7  ;  *p = 0;\n"
+         "                LAD     gr1, INTBUF\n"
+         "                CALL    WRITESTR  ;  WRITESTR();\n"
+         "                RPOP\n"
+         "                RET  ; }\n"
+         "WIC             LAD     gr6, OBUF  ; OBUFSIZE = p - OBUF;\n"
+         "                SUBA    gr7, gr6\n"
+         "                ST      gr7, OBUFSIZE\n"
+         "                RPOP\n"
+         "                RET\n"
+         "WI9             LAD     gr1, MMINT\n"
+         "                CALL    WRITESTR  ; WRITESTR();\n"
+         "                RPOP\n"
+         "                RET\n"
+         "MMINT           DC      '-32768'\n"
+         "WIPOW           DC      10000, 1000, 100, 10, 0\n",
+         RUNTIME_BIT(WRITESTR) | RUNTIME_BIT(SPACE) | RUNTIME_BIT(MINUS) | RUNTIME_BIT(ZERO) |
+         RUNTIME_BIT(INTBUF) | RUNTIME_BIT(OBUFSIZE) | RUNTIME_BIT(OBUF)},
+    [RUNTIME_WRITELINE] =
+        {"WRITELINE",
+         "; 改行を出力する\n"
+         "; 使うレジスタだけを退避する\n"
+         "WRITELINE       PUSH    0,gr6\n"
+         "                PUSH    0,gr7\n"
+         "                LD      gr7, OBUFSIZE\n"
+         "                LD      gr6, NEWLINE\n"
+         "                ST      gr6, OBUF,gr7\n"
+         "                LAD     gr7, 1,gr7\n"
+         "                ST      gr7, OBUFSIZE\n"
+         "                OUT     OBUF, OBUFSIZE\n"
+         "                ST      gr0, OBUFSIZE\n"
+         "                POP     gr7\n"
+         "                POP     gr6\n"
+         "                RET\n",
+         RUNTIME_BIT(NEWLINE) | RUNTIME_BIT(OBUFSIZE) | RUNTIME_BIT(OBUF)},
+    [RUNTIME_READINT] =
+        {"READINT",
+         "; gr1が指す番地に整数値一つを読み込む\n"
+         "; 読む位置はgr6に置いたまま，数字の並びは入力バッファから直接読む\n"
+         "READINT         RPUSH\n"
+         "                LD      gr6, INP  ; inp = INP;\n"
+         "                LD      gr7, RPBBUF  ; if(RPBBUF != 0) {\n"
+         "                JZE     RI1\n"
+         "                ST      gr0, RPBBUF  ;  ch = RPBBUF; RPBBUF = 0;\n"
+         "                JUMP    RI2  ; }\n"
+         "; do {\n"
+         "RI1             CALL    RDCH  ;  ch = RDCH();\n"
+         "RI2             CPA     gr7, SPACE  ; } while(ch==' ' || ch=='\\t' || ch=='\\n');\n"
+         "                JZE     RI1\n"
+         "                CPA     gr7, TAB\n"
+         "                JZE     RI1\n"
+         "                CPA     gr7, NEWLINE\n"
+         "                JZE     RI1\n"
+         "                LD      gr5, ONE  ; flag = 1\n"
+         "                CPA     gr7, MINUS  ; if(ch == '-') {\n"
+         "                JNZ     RI3\n"
+         "                LD      gr5, gr0  ;  flag = 0;\n"
+         "                CALL    RDCH  ;  ch = RDCH();\n"
+         "RI3             LD      gr4, gr0  ; v = 0;     ; }\n"
+         "RI4             CPA     gr7, ZERO  ; while('0' <= ch && ch <= '9') {\n"
+         "                JMI     RI6\n"
+         "                CPA     gr7, NINE\n"
+         "                JPL     RI6\n"
+         "                MULA    gr4, TEN  ;  v = v*10+ch-'0';\n"
+         "                ADDA    gr4, gr7\n"
+         "                SUBA    gr4, ZERO\n"
+         "                CPA     gr6, IBUFSIZE  ;  if(inp != IBUFSIZE) {\n"
+         "                JZE     RI5\n"
+         "                LD      gr7, IBUF,gr6  ;   ch = IBUF[inp++];\n"
+         "                LAD     gr6, 1,gr6\n"
+         "                JUMP    RI4  ;  }\n"
+         "RI5             CALL    RDCH  ;  else ch = RDCH();\n"
+         "                JUMP    RI4  ; }\n"
+         "RI6             ST      gr7, RPBBUF  ; ReadPushBack();\n"
+         "                ST      gr6, INP  ; INP = inp;\n"
+         "                ST      gr4, 0,gr1  ; *gr1 = v;\n"
+         "                CPA     gr5, gr0  ; if(flag == 0) {\n"
+         "                JNZ     RI7\n"
+         "                SUBA    gr5, gr4  ;  *gr1 = -v;\n"
+         "                ST      gr5, 0,gr1\n"
+         "; }\n"
+         "RI7             RPOP\n"
+         "                RET\n",
+         RUNTIME_BIT(RDCH) | RUNTIME_BIT(ONE) | RUNTIME_BIT(TEN) | RUNTIME_BIT(SPACE) |
+         RUNTIME_BIT(MINUS) | RUNTIME_BIT(TAB) | RUNTIME_BIT(ZERO) | RUNTIME_BIT(NINE) |
+         RUNTIME_BIT(NEWLINE) | RUNTIME_BIT(IBUFSIZE) | RUNTIME_BIT(INP) | RUNTIME_BIT(IBUF) |
+         RUNTIME_BIT(RPBBUF)},
+    [RUNTIME_RDCH] =
+        {"RDCH",
+         "; READINTの中で入力バッファから文字一つをgr7に読む\n"
+         "; gr6は読む位置で，呼び出し元が保持する\n"
+         "RDCH            LD      gr7, IBUFSIZE  ; if(IBUFSIZE == 0) {\n"
+         "                JNZ     RD1\n"
+         "                IN      IBUF, IBUFSIZE  ;  IN();\n"
+         "                LD      gr6, gr0  ;  inp = 0;\n"
+         "; }\n"
+         "RD1             CPA     gr6, IBUFSIZE  ; if(inp == IBUFSIZE) {\n"
+         "                JNZ     RD2\n"
+         "                LD      gr7, NEWLINE  ;  ch = '\\n';\n"
+         "                ST      gr0, IBUFSIZE  ;  IBUFSIZE = inp = 0;\n"
+         "                LD      gr6, gr0\n"
+         "                RET  ; }\n"
+         "RD2             LD      gr7, IBUF,gr6  ; ch = IBUF[inp++];\n"
+         "                LAD     gr6, 1,gr6\n"
+         "                RET\n",
+         RUNTIME_BIT(NEWLINE) | RUNTIME_BIT(IBUFSIZE) | RUNTIME_BIT(IBUF)},
+};
+
+/**
+ * @brief 実行時ライブラリのルーチンの定義を返す
+ * 
+ * @param routine ルーチン
+ * @param fast 最適化した実行時ライブラリを使うならtrue
+ * @return const RuntimeDefinition* ルーチンの定義。そのライブラリにないルーチンはnameがNULL
+ */
+static const RuntimeDefinition * runtimeDefinition(int routine, bool fast)
+{
+  if (fast && fast_runtime_library[routine].name != NULL) return &fast_runtime_library[routine];
+  return &runtime_library[routine];
+}
+
+/**
+ * @brief オペランドが実行時ライブラリのルーチンのラベルであれば、そのルーチンを返す
+ * 
+ * @param operand オペランドの先頭
+ * @param len オペランドの長さ
+ * @param fast 最適化した実行時ライブラリを使うならtrue
+ * @return int ルーチン。ルーチンのラベルでない場合は-1
+ */
+static int findRuntimeRoutine(const char * operand, size_t len, bool fast)
+{
+  // レジスタ、Lで始まるラベル、$で始まる変数、数値はどのルーチンのラベルとも一致しない
+  if (len == 0 || !isupper((unsigned char)operand[0]) || operand[0] == 'G' || operand[0] == 'L')
+    return -1;
+  for (int i = 0; i < NUM_RUNTIME_ROUTINES; i++) {
+    const char * name = runtimeDefinition(i, fast)->name;
+    if (name != NULL && strlen(name) == len && memcmp(name, operand, len) == 0) return i;
+  }
+  return -1;
+}
+
+/**
+ * @brief 生成したプログラムのオペランドから参照されている実行時ライブラリのルーチンの集合を求める
+ * 各行はラベル、命令、オペランドをタブで区切ったものとして読み、注釈の行と定数以降のオペランドは読み飛ばす
+ * @param buf 生成したプログラム
+ * @param len 生成したプログラムの長さ
+ * @param fast 最適化した実行時ライブラリを使うならtrue
+ * @return unsigned long long 参照されているルーチンの集合
+ */
+static unsigned long long referencedRoutines(const char * buf, size_t len, bool fast)
+{
+  unsigned long long used = 0;
+  const char * end = buf + len;
+  for (const char * line = buf; line < end;) {
+    const char * eol = memchr(line, '\n', end - line);
+    if (eol == NULL) eol = end;
+    const char * opcode = *line == ';' ? NULL : memchr(line, '\t', eol - line);
+    const char * p = opcode == NULL ? NULL : memchr(opcode + 1, '\t', eol - opcode - 1);
+    while (p != NULL && p < eol && p[1] != '=' && p[1] != '\'') {
+      const char * operand = p + 1;
+      p = memchr(operand, ',', eol - operand);
+      int routine = findRuntimeRoutine(operand, (p == NULL ? eol : p) - operand, fast);
+      if (routine >= 0) used |= 1ULL << routine;
+    }
+    line = eol + 1;
+  }
+  return used;
+}
+
+/**
+ * @brief 実行時ライブラリのうち、生成したプログラムから到達できるルーチンだけを出力バッファに書き込む
+ * 参照されているルーチンから依存関係をたどり、到達できるルーチンを定義の順に出力する
+ * @param emitter 生成したプログラムを書き込んだ出力バッファ
+ * @param fast 整数と文字列の入出力に最適化した実行時ライブラリを使うならtrue
+ */
+void outlib(Emitter * emitter, bool fast)
+{
+  unsigned long long used = referencedRoutines(emitter->buf, emitter->len, fast);
+  for (unsigned long long previous = 0; used != previous;) {
+    previous = used;
+    for (int i = 0; i < NUM_RUNTIME_ROUTINES; i++) {
+      if (used & (1ULL << i)) used |= runtimeDefinition(i, fast)->deps;
+    }
+  }
+
+  emitStr(emitter, runtime_header, sizeof(runtime_header) - 1);
+  for (int i = 0; i < NUM_RUNTIME_ROUTINES; i++) {
+    if (used & (1ULL << i)) emitCStr(emitter, runtimeDefinition(i, fast)->text);
+  }
 }
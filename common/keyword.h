@@ -0,0 +1,83 @@
+#ifndef KEYWORD_H
+#define KEYWORD_H
+/**
+ * @file
+ * MPPLの予約語を完全ハッシュで判定する為の表と関数を纏めている
+ * 
+ * 1/scan.c と 4/scan.c の双方から利用する。インクルードする前に
+ * TAND などのトークンIDが定義されている必要がある。
+ * 
+ * ハッシュ値は 長さ + asso[先頭の文字] + asso[末尾の一つ前の文字] + asso[末尾の文字] で求める。
+ * assoの値は28個の予約語が衝突しないように予め探索したものであり、予約語を追加した場合は
+ * keyword_tableと合わせて探索し直す必要がある。
+ */
+#include <string.h>
+
+/**
+ * @def MIN_KEYWORD_LENGTH
+ * 予約語の最小の長さ
+ */
+#define MIN_KEYWORD_LENGTH 2
+
+/**
+ * @def MAX_KEYWORD_LENGTH
+ * 予約語の最大の長さ
+ */
+#define MAX_KEYWORD_LENGTH 9
+
+/**
+ * @def MAX_KEYWORD_HASH
+ * 予約語のハッシュ値の最大値
+ */
+#define MAX_KEYWORD_HASH 53
+
+/**
+ * @brief ハッシュ値の計算に用いる文字ごとの重み
+ * 予約語に現れない文字は0とする
+ */
+static const unsigned char keyword_asso[256] = {
+  ['a'] = 3,  ['b'] = 2,  ['c'] = 12, ['d'] = 4,  ['e'] = 2,  ['f'] = 14, ['i'] = 12,
+  ['k'] = 4,  ['l'] = 17, ['n'] = 27, ['o'] = 8,  ['p'] = 1,  ['r'] = 1,  ['s'] = 17,
+  ['t'] = 14, ['u'] = 7,  ['v'] = 14, ['w'] = 2,  ['y'] = 13};
+
+/**
+ * @brief ハッシュ値を添字とする予約語の表
+ * 
+ */
+static const struct
+{
+  const char * keyword;
+  int keytoken;
+} keyword_table[MAX_KEYWORD_HASH + 1] = {
+  [11] = {"program", TPROGRAM}, [12] = {"read", TREAD},       [13] = {"procedure", TPROCEDURE},
+  [14] = {"break", TBREAK},     [18] = {"do", TDO},           [19] = {"or", TOR},
+  [20] = {"char", TCHAR},       [21] = {"var", TVAR},         [22] = {"integer", TINTEGER},
+  [23] = {"write", TWRITE},     [24] = {"array", TARRAY},     [25] = {"else", TELSE},
+  [26] = {"while", TWHILE},     [27] = {"true", TTRUE},       [32] = {"of", TOF},
+  [33] = {"div", TDIV},         [35] = {"return", TRETURN},   [36] = {"end", TEND},
+  [37] = {"and", TAND},         [38] = {"false", TFALSE},     [39] = {"boolean", TBOOLEAN},
+  [40] = {"if", TIF},           [46] = {"begin", TBEGIN},     [47] = {"then", TTHEN},
+  [50] = {"call", TCALL},       [51] = {"readln", TREADLN},   [52] = {"not", TNOT},
+  [53] = {"writeln", TWRITELN}};
+
+/**
+ * @brief 名前が予約語であるかを判定する
+ * 高々1回の文字列比較で判定できる
+ * @param str 名前の先頭を指すポインタ(終端文字は不要)
+ * @param len 名前の長さ
+ * @return int 予約語であればそのトークンID、そうでなければTNAME
+ */
+static inline int lookupKeyword(const char * str, size_t len)
+{
+  if (len < MIN_KEYWORD_LENGTH || len > MAX_KEYWORD_LENGTH) return TNAME;
+  unsigned int h = len + keyword_asso[(unsigned char)str[0]] +
+                   keyword_asso[(unsigned char)str[len - 2]] +
+                   keyword_asso[(unsigned char)str[len - 1]];
+  if (h > MAX_KEYWORD_HASH) return TNAME;
+  const char * keyword = keyword_table[h].keyword;
+  if (keyword == NULL || *keyword != *str) return TNAME;
+  if (strncmp(str, keyword, len) != 0 || keyword[len] != '\0') return TNAME;
+  return keyword_table[h].keytoken;
+}
+
+#endif